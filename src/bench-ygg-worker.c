@@ -0,0 +1,470 @@
+/*
+ * bench-ygg-worker.c
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+/*
+ * Measures end-to-end throughput and latency of a worker on a private bus.
+ *
+ * The benchmark plays the part of the dispatcher: it floods the worker with
+ * Dispatch calls, the worker echoes every message back with Transmit, and the
+ * mock dispatcher records when each echo arrives. Payloads above
+ * CHUNKED_THRESHOLD do not fit in a single D-Bus message, so they are
+ * dispatched in chunks and echoed with ygg_worker_transmit_stream().
+ *
+ * Allocations are counted across the whole process, so "allocs/msg" includes
+ * the benchmark's own side of each round trip as well as the worker's.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mock-dispatcher.h"
+#include "ygg.h"
+
+#define STARTED_KEY "Bench-Started"
+#define WINDOW 32
+#define CHUNKED_THRESHOLD (16 * 1024 * 1024)
+#define TOTAL_BYTES_PER_RUN (256 * 1024 * 1024)
+#define MAX_MESSAGES_PER_RUN 5000
+
+#ifdef __GLIBC__
+/*
+ * Count every heap allocation in the process, on every thread, by interposing
+ * the allocator entry points that GLib uses.
+ */
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n_members, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static gint n_allocations;
+
+void *
+malloc (size_t size)
+{
+  g_atomic_int_inc (&n_allocations);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n_members,
+        size_t size)
+{
+  g_atomic_int_inc (&n_allocations);
+  return __libc_calloc (n_members, size);
+}
+
+void *
+realloc (void   *ptr,
+         size_t  size)
+{
+  g_atomic_int_inc (&n_allocations);
+  return __libc_realloc (ptr, size);
+}
+#else
+static gint n_allocations;
+#endif
+
+typedef struct {
+  GDBusConnection *connection;
+  MockDispatcher  *dispatcher;
+  YggWorker       *worker;
+
+  GBytes          *payload;
+  guint            n_metadata;
+  guint            n_messages;
+  gboolean         chunked;
+  guint            n_chunks;
+
+  guint            sent;
+  guint            chunk;
+  gchar           *message_id;
+  gint64           message_started;
+  guint            in_flight;
+  guint            pending_transmits;
+  guint            completed;
+  GArray          *latencies;
+} Bench;
+
+/* Returns a memory figure from /proc/self/status, in KiB. */
+static gsize
+read_status_field (const gchar *field)
+{
+  g_autofree gchar *status = NULL;
+
+  if (!g_file_get_contents ("/proc/self/status", &status, NULL, NULL))
+    return 0;
+
+  const gchar *line = strstr (status, field);
+  if (line == NULL)
+    return 0;
+
+  return g_ascii_strtoull (line + strlen (field), NULL, 10);
+}
+
+static void
+reset_peak_rss (void)
+{
+  gint clear_refs = g_open ("/proc/self/clear_refs", O_WRONLY, 0);
+  if (clear_refs >= 0) {
+    (void) ! write (clear_refs, "5", 1);
+    g_close (clear_refs, NULL);
+  }
+}
+
+static void
+transmit_done (GObject      *source_object,
+               GAsyncResult *res,
+               gpointer      user_data)
+{
+  Bench *bench = (Bench *) user_data;
+  GError *error = NULL;
+  g_autoptr (YggMetadata) response_metadata = NULL;
+  g_autoptr (GBytes) response_data = NULL;
+
+  if (!ygg_worker_transmit_finish (YGG_WORKER (source_object), res, NULL, &response_metadata, &response_data, &error))
+    g_error ("Transmit failed: %s", error->message);
+  bench->pending_transmits--;
+}
+
+static void
+transmit_stream_done (GObject      *source_object,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+  Bench *bench = (Bench *) user_data;
+  GError *error = NULL;
+
+  if (!ygg_worker_transmit_stream_finish (YGG_WORKER (source_object), res, &error))
+    g_error ("Transmit failed: %s", error->message);
+  bench->pending_transmits--;
+}
+
+/* Echoes each message back to the dispatcher, as an echo worker would. */
+static void
+handle_rx (YggWorker   *worker,
+           gchar       *addr,
+           gchar       *id,
+           gchar       *response_to,
+           YggMetadata *metadata,
+           GBytes      *data,
+           gpointer     user_data)
+{
+  Bench *bench = (Bench *) user_data;
+  g_autofree gchar *response_id = g_uuid_string_random ();
+
+  bench->pending_transmits++;
+  ygg_worker_transmit (worker, addr, response_id, id, metadata, data, NULL, transmit_done, bench);
+
+  g_free (addr);
+  g_free (id);
+  g_free (response_to);
+  g_object_unref (metadata);
+  g_bytes_unref (data);
+}
+
+static void
+handle_stream_rx (YggWorker    *worker,
+                  gchar        *addr,
+                  gchar        *id,
+                  gchar        *response_to,
+                  YggMetadata  *metadata,
+                  GInputStream *stream,
+                  gpointer      user_data)
+{
+  Bench *bench = (Bench *) user_data;
+  g_autofree gchar *response_id = g_uuid_string_random ();
+  g_autoptr (YggMetadata) response_metadata = ygg_metadata_new ();
+
+  /* Pass on the timestamp, but not the chunk keys of the received stream */
+  ygg_metadata_set (response_metadata, STARTED_KEY, ygg_metadata_get (metadata, STARTED_KEY));
+
+  bench->pending_transmits++;
+  ygg_worker_transmit_stream (worker,
+                              addr,
+                              response_id,
+                              id,
+                              response_metadata,
+                              stream,
+                              YGG_WORKER_DEFAULT_CHUNK_SIZE,
+                              NULL,
+                              transmit_stream_done,
+                              bench);
+
+  g_free (addr);
+  g_free (id);
+  g_free (response_to);
+  g_object_unref (metadata);
+  g_object_unref (stream);
+}
+
+/* Records the end-to-end latency of each echoed message. */
+static void
+on_transmit (GVariant *parameters,
+             gpointer  user_data)
+{
+  Bench *bench = (Bench *) user_data;
+  g_autoptr (GVariant) metadata = g_variant_get_child_value (parameters, 3);
+  const gchar *started = NULL;
+
+  if (g_variant_lookup (metadata, YGG_WORKER_CHUNK_SEQUENCE, "&s", NULL) &&
+      !g_variant_lookup (metadata, YGG_WORKER_CHUNK_FINAL, "&s", NULL))
+    return;
+
+  if (!g_variant_lookup (metadata, STARTED_KEY, "&s", &started))
+    g_error ("echoed message has no %s key", STARTED_KEY);
+
+  gint64 latency = g_get_monotonic_time () - g_ascii_strtoll (started, NULL, 10);
+  g_array_append_val (bench->latencies, latency);
+  bench->completed++;
+}
+
+static void bench_pump (Bench *bench);
+
+static void
+dispatch_done (GObject      *source_object,
+               GAsyncResult *res,
+               gpointer      user_data)
+{
+  Bench *bench = (Bench *) user_data;
+  GError *error = NULL;
+
+  g_autoptr (GVariant) reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+  if (reply == NULL)
+    g_error ("Dispatch failed: %s", error->message);
+
+  bench->in_flight--;
+  bench_pump (bench);
+}
+
+/* Builds the parameters of the next Dispatch call: a whole message, or the
+ * next chunk of one. */
+static GVariant *
+bench_next_call (Bench *bench)
+{
+  g_autofree gchar *id = g_uuid_string_random ();
+  g_autofree gchar *started = NULL;
+  g_autoptr (GBytes) data = NULL;
+  GVariantBuilder metadata;
+
+  if (bench->chunk == 0) {
+    g_free (bench->message_id);
+    bench->message_id = g_strdup (id);
+    bench->message_started = g_get_monotonic_time ();
+  }
+  started = g_strdup_printf ("%" G_GINT64_FORMAT, bench->message_started);
+
+  g_variant_builder_init (&metadata, G_VARIANT_TYPE ("a{ss}"));
+  g_variant_builder_add (&metadata, "{ss}", STARTED_KEY, started);
+  for (guint i = 0; i < bench->n_metadata; i++) {
+    g_autofree gchar *key = g_strdup_printf ("X-Bench-Header-%u", i);
+    g_variant_builder_add (&metadata, "{ss}", key, "a typical header value");
+  }
+
+  if (bench->chunked) {
+    gsize size = g_bytes_get_size (bench->payload);
+    gsize offset = (gsize) bench->chunk * YGG_WORKER_DEFAULT_CHUNK_SIZE;
+    g_autofree gchar *sequence = g_strdup_printf ("%u", bench->chunk);
+
+    data = g_bytes_new_from_bytes (bench->payload, offset, MIN (size - offset, YGG_WORKER_DEFAULT_CHUNK_SIZE));
+    g_variant_builder_add (&metadata, "{ss}", YGG_WORKER_CHUNK_STREAM_ID, bench->message_id);
+    g_variant_builder_add (&metadata, "{ss}", YGG_WORKER_CHUNK_SEQUENCE, sequence);
+    if (++bench->chunk == bench->n_chunks) {
+      g_variant_builder_add (&metadata, "{ss}", YGG_WORKER_CHUNK_FINAL, "true");
+      bench->chunk = 0;
+      bench->sent++;
+    }
+  } else {
+    data = g_bytes_ref (bench->payload);
+    bench->sent++;
+  }
+
+  return g_variant_new ("(sss@a{ss}@ay)",
+                        "bench",
+                        id,
+                        "",
+                        g_variant_builder_end (&metadata),
+                        g_variant_new_from_bytes (G_VARIANT_TYPE_BYTESTRING, data, TRUE));
+}
+
+/* Keeps up to WINDOW Dispatch calls in flight until all are sent. */
+static void
+bench_pump (Bench *bench)
+{
+  while (bench->in_flight < WINDOW && bench->sent < bench->n_messages) {
+    bench->in_flight++;
+    g_dbus_connection_call (bench->connection,
+                            "com.redhat.Yggdrasil1.Worker1.ygg_worker_bench",
+                            "/com/redhat/Yggdrasil1/Worker1/ygg_worker_bench",
+                            "com.redhat.Yggdrasil1.Worker1",
+                            "Dispatch",
+                            bench_next_call (bench),
+                            NULL,
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            NULL,
+                            dispatch_done,
+                            bench);
+  }
+}
+
+static gint
+compare_latency (gconstpointer a,
+                 gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a;
+  gint64 y = *(const gint64 *) b;
+
+  return (x > y) - (x < y);
+}
+
+static gint64
+percentile (GArray *sorted,
+            guint   p)
+{
+  guint index = (sorted->len * p + 99) / 100;
+
+  return g_array_index (sorted, gint64, index > 0 ? index - 1 : 0);
+}
+
+static void
+bench_run (Bench *bench,
+           gsize  payload_size,
+           guint  n_metadata)
+{
+  guint8 *payload = g_malloc (payload_size);
+  memset (payload, 'x', payload_size);
+
+  bench->payload = g_bytes_new_take (payload, payload_size);
+  bench->n_metadata = n_metadata;
+  bench->n_messages = CLAMP (TOTAL_BYTES_PER_RUN / MAX (payload_size, 1), 4, MAX_MESSAGES_PER_RUN);
+  bench->chunked = payload_size > CHUNKED_THRESHOLD;
+  bench->n_chunks = (payload_size + YGG_WORKER_DEFAULT_CHUNK_SIZE - 1) / YGG_WORKER_DEFAULT_CHUNK_SIZE;
+  bench->sent = 0;
+  bench->chunk = 0;
+  bench->completed = 0;
+  bench->latencies = g_array_sized_new (FALSE, FALSE, sizeof (gint64), bench->n_messages);
+
+  reset_peak_rss ();
+  gint allocations = g_atomic_int_get (&n_allocations);
+  gint64 start = g_get_monotonic_time ();
+
+  bench_pump (bench);
+  while (bench->completed < bench->n_messages || bench->pending_transmits > 0 || bench->in_flight > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  gdouble elapsed = (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC;
+  allocations = g_atomic_int_get (&n_allocations) - allocations;
+  g_array_sort (bench->latencies, compare_latency);
+
+  g_print ("%12" G_GSIZE_FORMAT " %8u %8u %12.1f %10" G_GINT64_FORMAT " %10" G_GINT64_FORMAT " %12" G_GSIZE_FORMAT " %12" G_GSIZE_FORMAT " %10.1f\n",
+           payload_size,
+           n_metadata,
+           bench->n_messages,
+           bench->n_messages / elapsed,
+           percentile (bench->latencies, 50),
+           percentile (bench->latencies, 99),
+           read_status_field ("VmHWM:"),
+           read_status_field ("VmRSS:"),
+           (gdouble) allocations / bench->n_messages);
+
+  g_clear_pointer (&bench->payload, g_bytes_unref);
+  g_clear_pointer (&bench->latencies, g_array_unref);
+  g_clear_pointer (&bench->message_id, g_free);
+}
+
+static void
+name_appeared (GDBusConnection *connection,
+               const gchar     *name,
+               const gchar     *name_owner,
+               gpointer         user_data)
+{
+  *(gboolean *) user_data = TRUE;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  static const gsize payload_sizes[] = {
+    0, 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 64 * 1024 * 1024,
+  };
+  static const guint metadata_sizes[] = { 0, 8, 64 };
+  GError *error = NULL;
+  Bench bench = { 0 };
+
+  setlocale (LC_ALL, "");
+  g_setenv ("DBUS_STARTER_BUS_TYPE", "session", TRUE);
+
+  g_autoptr (GTestDBus) dbus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  g_test_dbus_up (dbus);
+
+  bench.connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+  if (bench.connection == NULL)
+    g_error ("%s", error->message);
+
+  bench.dispatcher = mock_dispatcher_new (bench.connection, &error);
+  if (bench.dispatcher == NULL)
+    g_error ("%s", error->message);
+  bench.dispatcher->transmit_func = on_transmit;
+  bench.dispatcher->transmit_func_user_data = &bench;
+
+  bench.worker = ygg_worker_new ("ygg_worker_bench", FALSE, NULL);
+  ygg_worker_set_rx_func (bench.worker, handle_rx, &bench, NULL);
+  ygg_worker_set_stream_rx_func (bench.worker, handle_stream_rx, &bench, NULL);
+  if (!ygg_worker_connect (bench.worker, &error))
+    g_error ("%s", error->message);
+
+  gboolean appeared = FALSE;
+  guint watch_id = g_bus_watch_name_on_connection (bench.connection,
+                                                   "com.redhat.Yggdrasil1.Worker1.ygg_worker_bench",
+                                                   G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                   name_appeared,
+                                                   NULL,
+                                                   &appeared,
+                                                   NULL);
+  while (!appeared)
+    g_main_context_iteration (NULL, TRUE);
+  g_bus_unwatch_name (watch_id);
+
+  g_print ("%12s %8s %8s %12s %10s %10s %12s %12s %10s\n",
+           "payload (B)", "metadata", "messages", "messages/s", "p50 (us)", "p99 (us)", "HWM (KiB)", "RSS (KiB)",
+           "allocs/msg");
+
+  /* Warm up the connections and the worker's dispatcher proxy */
+  bench_run (&bench, 0, 0);
+
+  for (guint i = 0; i < G_N_ELEMENTS (payload_sizes); i++)
+    bench_run (&bench, payload_sizes[i], 8);
+  for (guint i = 0; i < G_N_ELEMENTS (metadata_sizes); i++)
+    bench_run (&bench, 1024, metadata_sizes[i]);
+
+  g_clear_object (&bench.worker);
+  mock_dispatcher_free (bench.dispatcher);
+  g_clear_object (&bench.connection);
+  g_test_dbus_down (dbus);
+
+  return 0;
+}
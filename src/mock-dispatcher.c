@@ -0,0 +1,158 @@
+/*
+ * mock-dispatcher.c
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "mock-dispatcher.h"
+#include "ygg.h"
+
+static const gchar dispatcher_introspection_xml[] =
+  "<node>"
+  "  <interface name='com.redhat.Yggdrasil1.Dispatcher1'>"
+  "    <method name='Transmit'>"
+  "      <arg type='s' name='addr' direction='in'/>"
+  "      <arg type='s' name='id' direction='in'/>"
+  "      <arg type='s' name='response_to' direction='in'/>"
+  "      <arg type='a{ss}' name='metadata' direction='in'/>"
+  "      <arg type='ay' name='data' direction='in'/>"
+  "      <arg type='i' name='response_code' direction='out'/>"
+  "      <arg type='a{ss}' name='response_metadata' direction='out'/>"
+  "      <arg type='ay' name='response_data' direction='out'/>"
+  "    </method>"
+  "    <signal name='Event'>"
+  "      <arg type='u' name='event'/>"
+  "    </signal>"
+  "  </interface>"
+  "</node>";
+
+static void
+handle_dispatcher_method_call (GDBusConnection       *connection,
+                               const gchar           *sender,
+                               const gchar           *object_path,
+                               const gchar           *interface_name,
+                               const gchar           *method_name,
+                               GVariant              *parameters,
+                               GDBusMethodInvocation *invocation,
+                               gpointer               user_data)
+{
+  MockDispatcher *dispatcher = (MockDispatcher *) user_data;
+
+  g_assert_cmpstr (method_name, ==, "Transmit");
+
+  if (dispatcher->n_transmit_failures > 0) {
+    dispatcher->n_transmit_failures--;
+    g_dbus_method_invocation_return_dbus_error (invocation,
+                                                "org.freedesktop.DBus.Error.Timeout",
+                                                "mock transmit failure");
+    return;
+  }
+
+  g_autoptr (GVariant) metadata = g_variant_get_child_value (parameters, 3);
+  g_autoptr (GVariant) data = g_variant_get_child_value (parameters, 4);
+
+  dispatcher->bytes_received += g_variant_get_size (data);
+  if (g_variant_lookup (metadata, YGG_WORKER_CHUNK_SEQUENCE, "&s", NULL)) {
+    dispatcher->n_chunks++;
+  }
+  if (g_variant_lookup (metadata, YGG_WORKER_CHUNK_FINAL, "&s", NULL)) {
+    dispatcher->final_chunk_received = TRUE;
+  }
+  if (dispatcher->transmit_func != NULL) {
+    dispatcher->transmit_func (parameters, dispatcher->transmit_func_user_data);
+  }
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(i@a{ss}@ay)", 0, metadata, data));
+}
+
+static const GDBusInterfaceVTable dispatcher_vtable = {
+  handle_dispatcher_method_call,
+  NULL,
+  NULL,
+  { 0 }
+};
+
+/**
+ * mock_dispatcher_new:
+ * @connection: A #GDBusConnection to a private test bus.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Exports a mock dispatcher on @connection and claims the
+ * com.redhat.Yggdrasil1.Dispatcher1 name for it.
+ *
+ * Returns: (transfer full) (nullable): A new #MockDispatcher, or %NULL on
+ * error.
+ */
+MockDispatcher *
+mock_dispatcher_new (GDBusConnection  *connection,
+                     GError          **error)
+{
+  g_autoptr (GDBusNodeInfo) node_info = g_dbus_node_info_new_for_xml (dispatcher_introspection_xml, error);
+  if (node_info == NULL) {
+    return NULL;
+  }
+
+  MockDispatcher *dispatcher = g_new0 (MockDispatcher, 1);
+  dispatcher->connection = g_object_ref (connection);
+  dispatcher->registration_id = g_dbus_connection_register_object (connection,
+                                                                   "/com/redhat/Yggdrasil1/Dispatcher1",
+                                                                   node_info->interfaces[0],
+                                                                   &dispatcher_vtable,
+                                                                   dispatcher,
+                                                                   NULL,
+                                                                   error);
+  if (dispatcher->registration_id == 0) {
+    mock_dispatcher_free (dispatcher);
+    return NULL;
+  }
+
+  g_autoptr (GVariant) reply = g_dbus_connection_call_sync (connection,
+                                                            "org.freedesktop.DBus",
+                                                            "/org/freedesktop/DBus",
+                                                            "org.freedesktop.DBus",
+                                                            "RequestName",
+                                                            g_variant_new ("(su)", "com.redhat.Yggdrasil1.Dispatcher1", 0x4),
+                                                            G_VARIANT_TYPE ("(u)"),
+                                                            G_DBUS_CALL_FLAGS_NONE,
+                                                            -1,
+                                                            NULL,
+                                                            error);
+  if (reply == NULL) {
+    mock_dispatcher_free (dispatcher);
+    return NULL;
+  }
+
+  return dispatcher;
+}
+
+/**
+ * mock_dispatcher_free:
+ * @dispatcher: A #MockDispatcher.
+ *
+ * Unexports @dispatcher and frees it.
+ */
+void
+mock_dispatcher_free (MockDispatcher *dispatcher)
+{
+  if (dispatcher->registration_id != 0) {
+    g_dbus_connection_unregister_object (dispatcher->connection, dispatcher->registration_id);
+  }
+  g_object_unref (dispatcher->connection);
+  g_free (dispatcher);
+}
@@ -0,0 +1,65 @@
+/*
+ * mock-dispatcher.h
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/**
+ * MockDispatcherTransmitFunc:
+ * @parameters: The parameters of a Transmit call.
+ * @user_data: (closure): Data passed to the function when it is invoked.
+ *
+ * Signature of a function invoked for every Transmit call the mock dispatcher
+ * receives, before it replies.
+ */
+typedef void (* MockDispatcherTransmitFunc) (GVariant *parameters,
+                                             gpointer  user_data);
+
+/**
+ * MockDispatcher:
+ *
+ * An in-process com.redhat.Yggdrasil1.Dispatcher1 that echoes the metadata and
+ * data of each Transmit call back to the caller, and keeps count of what it
+ * received. While @n_transmit_failures is non-zero, Transmit calls are
+ * instead failed with org.freedesktop.DBus.Error.Timeout, and the counter is
+ * decremented.
+ */
+typedef struct {
+  GDBusConnection            *connection;
+  guint                       registration_id;
+  guint64                     bytes_received;
+  guint                       n_chunks;
+  gboolean                    final_chunk_received;
+  guint                       n_transmit_failures;
+  MockDispatcherTransmitFunc  transmit_func;
+  gpointer                    transmit_func_user_data;
+} MockDispatcher;
+
+MockDispatcher *mock_dispatcher_new (GDBusConnection  *connection,
+                                     GError          **error);
+
+void mock_dispatcher_free (MockDispatcher *dispatcher);
+
+G_END_DECLS
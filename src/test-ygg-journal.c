@@ -0,0 +1,334 @@
+/*
+ * test-ygg-journal.c
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <locale.h>
+
+#include "ygg-journal-private.h"
+
+typedef struct {
+  gchar *directory;
+  gchar *path;
+} TestFixture;
+
+static void
+fixture_setup (TestFixture   *fixture,
+               gconstpointer  user_data)
+{
+  GError *error = NULL;
+
+  fixture->directory = g_dir_make_tmp ("test-ygg-journal-XXXXXX", &error);
+  g_assert_no_error (error);
+  fixture->path = g_build_filename (fixture->directory, "test.journal", NULL);
+}
+
+static void
+fixture_teardown (TestFixture   *fixture,
+                  gconstpointer  user_data)
+{
+  g_unlink (fixture->path);
+  g_rmdir (fixture->directory);
+  g_free (fixture->path);
+  g_free (fixture->directory);
+}
+
+static GVariant *
+build_message (const gchar *id,
+               gsize        data_size)
+{
+  g_autofree guint8 *data = g_malloc0 (data_size);
+
+  return g_variant_ref_sink (g_variant_new ("(sss@a{ss}@ay)",
+                                            "test",
+                                            id,
+                                            "",
+                                            g_variant_new_parsed ("@a{ss} {'key': 'value'}"),
+                                            g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, data, data_size, 1)));
+}
+
+static YggJournalEntry *
+append_message (YggJournal  *journal,
+                const gchar *id,
+                gsize        data_size)
+{
+  GError *error = NULL;
+  YggJournalEntry *entry = NULL;
+  g_autoptr (GVariant) value = build_message (id, data_size);
+
+  g_assert_true (ygg_journal_append (journal, value, &entry, &error));
+  g_assert_no_error (error);
+  g_assert_nonnull (entry);
+
+  return entry;
+}
+
+static void
+collect_pending (YggJournalEntry *entry,
+                 GVariant        *value,
+                 gpointer         user_data)
+{
+  const gchar *id = NULL;
+
+  g_variant_get_child (value, 1, "&s", &id);
+  g_ptr_array_add ((GPtrArray *) user_data, g_strdup (id));
+}
+
+static GPtrArray *
+reopen_and_collect (const gchar *path)
+{
+  GError *error = NULL;
+  g_autoptr (GPtrArray) ids = g_ptr_array_new_with_free_func (g_free);
+
+  g_autoptr (YggJournal) journal = ygg_journal_open (path, 16, FALSE, &error);
+  g_assert_no_error (error);
+  ygg_journal_foreach_pending (journal, collect_pending, ids);
+  g_assert_cmpuint (ygg_journal_get_n_pending (journal), ==, ids->len);
+
+  return g_steal_pointer (&ids);
+}
+
+static void
+test_journal_recover (TestFixture   *fixture,
+                      gconstpointer  user_data)
+{
+  GError *error = NULL;
+
+  YggJournal *journal = ygg_journal_open (fixture->path, 16, TRUE, &error);
+  g_assert_no_error (error);
+  append_message (journal, "1", 5);
+  YggJournalEntry *second = append_message (journal, "2", 5);
+  append_message (journal, "3", 5);
+  ygg_journal_complete (journal, second);
+  g_assert_cmpuint (ygg_journal_get_n_pending (journal), ==, 2);
+  ygg_journal_free (journal);
+
+  /* Only the messages that were not completed are recovered, in order */
+  g_autoptr (GPtrArray) ids = reopen_and_collect (fixture->path);
+  g_assert_cmpuint (ids->len, ==, 2);
+  g_assert_cmpstr (g_ptr_array_index (ids, 0), ==, "1");
+  g_assert_cmpstr (g_ptr_array_index (ids, 1), ==, "3");
+}
+
+static void
+test_journal_completed (TestFixture   *fixture,
+                        gconstpointer  user_data)
+{
+  GError *error = NULL;
+
+  YggJournal *journal = ygg_journal_open (fixture->path, 16, FALSE, &error);
+  g_assert_no_error (error);
+  YggJournalEntry *first = append_message (journal, "1", 5);
+  YggJournalEntry *second = append_message (journal, "2", 5);
+  ygg_journal_complete (journal, first);
+  ygg_journal_complete (journal, second);
+  append_message (journal, "3", 5);
+  ygg_journal_free (journal);
+
+  g_autoptr (GPtrArray) ids = reopen_and_collect (fixture->path);
+  g_assert_cmpuint (ids->len, ==, 1);
+  g_assert_cmpstr (g_ptr_array_index (ids, 0), ==, "3");
+
+  /* Completed messages are still recognized after reopening */
+  journal = ygg_journal_open (fixture->path, 16, FALSE, &error);
+  g_assert_no_error (error);
+  g_assert_true (ygg_journal_lookup_id (journal, "1"));
+  g_assert_true (ygg_journal_lookup_id (journal, "2"));
+  ygg_journal_free (journal);
+}
+
+static void
+test_journal_grow (TestFixture   *fixture,
+                   gconstpointer  user_data)
+{
+  GError *error = NULL;
+  const guint n_messages = 64;
+
+  /* Keep every other message pending, so the journal has to be rewritten */
+  YggJournal *journal = ygg_journal_open (fixture->path, 16, FALSE, &error);
+  g_assert_no_error (error);
+  for (guint i = 0; i < n_messages; i++) {
+    g_autofree gchar *id = g_strdup_printf ("%u", i);
+    YggJournalEntry *entry = append_message (journal, id, 64 * 1024);
+    if (i % 2 == 1) {
+      ygg_journal_complete (journal, entry);
+    }
+  }
+  ygg_journal_free (journal);
+
+  g_autoptr (GPtrArray) ids = reopen_and_collect (fixture->path);
+  g_assert_cmpuint (ids->len, ==, n_messages / 2);
+  for (guint i = 0; i < ids->len; i++) {
+    g_autofree gchar *id = g_strdup_printf ("%u", i * 2);
+    g_assert_cmpstr (g_ptr_array_index (ids, i), ==, id);
+  }
+
+  /* The most recent IDs outlive the rewrites, completed or not */
+  journal = ygg_journal_open (fixture->path, 16, FALSE, &error);
+  g_assert_no_error (error);
+  for (guint i = n_messages - 16; i < n_messages; i++) {
+    g_autofree gchar *id = g_strdup_printf ("%u", i);
+    g_assert_true (ygg_journal_lookup_id (journal, id));
+  }
+  ygg_journal_free (journal);
+}
+
+static goffset
+journal_file_size (const gchar *path)
+{
+  GStatBuf st;
+
+  g_assert_cmpint (g_stat (path, &st), ==, 0);
+
+  return st.st_size;
+}
+
+static void
+test_journal_bounded (TestFixture   *fixture,
+                      gconstpointer  user_data)
+{
+  GError *error = NULL;
+  const guint n_cycles = 10000;
+  const goffset max_size = 256 * 1024;
+
+  YggJournal *journal = ygg_journal_open (fixture->path, 16, FALSE, &error);
+  g_assert_no_error (error);
+
+  /* A journal that grew for a large message shrinks once it is done */
+  ygg_journal_complete (journal, append_message (journal, "large", 1024 * 1024));
+  g_assert_cmpint (journal_file_size (fixture->path), <=, max_size);
+
+  /* Completed records are compacted away instead of growing the file */
+  for (guint i = 0; i < n_cycles; i++) {
+    g_autofree gchar *id = g_strdup_printf ("%u", i);
+    ygg_journal_complete (journal, append_message (journal, id, 256));
+  }
+  g_assert_cmpint (journal_file_size (fixture->path), <=, max_size);
+  ygg_journal_free (journal);
+
+  journal = ygg_journal_open (fixture->path, 16, FALSE, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (ygg_journal_get_n_pending (journal), ==, 0);
+  g_autofree gchar *last_id = g_strdup_printf ("%u", n_cycles - 1);
+  g_assert_true (ygg_journal_lookup_id (journal, last_id));
+  ygg_journal_free (journal);
+}
+
+static void
+test_journal_dedup (TestFixture   *fixture,
+                    gconstpointer  user_data)
+{
+  GError *error = NULL;
+
+  YggJournal *journal = ygg_journal_open (fixture->path, 2, FALSE, &error);
+  g_assert_no_error (error);
+  ygg_journal_complete (journal, append_message (journal, "1", 5));
+  append_message (journal, "2", 5);
+  g_assert_true (ygg_journal_lookup_id (journal, "1"));
+  g_assert_false (ygg_journal_lookup_id (journal, "3"));
+
+  /* "2" is the least recently used ID, so it is forgotten first */
+  append_message (journal, "3", 5);
+  g_assert_true (ygg_journal_lookup_id (journal, "1"));
+  g_assert_false (ygg_journal_lookup_id (journal, "2"));
+  g_assert_true (ygg_journal_lookup_id (journal, "3"));
+  ygg_journal_free (journal);
+
+  /* IDs of recorded messages are remembered across reopening */
+  journal = ygg_journal_open (fixture->path, 2, FALSE, &error);
+  g_assert_no_error (error);
+  g_assert_true (ygg_journal_lookup_id (journal, "3"));
+  ygg_journal_free (journal);
+}
+
+static void
+test_journal_not_a_journal (TestFixture   *fixture,
+                            gconstpointer  user_data)
+{
+  GError *error = NULL;
+
+  g_assert_true (g_file_set_contents (fixture->path, "this file is not a journal file.", -1, &error));
+  g_assert_no_error (error);
+
+  YggJournal *journal = ygg_journal_open (fixture->path, 16, FALSE, &error);
+  g_assert_null (journal);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_clear_error (&error);
+}
+
+static void
+count_pending (YggJournalEntry *entry,
+               GVariant        *value,
+               gpointer         user_data)
+{
+  (*(guint *) user_data)++;
+}
+
+static void
+test_journal_perf_recover (TestFixture   *fixture,
+                           gconstpointer  user_data)
+{
+  GError *error = NULL;
+  const guint n_messages = 100000;
+
+  if (!g_test_perf ()) {
+    g_test_skip ("not running in perf mode");
+    return;
+  }
+
+  YggJournal *journal = ygg_journal_open (fixture->path, 4096, FALSE, &error);
+  g_assert_no_error (error);
+  for (guint i = 0; i < n_messages; i++) {
+    g_autofree gchar *id = g_uuid_string_random ();
+    append_message (journal, id, 256);
+  }
+  ygg_journal_free (journal);
+
+  guint n_recovered = 0;
+  g_test_timer_start ();
+  journal = ygg_journal_open (fixture->path, 4096, FALSE, &error);
+  g_assert_no_error (error);
+  ygg_journal_foreach_pending (journal, count_pending, &n_recovered);
+  gdouble elapsed = g_test_timer_elapsed ();
+  ygg_journal_free (journal);
+
+  g_assert_cmpuint (n_recovered, ==, n_messages);
+  g_test_minimized_result (elapsed,
+                           "%.1f ms to recover %u pending messages", elapsed * 1e3, n_messages);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  setlocale (LC_ALL, "");
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/ygg/journal/recover", TestFixture, NULL, fixture_setup, test_journal_recover, fixture_teardown);
+  g_test_add ("/ygg/journal/completed", TestFixture, NULL, fixture_setup, test_journal_completed, fixture_teardown);
+  g_test_add ("/ygg/journal/grow", TestFixture, NULL, fixture_setup, test_journal_grow, fixture_teardown);
+  g_test_add ("/ygg/journal/bounded", TestFixture, NULL, fixture_setup, test_journal_bounded, fixture_teardown);
+  g_test_add ("/ygg/journal/dedup", TestFixture, NULL, fixture_setup, test_journal_dedup, fixture_teardown);
+  g_test_add ("/ygg/journal/not_a_journal", TestFixture, NULL, fixture_setup, test_journal_not_a_journal, fixture_teardown);
+  g_test_add ("/ygg/journal/perf/recover", TestFixture, NULL, fixture_setup, test_journal_perf_recover, fixture_teardown);
+
+  return g_test_run ();
+}
@@ -23,6 +23,7 @@
 #include <locale.h>
 
 #include "ygg.h"
+#include "ygg-metadata-private.h"
 
 static void
 test_ygg_metadata_set (void)
@@ -44,6 +45,31 @@ test_ygg_metadata_to_variant (void)
   g_assert_true (g_variant_check_format_string (variant, "a{ss}", FALSE));
 }
 
+static void
+test_ygg_metadata_ref_variant_cached (void)
+{
+  g_autoptr (YggMetadata) metadata = ygg_metadata_new ();
+  g_assert_true (ygg_metadata_set (metadata, "ke", "ka"));
+
+  g_autoptr (GVariant) first = ygg_metadata_ref_variant (metadata);
+  g_autoptr (GVariant) second = ygg_metadata_ref_variant (metadata);
+  g_assert_false (g_variant_is_floating (first));
+  g_assert_true (first == second);
+
+  /* The public serialization is a floating variant sharing the cached data */
+  GVariant *floating = ygg_metadata_to_variant (metadata);
+  g_assert_true (g_variant_is_floating (floating));
+  g_autoptr (GVariant) copy = g_variant_ref_sink (floating);
+  g_assert_true (copy != first);
+  g_assert_true (g_variant_get_data (copy) == g_variant_get_data (first));
+
+  g_assert_true (ygg_metadata_set (metadata, "he", "ha"));
+  g_autoptr (GVariant) third = ygg_metadata_ref_variant (metadata);
+  g_assert_true (third != first);
+  g_autofree gchar *printed = g_variant_print (third, TRUE);
+  g_assert_cmpstr (printed, ==, "{'he': 'ha', 'ke': 'ka'}");
+}
+
 static void
 test_ygg_metadata_new_from_variant (void)
 {
@@ -54,6 +80,26 @@ test_ygg_metadata_new_from_variant (void)
   g_assert_cmpstr (ygg_metadata_get (metadata, "ke"), ==, "ka");
 }
 
+static void
+test_ygg_metadata_new_from_variant_view (void)
+{
+  GError *err = NULL;
+  GVariant *variant = g_variant_ref_sink (g_variant_new_parsed ("{'ke': 'ka', 'he': 'ha'}"));
+  g_autoptr (YggMetadata) metadata = ygg_metadata_new_from_variant (variant, &err);
+  g_assert_null (err);
+
+  /* The metadata keeps the variant it refers to alive */
+  g_variant_unref (variant);
+  g_assert_cmpstr (ygg_metadata_get (metadata, "ke"), ==, "ka");
+
+  /* Modifying the metadata copies it */
+  g_assert_false (ygg_metadata_set (metadata, "ke", "ki"));
+  g_assert_true (ygg_metadata_set (metadata, "ho", "hi"));
+  g_assert_cmpstr (ygg_metadata_get (metadata, "ke"), ==, "ki");
+  g_assert_cmpstr (ygg_metadata_get (metadata, "he"), ==, "ha");
+  g_assert_cmpstr (ygg_metadata_get (metadata, "ho"), ==, "hi");
+}
+
 static void
 _foreach (const gchar *key,
           const gchar *val,
@@ -77,6 +123,131 @@ test_ygg_metadata_foreach (void)
   g_list_free_full (keys, g_free);
 }
 
+static void
+_count_sorted (const gchar *key,
+               const gchar *val,
+               gpointer     user_data)
+{
+  GPtrArray *keys = (GPtrArray *) user_data;
+  if (keys->len > 0)
+    g_assert_cmpstr (g_ptr_array_index (keys, keys->len - 1), <, key);
+  g_ptr_array_add (keys, (gpointer) key);
+}
+
+static void
+test_ygg_metadata_many (void)
+{
+  g_autoptr (YggMetadata) metadata = ygg_metadata_new ();
+  g_autoptr (GPtrArray) keys = g_ptr_array_new ();
+
+  /* Enough keys to cross over from the flat array to the hash index */
+  for (guint i = 0; i < 100; i++) {
+    g_autofree gchar *key = g_strdup_printf ("key-%u", (i * 37) % 100);
+    g_autofree gchar *val = g_strdup_printf ("val-%u", (i * 37) % 100);
+    g_assert_true (ygg_metadata_set (metadata, key, val));
+  }
+  g_assert_false (ygg_metadata_set (metadata, "key-42", "replaced"));
+
+  for (guint i = 0; i < 100; i++) {
+    g_autofree gchar *key = g_strdup_printf ("key-%u", i);
+    g_autofree gchar *val = g_strdup_printf ("val-%u", i);
+    g_assert_cmpstr (ygg_metadata_get (metadata, key), ==, i == 42 ? "replaced" : val);
+  }
+  g_assert_null (ygg_metadata_get (metadata, "key-100"));
+
+  ygg_metadata_foreach (metadata, _count_sorted, keys);
+  g_assert_cmpuint (keys->len, ==, 100);
+}
+
+static GVariant *
+build_metadata_variant (guint n_keys)
+{
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
+  for (guint i = 0; i < n_keys; i++) {
+    g_autofree gchar *key = g_strdup_printf ("X-Header-%u", i);
+    g_variant_builder_add (&builder, "{ss}", key, "some value");
+  }
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static void
+test_ygg_metadata_perf_new_from_variant (void)
+{
+  const guint n_iterations = 100000;
+  g_autoptr (GVariant) variant = build_metadata_variant (8);
+
+  if (!g_test_perf ()) {
+    g_test_skip ("not running in perf mode");
+    return;
+  }
+
+  g_test_timer_start ();
+  for (guint i = 0; i < n_iterations; i++) {
+    YggMetadata *metadata = ygg_metadata_new_from_variant (variant, NULL);
+    g_object_unref (metadata);
+  }
+  gdouble elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed / n_iterations * 1e9,
+                           "%.0f ns per 8-key construction", elapsed / n_iterations * 1e9);
+}
+
+static void
+test_ygg_metadata_perf_get (void)
+{
+  const guint n_iterations = 1000000;
+  g_autoptr (GVariant) variant = build_metadata_variant (8);
+  g_autoptr (YggMetadata) metadata = ygg_metadata_new_from_variant (variant, NULL);
+  const gchar *keys[] = { "X-Header-0", "X-Header-5", "X-Header-7", "missing" };
+
+  if (!g_test_perf ()) {
+    g_test_skip ("not running in perf mode");
+    return;
+  }
+
+  g_test_timer_start ();
+  for (guint i = 0; i < n_iterations; i++) {
+    (void) ygg_metadata_get (metadata, keys[i % G_N_ELEMENTS (keys)]);
+  }
+  gdouble elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed / n_iterations * 1e9,
+                           "%.1f ns per lookup", elapsed / n_iterations * 1e9);
+}
+
+static void
+_count (const gchar *key,
+        const gchar *val,
+        gpointer     user_data)
+{
+  (*(guint *) user_data)++;
+}
+
+static void
+test_ygg_metadata_perf_foreach (void)
+{
+  const guint n_iterations = 1000000;
+  g_autoptr (GVariant) variant = build_metadata_variant (8);
+  g_autoptr (YggMetadata) metadata = ygg_metadata_new_from_variant (variant, NULL);
+  guint count = 0;
+
+  if (!g_test_perf ()) {
+    g_test_skip ("not running in perf mode");
+    return;
+  }
+
+  g_test_timer_start ();
+  for (guint i = 0; i < n_iterations; i++) {
+    ygg_metadata_foreach (metadata, _count, &count);
+  }
+  gdouble elapsed = g_test_timer_elapsed ();
+
+  g_assert_cmpuint (count, ==, n_iterations * 8);
+  g_test_minimized_result (elapsed / n_iterations * 1e9,
+                           "%.1f ns per 8-key iteration", elapsed / n_iterations * 1e9);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -86,8 +257,14 @@ main (int   argc,
 
   g_test_add_func ("/ygg/metadata/set", test_ygg_metadata_set);
   g_test_add_func ("/ygg/metadata/to_variant", test_ygg_metadata_to_variant);
+  g_test_add_func ("/ygg/metadata/ref_variant/cached", test_ygg_metadata_ref_variant_cached);
   g_test_add_func ("/ygg/metadata/new_from_variant", test_ygg_metadata_new_from_variant);
+  g_test_add_func ("/ygg/metadata/new_from_variant/view", test_ygg_metadata_new_from_variant_view);
   g_test_add_func ("/ygg/metadata/foreach", test_ygg_metadata_foreach);
+  g_test_add_func ("/ygg/metadata/many", test_ygg_metadata_many);
+  g_test_add_func ("/ygg/metadata/perf/new_from_variant", test_ygg_metadata_perf_new_from_variant);
+  g_test_add_func ("/ygg/metadata/perf/get", test_ygg_metadata_perf_get);
+  g_test_add_func ("/ygg/metadata/perf/foreach", test_ygg_metadata_perf_foreach);
 
   return g_test_run ();
 }
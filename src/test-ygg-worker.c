@@ -20,16 +20,33 @@
  */
 
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
 #include <locale.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "mock-dispatcher.h"
 #include "ygg.h"
+#include "ygg-journal-private.h"
+#include "ygg-message-private.h"
 
 typedef struct {
-  GTestDBus *dbus;
-  YggWorker *worker;
+  GTestDBus       *dbus;
+  YggWorker       *worker;
+  GDBusConnection *connection;
+  MockDispatcher  *dispatcher;
 } TestFixture;
 
+typedef struct {
+  GMainLoop *loop;
+  gboolean   success;
+  gint       response_code;
+  GBytes    *response_data;
+  GError    *error;
+} TransmitResult;
+
 static void
 handle_rx (YggWorker   *worker,
            gchar       *addr,
@@ -41,6 +58,120 @@ handle_rx (YggWorker   *worker,
 {
 }
 
+static void
+transmit_done (GObject      *source_object,
+               GAsyncResult *res,
+               gpointer      user_data)
+{
+  TransmitResult *result = (TransmitResult *) user_data;
+  g_autoptr (YggMetadata) response_metadata = NULL;
+
+  result->success = ygg_worker_transmit_finish (YGG_WORKER (source_object),
+                                                res,
+                                                &result->response_code,
+                                                &response_metadata,
+                                                &result->response_data,
+                                                &result->error);
+  g_main_loop_quit (result->loop);
+}
+
+static gboolean
+transmit_and_wait (YggWorker  *worker,
+                   GBytes     *data,
+                   GBytes    **response_data,
+                   GError    **error)
+{
+  g_autoptr (GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+  g_autoptr (YggMetadata) metadata = ygg_metadata_new ();
+  g_autofree gchar *id = g_uuid_string_random ();
+  TransmitResult result = { loop, FALSE, -1, NULL, NULL };
+
+  ygg_worker_transmit (worker, "test", id, "", metadata, data, NULL, transmit_done, &result);
+  g_main_loop_run (loop);
+
+  if (result.error != NULL) {
+    g_propagate_error (error, result.error);
+  }
+  if (response_data != NULL) {
+    *response_data = result.response_data;
+  } else if (result.response_data != NULL) {
+    g_bytes_unref (result.response_data);
+  }
+
+  return result.success;
+}
+
+static void
+name_appeared (GDBusConnection *connection,
+               const gchar     *name,
+               const gchar     *name_owner,
+               gpointer         user_data)
+{
+  g_main_loop_quit ((GMainLoop *) user_data);
+}
+
+/**
+ * wait_for_worker:
+ *
+ * Runs the default main context until @directive's worker owns its bus name,
+ * which implies that its object has been exported.
+ */
+static void
+wait_for_worker (GDBusConnection *connection,
+                 const gchar     *directive)
+{
+  g_autoptr (GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+  g_autofree gchar *name = g_strjoin (".", "com.redhat.Yggdrasil1.Worker1", directive, NULL);
+
+  guint watch_id = g_bus_watch_name_on_connection (connection,
+                                                   name,
+                                                   G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                   name_appeared,
+                                                   NULL,
+                                                   loop,
+                                                   NULL);
+  g_main_loop_run (loop);
+  g_bus_unwatch_name (watch_id);
+}
+
+/**
+ * dispatch:
+ *
+ * Calls com.redhat.Yggdrasil1.Worker1.Dispatch on @directive's worker without
+ * waiting for the reply.
+ */
+static void
+dispatch (GDBusConnection     *connection,
+          const gchar         *directive,
+          const gchar         *id,
+          YggMetadata         *metadata,
+          GBytes              *data,
+          GAsyncReadyCallback  callback,
+          gpointer             user_data)
+{
+  g_autofree gchar *name = g_strjoin (".", "com.redhat.Yggdrasil1.Worker1", directive, NULL);
+  g_autofree gchar *path = g_strjoin ("/", "/com/redhat/Yggdrasil1/Worker1", directive, NULL);
+  g_autoptr (YggMetadata) empty = ygg_metadata_new ();
+
+  g_dbus_connection_call (connection,
+                          name,
+                          path,
+                          "com.redhat.Yggdrasil1.Worker1",
+                          "Dispatch",
+                          g_variant_new ("(sss@a{ss}@ay)",
+                                         "test",
+                                         id,
+                                         "",
+                                         ygg_metadata_to_variant (metadata != NULL ? metadata : empty),
+                                         g_variant_new_from_bytes (G_VARIANT_TYPE_BYTESTRING, data, TRUE)),
+                          NULL,
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          callback,
+                          user_data);
+}
+
 static void
 fixture_setup (TestFixture   *fixture,
                gconstpointer  user_data)
@@ -71,6 +202,26 @@ fixture_setup (TestFixture   *fixture,
   ygg_worker_set_rx_func (fixture->worker, handle_rx, NULL, NULL);
 }
 
+static void
+dispatcher_fixture_setup (TestFixture   *fixture,
+                          gconstpointer  user_data)
+{
+  GError *error = NULL;
+
+  fixture_setup (fixture, user_data);
+
+  /* Export a mock dispatcher on the private bus
+   */
+  fixture->connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+  g_assert_no_error (error);
+
+  fixture->dispatcher = mock_dispatcher_new (fixture->connection, &error);
+  g_assert_no_error (error);
+
+  g_assert_true (ygg_worker_connect (fixture->worker, &error));
+  g_assert_no_error (error);
+}
+
 static void
 fixture_teardown (TestFixture   *fixture,
                   gconstpointer  user_data)
@@ -80,6 +231,11 @@ fixture_teardown (TestFixture   *fixture,
   if (fixture->worker)
     g_object_unref (fixture->worker);
 
+  /* Tear down the mock dispatcher
+   */
+  g_clear_pointer (&fixture->dispatcher, mock_dispatcher_free);
+  g_clear_object (&fixture->connection);
+
   /* Stop the private D-Bus daemon
    */
   g_test_dbus_down (fixture->dbus);
@@ -99,22 +255,2040 @@ test_worker_connect (TestFixture   *fixture,
   g_assert_no_error (error);
 }
 
-int
-main (int   argc,
-      char *argv[])
+static void
+connect_done (GObject      *source_object,
+              GAsyncResult *res,
+              gpointer      user_data)
 {
-  setlocale (LC_ALL, "");
-  g_test_init (&argc, &argv,
-#if GLIB_CHECK_VERSION(2, 60, 0)
-               G_TEST_OPTION_ISOLATE_DIRS,
-#endif
-               NULL);
+  GAsyncResult **result = (GAsyncResult **) user_data;
 
-  g_test_add ("/ygg/worker/connect",
-              TestFixture,
-              NULL,
-              fixture_setup,
-              test_worker_connect,
+  *result = g_object_ref (res);
+}
+
+static gboolean
+connect_and_wait (YggWorker  *worker,
+                  GError    **error)
+{
+  g_autoptr (GAsyncResult) result = NULL;
+
+  ygg_worker_connect_async (worker, NULL, connect_done, &result);
+  while (result == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  return ygg_worker_connect_finish (worker, result, error);
+}
+
+static void
+test_worker_connect_async (TestFixture   *fixture,
+                           gconstpointer  user_data)
+{
+  GError *error = NULL;
+
+  g_assert_true (connect_and_wait (fixture->worker, &error));
+  g_assert_no_error (error);
+
+  /* The worker owns its name by the time connecting completes */
+  g_autoptr (GDBusConnection) connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+  g_assert_no_error (error);
+  g_autoptr (GVariant) reply = g_dbus_connection_call_sync (connection,
+                                                            "org.freedesktop.DBus",
+                                                            "/org/freedesktop/DBus",
+                                                            "org.freedesktop.DBus",
+                                                            "NameHasOwner",
+                                                            g_variant_new ("(s)", "com.redhat.Yggdrasil1.Worker1.ygg_worker_test"),
+                                                            G_VARIANT_TYPE ("(b)"),
+                                                            G_DBUS_CALL_FLAGS_NONE,
+                                                            -1,
+                                                            NULL,
+                                                            &error);
+  g_assert_no_error (error);
+  gboolean has_owner = FALSE;
+  g_variant_get (reply, "(b)", &has_owner);
+  g_assert_true (has_owner);
+
+  g_autoptr (GVariant) metrics = ygg_worker_get_metrics (fixture->worker);
+  guint64 time_to_ready = 0;
+  g_assert_true (g_variant_lookup (metrics, "time-to-ready-us", "t", &time_to_ready));
+  g_assert_cmpuint (time_to_ready, >, 0);
+
+  /* A worker cannot be connected twice */
+  g_assert_false (connect_and_wait (fixture->worker, &error));
+  g_assert_error (error, YGG_WORKER_ERROR, YGG_WORKER_ERROR_CONNECT_FAILED);
+  g_clear_error (&error);
+
+  /* A second worker for the same directive cannot own the name */
+  g_autoptr (YggWorker) other = ygg_worker_new ("ygg_worker_test", FALSE, NULL);
+  ygg_worker_set_rx_func (other, handle_rx, NULL, NULL);
+  g_assert_false (connect_and_wait (other, &error));
+  g_assert_error (error, YGG_WORKER_ERROR, YGG_WORKER_ERROR_CONNECT_FAILED);
+  g_clear_error (&error);
+}
+
+static void
+test_worker_connect_async_cancel (TestFixture   *fixture,
+                                  gconstpointer  user_data)
+{
+  GError *error = NULL;
+  g_autoptr (GCancellable) cancellable = g_cancellable_new ();
+  g_autoptr (GAsyncResult) result = NULL;
+
+  ygg_worker_connect_async (fixture->worker, cancellable, connect_done, &result);
+  g_cancellable_cancel (cancellable);
+  while (result == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_false (ygg_worker_connect_finish (fixture->worker, result, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error (&error);
+
+  /* A cancelled worker releases everything, so it can connect again */
+  g_assert_true (connect_and_wait (fixture->worker, &error));
+  g_assert_no_error (error);
+}
+
+static void
+test_worker_emit_event_before_connect (TestFixture   *fixture,
+                                       gconstpointer  user_data)
+{
+  GError *error = NULL;
+
+  /* Events emitted before the bus is acquired are queued, not dropped */
+  g_assert_true (ygg_worker_emit_event (fixture->worker, YGG_WORKER_EVENT_WORKING, "id", "queued", &error));
+  g_assert_no_error (error);
+
+  g_assert_true (ygg_worker_connect (fixture->worker, &error));
+  g_assert_no_error (error);
+}
+
+typedef struct {
+  GMutex lock;
+  GCond  cond;
+  guint  n_expected;
+  guint  running;
+  guint  max_running;
+  guint  done;
+} ConcurrencyState;
+
+static void
+handle_rx_concurrent (YggWorker   *worker,
+                      gchar       *addr,
+                      gchar       *id,
+                      gchar       *response_to,
+                      YggMetadata *metadata,
+                      GBytes      *data,
+                      gpointer     user_data)
+{
+  ConcurrencyState *state = (ConcurrencyState *) user_data;
+  gint64 deadline = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+
+  g_mutex_lock (&state->lock);
+  state->running++;
+  state->max_running = MAX (state->max_running, state->running);
+  g_cond_broadcast (&state->cond);
+  /* Hold the handler until every message is being handled at once */
+  while (state->max_running < state->n_expected) {
+    if (!g_cond_wait_until (&state->cond, &state->lock, deadline))
+      break;
+  }
+  state->running--;
+  state->done++;
+  g_mutex_unlock (&state->lock);
+
+  g_main_context_wakeup (NULL);
+
+  g_free (addr);
+  g_free (id);
+  g_free (response_to);
+  g_object_unref (metadata);
+  g_bytes_unref (data);
+}
+
+static void
+test_worker_max_concurrency (TestFixture   *fixture,
+                             gconstpointer  user_data)
+{
+  const guint n_messages = 4;
+  GError *error = NULL;
+  ConcurrencyState state = { 0 };
+  g_autoptr (GBytes) data = g_bytes_new_static ("", 0);
+
+  g_mutex_init (&state.lock);
+  g_cond_init (&state.cond);
+  state.n_expected = n_messages;
+
+  g_autoptr (YggWorker) worker = g_object_new (YGG_TYPE_WORKER,
+                                               "directive", "ygg_worker_concurrent",
+                                               "max-concurrency", n_messages,
+                                               NULL);
+  ygg_worker_set_rx_func (worker, handle_rx_concurrent, &state, NULL);
+  g_assert_true (ygg_worker_connect (worker, &error));
+  g_assert_no_error (error);
+  wait_for_worker (fixture->connection, "ygg_worker_concurrent");
+
+  for (guint i = 0; i < n_messages; i++) {
+    g_autofree gchar *id = g_uuid_string_random ();
+    dispatch (fixture->connection, "ygg_worker_concurrent", id, NULL, data, NULL, NULL);
+  }
+
+  while (g_atomic_int_get (&state.done) < n_messages) {
+    g_main_context_iteration (NULL, TRUE);
+  }
+
+  g_assert_cmpuint (state.max_running, ==, n_messages);
+
+  g_mutex_clear (&state.lock);
+  g_cond_clear (&state.cond);
+}
+
+typedef struct {
+  GMutex   lock;
+  GCond    cond;
+  gboolean started;
+  gboolean released;
+} BlockingState;
+
+static void
+handle_rx_blocking (YggWorker   *worker,
+                    gchar       *addr,
+                    gchar       *id,
+                    gchar       *response_to,
+                    YggMetadata *metadata,
+                    GBytes      *data,
+                    gpointer     user_data)
+{
+  BlockingState *state = (BlockingState *) user_data;
+
+  g_mutex_lock (&state->lock);
+  state->started = TRUE;
+  g_cond_broadcast (&state->cond);
+  while (!state->released)
+    g_cond_wait (&state->cond, &state->lock);
+  g_mutex_unlock (&state->lock);
+
+  g_free (addr);
+  g_free (id);
+  g_free (response_to);
+  g_object_unref (metadata);
+  g_bytes_unref (data);
+}
+
+typedef struct {
+  gboolean  done;
+  GError   *error;
+} DispatchResult;
+
+static void
+dispatch_done (GObject      *source_object,
+               GAsyncResult *res,
+               gpointer      user_data)
+{
+  DispatchResult *result = (DispatchResult *) user_data;
+  g_autoptr (GVariant) reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &result->error);
+  result->done = TRUE;
+}
+
+static void
+dispatch_and_wait (GDBusConnection  *connection,
+                   const gchar      *directive,
+                   GBytes           *data,
+                   GError          **error)
+{
+  g_autofree gchar *id = g_uuid_string_random ();
+  DispatchResult result = { FALSE, NULL };
+
+  dispatch (connection, directive, id, NULL, data, dispatch_done, &result);
+  while (!result.done)
+    g_main_context_iteration (NULL, TRUE);
+
+  if (result.error != NULL)
+    g_propagate_error (error, result.error);
+}
+
+static void
+test_worker_max_in_flight (TestFixture   *fixture,
+                           gconstpointer  user_data)
+{
+  GError *error = NULL;
+  BlockingState state = { 0 };
+  g_autoptr (GBytes) data = g_bytes_new_static ("", 0);
+
+  g_mutex_init (&state.lock);
+  g_cond_init (&state.cond);
+
+  g_autoptr (YggWorker) worker = g_object_new (YGG_TYPE_WORKER,
+                                               "directive", "ygg_worker_bounded",
+                                               "max-concurrency", 1,
+                                               "max-in-flight", 1,
+                                               NULL);
+  ygg_worker_set_rx_func (worker, handle_rx_blocking, &state, NULL);
+  g_assert_true (ygg_worker_connect (worker, &error));
+  g_assert_no_error (error);
+  wait_for_worker (fixture->connection, "ygg_worker_bounded");
+
+  dispatch_and_wait (fixture->connection, "ygg_worker_bounded", data, &error);
+  g_assert_no_error (error);
+
+  g_mutex_lock (&state.lock);
+  while (!state.started)
+    g_cond_wait (&state.cond, &state.lock);
+  g_mutex_unlock (&state.lock);
+
+  guint queue_depth = 0;
+  g_object_get (worker, "queue-depth", &queue_depth, NULL);
+  g_assert_cmpuint (queue_depth, ==, 1);
+
+  /* The first message is still being handled, so this one is rejected */
+  dispatch_and_wait (fixture->connection, "ygg_worker_bounded", data, &error);
+  g_assert_error (error, YGG_WORKER_ERROR, YGG_WORKER_ERROR_BUSY);
+  g_clear_error (&error);
+
+  g_mutex_lock (&state.lock);
+  state.released = TRUE;
+  g_cond_broadcast (&state.cond);
+  g_mutex_unlock (&state.lock);
+
+  while (queue_depth > 0) {
+    g_main_context_iteration (NULL, FALSE);
+    g_object_get (worker, "queue-depth", &queue_depth, NULL);
+  }
+
+  g_mutex_clear (&state.lock);
+  g_cond_clear (&state.cond);
+}
+
+typedef struct {
+  BlockingState  blocking;
+  GPtrArray     *handled;
+} OrderState;
+
+static void
+handle_rx_ordered (YggWorker   *worker,
+                   gchar       *addr,
+                   gchar       *id,
+                   gchar       *response_to,
+                   YggMetadata *metadata,
+                   GBytes      *data,
+                   gpointer     user_data)
+{
+  OrderState *state = (OrderState *) user_data;
+
+  g_mutex_lock (&state->blocking.lock);
+  g_ptr_array_add (state->handled, g_strdup (ygg_metadata_get (metadata, "priority")));
+  /* Hold the first message until the rest have been queued behind it */
+  state->blocking.started = TRUE;
+  g_cond_broadcast (&state->blocking.cond);
+  while (!state->blocking.released)
+    g_cond_wait (&state->blocking.cond, &state->blocking.lock);
+  g_mutex_unlock (&state->blocking.lock);
+
+  g_main_context_wakeup (NULL);
+
+  g_free (addr);
+  g_free (id);
+  g_free (response_to);
+  g_object_unref (metadata);
+  g_bytes_unref (data);
+}
+
+static void
+test_worker_priority (TestFixture   *fixture,
+                      gconstpointer  user_data)
+{
+  const guint n_bulk = 32;
+  GError *error = NULL;
+  OrderState state = { 0 };
+  g_autoptr (GBytes) data = g_bytes_new_static ("", 0);
+  g_autoptr (YggMetadata) bulk = ygg_metadata_new ();
+  g_autoptr (YggMetadata) high = ygg_metadata_new ();
+
+  g_mutex_init (&state.blocking.lock);
+  g_cond_init (&state.blocking.cond);
+  state.handled = g_ptr_array_new_with_free_func (g_free);
+  ygg_metadata_set (bulk, "priority", "low");
+  ygg_metadata_set (high, "priority", "high");
+
+  g_autoptr (YggWorker) worker = g_object_new (YGG_TYPE_WORKER,
+                                               "directive", "ygg_worker_priority",
+                                               "max-concurrency", 1,
+                                               "priority-key", "priority",
+                                               NULL);
+  ygg_worker_set_rx_func (worker, handle_rx_ordered, &state, NULL);
+  g_assert_true (ygg_worker_connect (worker, &error));
+  g_assert_no_error (error);
+  wait_for_worker (fixture->connection, "ygg_worker_priority");
+
+  /* Flood the worker with bulk messages, then send one urgent message */
+  for (guint i = 0; i < n_bulk; i++) {
+    g_autofree gchar *id = g_uuid_string_random ();
+    dispatch (fixture->connection, "ygg_worker_priority", id, bulk, data, NULL, NULL);
+  }
+  g_autofree gchar *high_id = g_uuid_string_random ();
+  dispatch (fixture->connection, "ygg_worker_priority", high_id, high, data, NULL, NULL);
+
+  guint queue_depth = 0;
+  while (queue_depth < n_bulk + 1) {
+    g_main_context_iteration (NULL, TRUE);
+    g_object_get (worker, "queue-depth", &queue_depth, NULL);
+  }
+
+  g_mutex_lock (&state.blocking.lock);
+  state.blocking.released = TRUE;
+  g_cond_broadcast (&state.blocking.cond);
+  g_mutex_unlock (&state.blocking.lock);
+
+  while (queue_depth > 0) {
+    g_main_context_iteration (NULL, FALSE);
+    g_object_get (worker, "queue-depth", &queue_depth, NULL);
+  }
+
+  /* Only the bulk message already being handled may run before the urgent one */
+  g_assert_cmpuint (state.handled->len, ==, n_bulk + 1);
+  g_assert_cmpstr (g_ptr_array_index (state.handled, 0), ==, "low");
+  g_assert_cmpstr (g_ptr_array_index (state.handled, 1), ==, "high");
+
+  g_ptr_array_unref (state.handled);
+  g_mutex_clear (&state.blocking.lock);
+  g_cond_clear (&state.blocking.cond);
+}
+
+static void
+test_worker_transmit (TestFixture   *fixture,
+                      gconstpointer  user_data)
+{
+  GError *error = NULL;
+  g_autoptr (GBytes) data = g_bytes_new_static ("hello", 5);
+  g_autoptr (GBytes) response_data = NULL;
+
+  g_assert_true (transmit_and_wait (fixture->worker, data, &response_data, &error));
+  g_assert_no_error (error);
+  g_assert_nonnull (response_data);
+}
+
+static void
+test_worker_transmit_binary (TestFixture   *fixture,
+                             gconstpointer  user_data)
+{
+  static const guint8 payload[] = { 0x00, 'y', 'g', 'g', 0x00, 0xff, 0x00 };
+  GError *error = NULL;
+  g_autoptr (GBytes) data = g_bytes_new_static (payload, sizeof (payload));
+  g_autoptr (GBytes) response_data = NULL;
+
+  g_assert_true (transmit_and_wait (fixture->worker, data, &response_data, &error));
+  g_assert_no_error (error);
+  g_assert_true (g_bytes_equal (data, response_data));
+}
+
+static void
+test_worker_transmit_throughput (TestFixture   *fixture,
+                                 gconstpointer  user_data)
+{
+  const gsize size = 16 * 1024 * 1024;
+  const guint n_transmits = 16;
+  GError *error = NULL;
+
+  if (!g_test_perf ()) {
+    g_test_skip ("not running in perf mode");
+    return;
+  }
+
+  guint8 *payload = g_malloc (size);
+  for (gsize i = 0; i < size; i++) {
+    payload[i] = (guint8) g_test_rand_int_range (0, 256);
+  }
+  g_autoptr (GBytes) data = g_bytes_new_take (payload, size);
+
+  g_test_timer_start ();
+  for (guint i = 0; i < n_transmits; i++) {
+    g_autoptr (GBytes) response_data = NULL;
+    g_assert_true (transmit_and_wait (fixture->worker, data, &response_data, &error));
+    g_assert_no_error (error);
+    g_assert_cmpuint (g_bytes_get_size (response_data), ==, size);
+  }
+  gdouble elapsed = g_test_timer_elapsed ();
+
+  gdouble mib_per_sec = (gdouble) (size * n_transmits) / (1024 * 1024) / elapsed;
+  g_test_maximized_result (mib_per_sec, "%.1f MiB/s round trip", mib_per_sec);
+}
+
+static void
+transmit_batch_done (GObject      *source_object,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+  GPtrArray **results = (GPtrArray **) user_data;
+  GError *error = NULL;
+
+  *results = ygg_worker_transmit_batch_finish (YGG_WORKER (source_object), res, &error);
+  g_assert_no_error (error);
+  g_main_context_wakeup (NULL);
+}
+
+static GPtrArray *
+transmit_batch_and_wait (YggWorker *worker,
+                         guint      n_items,
+                         guint      max_in_flight,
+                         GBytes    *data)
+{
+  g_autofree YggTransmitItem *items = g_new0 (YggTransmitItem, n_items);
+  g_autoptr (GPtrArray) ids = g_ptr_array_new_with_free_func (g_free);
+  GPtrArray *results = NULL;
+
+  for (guint i = 0; i < n_items; i++) {
+    gchar *id = g_uuid_string_random ();
+    g_ptr_array_add (ids, id);
+    items[i].addr = "test";
+    items[i].id = id;
+    items[i].data = data;
+  }
+
+  ygg_worker_transmit_batch (worker, items, n_items, max_in_flight, NULL, transmit_batch_done, &results);
+  while (results == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  return results;
+}
+
+static void
+test_worker_transmit_batch (TestFixture   *fixture,
+                            gconstpointer  user_data)
+{
+  const guint n_items = 64;
+  g_autoptr (GBytes) data = g_bytes_new_static ("record", 6);
+
+  g_autoptr (GPtrArray) results = transmit_batch_and_wait (fixture->worker, n_items, 8, data);
+
+  g_assert_cmpuint (results->len, ==, n_items);
+  for (guint i = 0; i < results->len; i++) {
+    YggTransmitResult *result = g_ptr_array_index (results, i);
+    g_assert_no_error (result->error);
+    g_assert_cmpint (result->response_code, ==, 0);
+    g_assert_true (g_bytes_equal (result->response_data, data));
+  }
+}
+
+static void
+test_worker_transmit_batch_throughput (TestFixture   *fixture,
+                                       gconstpointer  user_data)
+{
+  const guint n_items = 1000;
+  GError *error = NULL;
+  g_autoptr (GBytes) data = g_bytes_new_static ("record", 6);
+
+  if (!g_test_perf ()) {
+    g_test_skip ("not running in perf mode");
+    return;
+  }
+
+  /* Warm up the connection and the dispatcher proxy */
+  g_assert_true (transmit_and_wait (fixture->worker, data, NULL, &error));
+  g_assert_no_error (error);
+
+  g_test_timer_start ();
+  for (guint i = 0; i < n_items; i++) {
+    g_assert_true (transmit_and_wait (fixture->worker, data, NULL, &error));
+    g_assert_no_error (error);
+  }
+  gdouble single = g_test_timer_elapsed ();
+
+  g_test_timer_start ();
+  g_autoptr (GPtrArray) results = transmit_batch_and_wait (fixture->worker, n_items, 64, data);
+  gdouble batch = g_test_timer_elapsed ();
+
+  g_test_message ("%u single transmits: %.0f msg/s", n_items, n_items / single);
+  g_test_message ("batch of %u transmits: %.0f msg/s", n_items, n_items / batch);
+  g_test_maximized_result (n_items / batch, "%.0f msg/s batched", n_items / batch);
+}
+
+/**
+ * read_status_field:
+ *
+ * Reads a size in kB from /proc/self/status.
+ *
+ * Returns: The size in bytes, or 0 if it could not be read.
+ */
+static gsize
+read_status_field (const gchar *field)
+{
+  g_autofree gchar *status = NULL;
+
+  if (!g_file_get_contents ("/proc/self/status", &status, NULL, NULL))
+    return 0;
+
+  const gchar *line = strstr (status, field);
+  if (line == NULL)
+    return 0;
+
+  return g_ascii_strtoull (line + strlen (field), NULL, 10) * 1024;
+}
+
+static void
+transmit_stream_done (GObject      *source_object,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+  DispatchResult *result = (DispatchResult *) user_data;
+
+  ygg_worker_transmit_stream_finish (YGG_WORKER (source_object), res, &result->error);
+  result->done = TRUE;
+}
+
+static void
+test_worker_transmit_stream (TestFixture   *fixture,
+                             gconstpointer  user_data)
+{
+  const gsize chunk_size = 1024 * 1024;
+  const guint n_chunks = 64;
+  GError *error = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree guint8 *buffer = g_malloc (chunk_size);
+  DispatchResult result = { FALSE, NULL };
+
+  /* Write a file much larger than the allowed memory growth */
+  gint fd = g_file_open_tmp ("ygg-stream-XXXXXX", &path, &error);
+  g_assert_no_error (error);
+  for (guint i = 0; i < n_chunks; i++) {
+    memset (buffer, i, chunk_size);
+    g_assert_cmpint (write (fd, buffer, chunk_size), ==, chunk_size);
+  }
+  g_close (fd, NULL);
+
+  g_autoptr (GFile) file = g_file_new_for_path (path);
+  g_autoptr (GFileInputStream) stream = g_file_read (file, NULL, &error);
+  g_assert_no_error (error);
+
+  /* Reset the peak RSS so VmHWM covers only the transmit */
+  gboolean peak_reset = FALSE;
+  gint clear_refs = g_open ("/proc/self/clear_refs", O_WRONLY, 0);
+  if (clear_refs >= 0) {
+    peak_reset = write (clear_refs, "5", 1) == 1;
+    g_close (clear_refs, NULL);
+  }
+  gsize rss_before = read_status_field ("VmRSS:");
+
+  g_autofree gchar *id = g_uuid_string_random ();
+  ygg_worker_transmit_stream (fixture->worker,
+                              "test",
+                              id,
+                              NULL,
+                              NULL,
+                              G_INPUT_STREAM (stream),
+                              chunk_size,
+                              NULL,
+                              transmit_stream_done,
+                              &result);
+  while (!result.done)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_no_error (result.error);
+
+  g_assert_cmpuint (fixture->dispatcher->bytes_received, ==, n_chunks * chunk_size);
+  g_assert_cmpuint (fixture->dispatcher->n_chunks, ==, n_chunks);
+  g_assert_true (fixture->dispatcher->final_chunk_received);
+
+  gsize rss_peak = read_status_field ("VmHWM:");
+  if (peak_reset && rss_before > 0 && rss_peak > rss_before) {
+    g_test_message ("peak RSS grew by %" G_GSIZE_FORMAT " bytes", rss_peak - rss_before);
+    g_assert_cmpuint (rss_peak - rss_before, <, 16 * chunk_size);
+  }
+
+  g_unlink (path);
+}
+
+typedef struct {
+  GByteArray *received;
+  gchar      *id;
+} ReassemblyState;
+
+static void
+handle_stream_rx (YggWorker    *worker,
+                  gchar        *addr,
+                  gchar        *id,
+                  gchar        *response_to,
+                  YggMetadata  *metadata,
+                  GInputStream *stream,
+                  gpointer      user_data)
+{
+  ReassemblyState *state = (ReassemblyState *) user_data;
+  GError *error = NULL;
+  guint8 buffer[4096];
+  gssize n_read = 0;
+
+  state->received = g_byte_array_new ();
+  while ((n_read = g_input_stream_read (stream, buffer, sizeof (buffer), NULL, &error)) > 0)
+    g_byte_array_append (state->received, buffer, n_read);
+  g_assert_no_error (error);
+  state->id = id;
+
+  g_free (addr);
+  g_free (response_to);
+  g_object_unref (metadata);
+  g_object_unref (stream);
+}
+
+static void
+dispatch_chunk_and_wait (GDBusConnection  *connection,
+                         const gchar      *directive,
+                         const gchar      *stream_id,
+                         guint             sequence,
+                         gboolean          final,
+                         const gchar      *data,
+                         GError          **error)
+{
+  g_autofree gchar *id = g_uuid_string_random ();
+  g_autofree gchar *sequence_value = g_strdup_printf ("%u", sequence);
+  g_autoptr (GBytes) bytes = g_bytes_new (data, strlen (data));
+  g_autoptr (YggMetadata) metadata = ygg_metadata_new ();
+  DispatchResult result = { FALSE, NULL };
+
+  ygg_metadata_set (metadata, YGG_WORKER_CHUNK_STREAM_ID, stream_id);
+  ygg_metadata_set (metadata, YGG_WORKER_CHUNK_SEQUENCE, sequence_value);
+  if (final)
+    ygg_metadata_set (metadata, YGG_WORKER_CHUNK_FINAL, "true");
+
+  dispatch (connection, directive, id, metadata, bytes, dispatch_done, &result);
+  while (!result.done)
+    g_main_context_iteration (NULL, TRUE);
+
+  if (result.error != NULL)
+    g_propagate_error (error, result.error);
+}
+
+static void
+test_worker_stream_rx (TestFixture   *fixture,
+                       gconstpointer  user_data)
+{
+  GError *error = NULL;
+  ReassemblyState state = { NULL, NULL };
+
+  ygg_worker_set_stream_rx_func (fixture->worker, handle_stream_rx, &state, NULL);
+  wait_for_worker (fixture->connection, "ygg_worker_test");
+
+  /* A stream must start with its first chunk */
+  dispatch_chunk_and_wait (fixture->connection, "ygg_worker_test", "stream-0", 1, FALSE, "world", &error);
+  g_assert_error (error, YGG_WORKER_ERROR, YGG_WORKER_ERROR_INVALID_CHUNK);
+  g_clear_error (&error);
+
+  dispatch_chunk_and_wait (fixture->connection, "ygg_worker_test", "stream-1", 0, FALSE, "hello", &error);
+  g_assert_no_error (error);
+  dispatch_chunk_and_wait (fixture->connection, "ygg_worker_test", "stream-1", 1, FALSE, ", ", &error);
+  g_assert_no_error (error);
+  dispatch_chunk_and_wait (fixture->connection, "ygg_worker_test", "stream-1", 2, TRUE, "world", &error);
+  g_assert_no_error (error);
+
+  while (state.received == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpstr (state.id, ==, "stream-1");
+  g_assert_cmpmem (state.received->data, state.received->len, "hello, world", 12);
+
+  g_byte_array_unref (state.received);
+  g_free (state.id);
+}
+
+static void
+test_worker_stream_rx_limit (TestFixture   *fixture,
+                             gconstpointer  user_data)
+{
+  GError *error = NULL;
+  ReassemblyState state = { NULL, NULL };
+  const guint max_streams = 64;
+
+  ygg_worker_set_stream_rx_func (fixture->worker, handle_stream_rx, &state, NULL);
+  wait_for_worker (fixture->connection, "ygg_worker_test");
+
+  for (guint i = 0; i < max_streams; i++) {
+    g_autofree gchar *stream_id = g_strdup_printf ("stream-%u", i);
+    dispatch_chunk_and_wait (fixture->connection, "ygg_worker_test", stream_id, 0, FALSE, "hello", &error);
+    g_assert_no_error (error);
+  }
+
+  /* No more streams are started while the worker is reassembling the maximum */
+  dispatch_chunk_and_wait (fixture->connection, "ygg_worker_test", "stream-extra", 0, FALSE, "hello", &error);
+  g_assert_error (error, YGG_WORKER_ERROR, YGG_WORKER_ERROR_BUSY);
+  g_clear_error (&error);
+
+  /* Completing a stream makes room for another one */
+  dispatch_chunk_and_wait (fixture->connection, "ygg_worker_test", "stream-0", 1, TRUE, ", world", &error);
+  g_assert_no_error (error);
+  while (state.received == NULL)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpstr (state.id, ==, "stream-0");
+  g_assert_cmpmem (state.received->data, state.received->len, "hello, world", 12);
+
+  dispatch_chunk_and_wait (fixture->connection, "ygg_worker_test", "stream-extra", 0, FALSE, "hello", &error);
+  g_assert_no_error (error);
+
+  g_byte_array_unref (state.received);
+  g_free (state.id);
+}
+
+static void
+test_worker_max_in_flight_stream (TestFixture   *fixture,
+                                  gconstpointer  user_data)
+{
+  GError *error = NULL;
+  BlockingState state = { 0 };
+  ReassemblyState reassembly = { NULL, NULL };
+  g_autoptr (GBytes) data = g_bytes_new_static ("", 0);
+
+  g_mutex_init (&state.lock);
+  g_cond_init (&state.cond);
+
+  g_autoptr (YggWorker) worker = g_object_new (YGG_TYPE_WORKER,
+                                               "directive", "ygg_worker_bounded",
+                                               "max-concurrency", 1,
+                                               "max-in-flight", 1,
+                                               NULL);
+  ygg_worker_set_rx_func (worker, handle_rx_blocking, &state, NULL);
+  ygg_worker_set_stream_rx_func (worker, handle_stream_rx, &reassembly, NULL);
+  g_assert_true (ygg_worker_connect (worker, &error));
+  g_assert_no_error (error);
+  wait_for_worker (fixture->connection, "ygg_worker_bounded");
+
+  dispatch_and_wait (fixture->connection, "ygg_worker_bounded", data, &error);
+  g_assert_no_error (error);
+  g_mutex_lock (&state.lock);
+  while (!state.started)
+    g_cond_wait (&state.cond, &state.lock);
+  g_mutex_unlock (&state.lock);
+
+  /* Chunks of a stream are not queued, so they are accepted while further
+   * messages are rejected */
+  dispatch_and_wait (fixture->connection, "ygg_worker_bounded", data, &error);
+  g_assert_error (error, YGG_WORKER_ERROR, YGG_WORKER_ERROR_BUSY);
+  g_clear_error (&error);
+  dispatch_chunk_and_wait (fixture->connection, "ygg_worker_bounded", "stream-1", 0, FALSE, "hello", &error);
+  g_assert_no_error (error);
+  dispatch_chunk_and_wait (fixture->connection, "ygg_worker_bounded", "stream-1", 1, FALSE, ", ", &error);
+  g_assert_no_error (error);
+
+  g_mutex_lock (&state.lock);
+  state.released = TRUE;
+  g_cond_broadcast (&state.cond);
+  g_mutex_unlock (&state.lock);
+
+  guint queue_depth = 1;
+  while (queue_depth > 0) {
+    g_main_context_iteration (NULL, FALSE);
+    g_object_get (worker, "queue-depth", &queue_depth, NULL);
+  }
+
+  g_mutex_clear (&state.lock);
+  g_cond_clear (&state.cond);
+}
+
+static void
+handle_message_rx (YggWorker  *worker,
+                   YggMessage *message,
+                   gpointer    user_data)
+{
+  YggMessage **received = (YggMessage **) user_data;
+
+  /* Keep the message beyond the handler */
+  *received = ygg_message_ref (message);
+}
+
+static void
+test_worker_message_rx (TestFixture   *fixture,
+                        gconstpointer  user_data)
+{
+  g_autoptr (YggMessage) received = NULL;
+  g_autoptr (YggMetadata) metadata = ygg_metadata_new ();
+  g_autoptr (GBytes) data = g_bytes_new_static ("hello", 5);
+
+  ygg_worker_set_message_rx_func (fixture->worker, handle_message_rx, &received, NULL);
+  wait_for_worker (fixture->connection, "ygg_worker_test");
+
+  ygg_metadata_set (metadata, "key", "value");
+  dispatch (fixture->connection, "ygg_worker_test", "message-1", metadata, data, NULL, NULL);
+  while (received == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpstr (ygg_message_get_addr (received), ==, "test");
+  g_assert_cmpstr (ygg_message_get_id (received), ==, "message-1");
+  g_assert_cmpstr (ygg_metadata_get (ygg_message_get_metadata (received), "key"), ==, "value");
+  g_assert_true (g_bytes_equal (ygg_message_get_data (received), data));
+}
+
+static gboolean
+metadata_borrows_from (YggMetadata *metadata,
+                       GVariant    *parameters)
+{
+  g_autoptr (GVariant) serialized = ygg_metadata_ref_variant (metadata);
+  const guint8 *data = g_variant_get_data (serialized);
+  const guint8 *start = g_variant_get_data (parameters);
+
+  return data >= start && data < start + g_variant_get_size (parameters);
+}
+
+/**
+ * serialize:
+ * @value: (transfer floating): A #GVariant.
+ *
+ * Returns: (transfer full): A serialized copy of @value, like the parameters
+ * of a received D-Bus call.
+ */
+static GVariant *
+serialize (GVariant *value)
+{
+  g_autoptr (GVariant) sunk = g_variant_ref_sink (value);
+  g_autoptr (GBytes) bytes = g_variant_get_data_as_bytes (sunk);
+
+  return g_variant_ref_sink (g_variant_new_from_bytes (g_variant_get_type (sunk), bytes, TRUE));
+}
+
+static void
+test_worker_message_metadata_copy (TestFixture   *fixture,
+                                   gconstpointer  user_data)
+{
+  GError *error = NULL;
+  g_autofree guint8 *payload = g_malloc0 (1024 * 1024);
+
+  /* Metadata of a small message borrows from its parameters */
+  g_autoptr (GVariant) small = serialize (g_variant_new_parsed ("('test', 'small', '', {'ke': 'ka'}, b'hello')"));
+  g_autoptr (YggMessage) small_message = ygg_message_new_from_variant (fixture->worker, NULL, small, &error);
+  g_assert_no_error (error);
+  g_assert_true (metadata_borrows_from (ygg_message_get_metadata (small_message), small));
+
+  /* Metadata of a large message is copied, so it does not pin the payload */
+  g_autoptr (GVariant) large = serialize (g_variant_new ("(sss@a{ss}@ay)",
+                                                        "test",
+                                                        "large",
+                                                        "",
+                                                        g_variant_new_parsed ("@a{ss} {'ke': 'ka'}"),
+                                                        g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, payload, 1024 * 1024, 1)));
+  g_autoptr (YggMessage) large_message = ygg_message_new_from_variant (fixture->worker, NULL, large, &error);
+  g_assert_no_error (error);
+  g_assert_false (metadata_borrows_from (ygg_message_get_metadata (large_message), large));
+  g_assert_cmpstr (ygg_metadata_get (ygg_message_get_metadata (large_message), "ke"), ==, "ka");
+}
+
+typedef struct {
+  guint     n_signals;
+  GVariant *changed;
+} FeaturesChangedState;
+
+static void
+on_properties_changed (GDBusConnection *connection,
+                       const gchar     *sender_name,
+                       const gchar     *object_path,
+                       const gchar     *interface_name,
+                       const gchar     *signal_name,
+                       GVariant        *parameters,
+                       gpointer         user_data)
+{
+  FeaturesChangedState *state = (FeaturesChangedState *) user_data;
+
+  state->n_signals++;
+  g_clear_pointer (&state->changed, g_variant_unref);
+  state->changed = g_variant_get_child_value (parameters, 1);
+}
+
+static void
+wait_for_features_changed (FeaturesChangedState *state,
+                           guint                 n_signals)
+{
+  while (state->n_signals < n_signals)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+test_worker_set_features (TestFixture   *fixture,
+                          gconstpointer  user_data)
+{
+  GError *error = NULL;
+  FeaturesChangedState state = { 0, NULL };
+
+  wait_for_worker (fixture->connection, "ygg_worker_test");
+  guint subscription_id = g_dbus_connection_signal_subscribe (fixture->connection,
+                                                              NULL,
+                                                              "org.freedesktop.DBus.Properties",
+                                                              "PropertiesChanged",
+                                                              "/com/redhat/Yggdrasil1/Worker1/ygg_worker_test",
+                                                              NULL,
+                                                              G_DBUS_SIGNAL_FLAGS_NONE,
+                                                              on_properties_changed,
+                                                              &state,
+                                                              NULL);
+
+  g_assert_true (ygg_worker_set_feature (fixture->worker, "a", "1", &error));
+  g_assert_no_error (error);
+  wait_for_features_changed (&state, 1);
+  g_assert_cmpuint (g_variant_n_children (state.changed), ==, 1);
+
+  /* Setting an unchanged value emits nothing */
+  g_assert_false (ygg_worker_set_feature (fixture->worker, "a", "1", &error));
+  g_assert_no_error (error);
+
+  g_autoptr (YggMetadata) features = ygg_metadata_new ();
+  ygg_metadata_set (features, "a", "1");
+  ygg_metadata_set (features, "b", "2");
+  ygg_metadata_set (features, "c", "3");
+  g_assert_true (ygg_worker_set_features (fixture->worker, features, &error));
+  g_assert_no_error (error);
+  wait_for_features_changed (&state, 2);
+
+  /* Only the changed keys are sent, in a single signal */
+  g_autofree gchar *printed = g_variant_print (state.changed, FALSE);
+  g_assert_cmpstr (printed, ==, "{'b': <'2'>, 'c': <'3'>}");
+  g_assert_cmpstr (ygg_worker_get_feature (fixture->worker, "c", &error), ==, "3");
+  g_assert_no_error (error);
+
+  g_dbus_connection_signal_unsubscribe (fixture->connection, subscription_id);
+  g_clear_pointer (&state.changed, g_variant_unref);
+}
+
+static void
+on_event (GDBusConnection *connection,
+          const gchar     *sender_name,
+          const gchar     *object_path,
+          const gchar     *interface_name,
+          const gchar     *signal_name,
+          GVariant        *parameters,
+          gpointer         user_data)
+{
+  GPtrArray *events = (GPtrArray *) user_data;
+  guint event = 0;
+  const gchar *message = NULL;
+
+  g_variant_get (parameters, "(u&s&s)", &event, NULL, &message);
+  g_ptr_array_add (events, g_strdup_printf ("%u:%s", event, message));
+}
+
+static void
+test_worker_working_event_coalescing (TestFixture   *fixture,
+                                      gconstpointer  user_data)
+{
+  GError *error = NULL;
+  g_autoptr (GPtrArray) events = g_ptr_array_new_with_free_func (g_free);
+
+  g_object_set (fixture->worker, "working-event-interval", 60000, NULL);
+  wait_for_worker (fixture->connection, "ygg_worker_test");
+  guint subscription_id = g_dbus_connection_signal_subscribe (fixture->connection,
+                                                              NULL,
+                                                              "com.redhat.Yggdrasil1.Worker1",
+                                                              "Event",
+                                                              "/com/redhat/Yggdrasil1/Worker1/ygg_worker_test",
+                                                              NULL,
+                                                              G_DBUS_SIGNAL_FLAGS_NONE,
+                                                              on_event,
+                                                              events,
+                                                              NULL);
+
+  g_assert_true (ygg_worker_emit_event (fixture->worker, YGG_WORKER_EVENT_BEGIN, "1234", "", &error));
+  for (guint i = 1; i <= 3; i++) {
+    g_autofree gchar *progress = g_strdup_printf ("%u/3", i);
+    g_assert_true (ygg_worker_emit_event (fixture->worker, YGG_WORKER_EVENT_WORKING, "1234", progress, &error));
+    g_assert_no_error (error);
+  }
+  g_assert_true (ygg_worker_emit_event (fixture->worker, YGG_WORKER_EVENT_END, "1234", "", &error));
+  g_assert_no_error (error);
+
+  while (events->len < 4)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* The first WORKING event goes out at once; of the rest only the latest is
+   * kept, and it is flushed before END */
+  g_assert_cmpstr (g_ptr_array_index (events, 0), ==, "1:");
+  g_assert_cmpstr (g_ptr_array_index (events, 1), ==, "3:1/3");
+  g_assert_cmpstr (g_ptr_array_index (events, 2), ==, "3:3/3");
+  g_assert_cmpstr (g_ptr_array_index (events, 3), ==, "2:");
+
+  guint coalesced_events = 0;
+  g_object_get (fixture->worker, "coalesced-events", &coalesced_events, NULL);
+  g_assert_cmpuint (coalesced_events, ==, 1);
+
+  g_dbus_connection_signal_unsubscribe (fixture->connection, subscription_id);
+}
+
+static guint64
+lookup_counter (GVariant    *metrics,
+                const gchar *name)
+{
+  guint64 value = 0;
+  g_assert_true (g_variant_lookup (metrics, name, "t", &value));
+  return value;
+}
+
+static void
+test_worker_metrics (TestFixture   *fixture,
+                     gconstpointer  user_data)
+{
+  GError *error = NULL;
+  g_autoptr (GBytes) data = g_bytes_new_static ("hello", 5);
+
+  wait_for_worker (fixture->connection, "ygg_worker_test");
+  dispatch_and_wait (fixture->connection, "ygg_worker_test", data, &error);
+  g_assert_no_error (error);
+  g_assert_true (transmit_and_wait (fixture->worker, data, NULL, &error));
+  g_assert_no_error (error);
+
+  g_autoptr (GVariant) metrics = NULL;
+  do {
+    g_clear_pointer (&metrics, g_variant_unref);
+    g_main_context_iteration (NULL, FALSE);
+    metrics = ygg_worker_get_metrics (fixture->worker);
+  } while (lookup_counter (metrics, "messages-handled") < 1);
+
+  g_assert_cmpuint (lookup_counter (metrics, "dispatch-received"), ==, 1);
+  g_assert_cmpuint (lookup_counter (metrics, "bytes-received"), ==, 5);
+  g_assert_cmpuint (lookup_counter (metrics, "transmits"), ==, 1);
+  g_assert_cmpuint (lookup_counter (metrics, "bytes-transmitted"), ==, 5);
+  g_assert_cmpuint (lookup_counter (metrics, "transmit-errors"), ==, 0);
+
+  guint64 count = 0;
+  guint64 sum = 0;
+  g_autoptr (GVariantIter) buckets = NULL;
+  g_assert_true (g_variant_lookup (metrics, "transmit-round-trip-us", "(tta(tt))", &count, &sum, &buckets));
+  g_assert_cmpuint (count, ==, 1);
+  g_assert_cmpuint (g_variant_iter_n_children (buckets), ==, 16);
+
+  /* The same snapshot is exported on the bus */
+  g_autoptr (GVariant) reply = g_dbus_connection_call_sync (fixture->connection,
+                                                            "com.redhat.Yggdrasil1.Worker1.ygg_worker_test",
+                                                            "/com/redhat/Yggdrasil1/Worker1/ygg_worker_test",
+                                                            "org.freedesktop.DBus.Properties",
+                                                            "Get",
+                                                            g_variant_new ("(ss)", "com.redhat.Yggdrasil1.Worker1.Metrics", "Metrics"),
+                                                            G_VARIANT_TYPE ("(v)"),
+                                                            G_DBUS_CALL_FLAGS_NONE,
+                                                            -1,
+                                                            NULL,
+                                                            &error);
+  g_assert_no_error (error);
+  g_autoptr (GVariant) exported = NULL;
+  g_variant_get (reply, "(v)", &exported);
+  g_assert_cmpuint (lookup_counter (exported, "dispatch-received"), ==, 1);
+}
+
+static void
+test_worker_message_pool (TestFixture   *fixture,
+                          gconstpointer  user_data)
+{
+  GError *error = NULL;
+  g_autoptr (GBytes) data = g_bytes_new_static ("hello", 5);
+
+  wait_for_worker (fixture->connection, "ygg_worker_test");
+  dispatch_and_wait (fixture->connection, "ygg_worker_test", data, &error);
+  g_assert_no_error (error);
+
+  g_autoptr (GVariant) metrics = NULL;
+  do {
+    g_clear_pointer (&metrics, g_variant_unref);
+    g_main_context_iteration (NULL, FALSE);
+    metrics = ygg_worker_get_metrics (fixture->worker);
+  } while (lookup_counter (metrics, "messages-handled") < 1);
+  g_assert_cmpuint (lookup_counter (metrics, "messages-allocated"), ==, 1);
+
+  /* The received message is freed once handled, and transmitting reuses it */
+  g_assert_true (transmit_and_wait (fixture->worker, data, NULL, &error));
+  g_assert_no_error (error);
+
+  g_clear_pointer (&metrics, g_variant_unref);
+  metrics = ygg_worker_get_metrics (fixture->worker);
+  g_assert_cmpuint (lookup_counter (metrics, "messages-allocated"), ==, 1);
+  g_assert_cmpuint (lookup_counter (metrics, "messages-reused"), ==, 1);
+}
+
+static void
+handle_dispatcher_event (YggDispatcherEvent event,
+                         gpointer           user_data)
+{
+  *(YggDispatcherEvent *) user_data = event;
+}
+
+/**
+ * emit_dispatcher_event:
+ *
+ * Emits com.redhat.Yggdrasil1.Dispatcher1.Event from the mock dispatcher and
+ * runs the default main context until @worker has received it.
+ */
+static void
+emit_dispatcher_event (TestFixture        *fixture,
+                       YggDispatcherEvent  event)
+{
+  GError *error = NULL;
+  YggDispatcherEvent received = 0;
+
+  ygg_worker_set_event_func (fixture->worker, handle_dispatcher_event, &received, NULL);
+  g_assert_true (g_dbus_connection_emit_signal (fixture->connection,
+                                                NULL,
+                                                "/com/redhat/Yggdrasil1/Dispatcher1",
+                                                "com.redhat.Yggdrasil1.Dispatcher1",
+                                                "Event",
+                                                g_variant_new ("(u)", event),
+                                                &error));
+  g_assert_no_error (error);
+  while (received != event)
+    g_main_context_iteration (NULL, TRUE);
+  ygg_worker_set_event_func (fixture->worker, NULL, NULL, NULL);
+}
+
+static void
+spool_fixture_setup (TestFixture   *fixture,
+                     gconstpointer  user_data)
+{
+  GError *error = NULL;
+
+  dispatcher_fixture_setup (fixture, user_data);
+
+  /* Replace the worker with one that spools to disk right away */
+  g_clear_object (&fixture->worker);
+  fixture->worker = g_object_new (YGG_TYPE_WORKER,
+                                  "directive", "ygg_worker_spool",
+                                  "remote-content", FALSE,
+                                  "spool", TRUE,
+                                  "spool-memory-limit", 1,
+                                  NULL);
+  ygg_worker_set_rx_func (fixture->worker, handle_rx, NULL, NULL);
+  g_assert_true (connect_and_wait (fixture->worker, &error));
+  g_assert_no_error (error);
+}
+
+static void
+record_transmit_id (GVariant *parameters,
+                    gpointer  user_data)
+{
+  const gchar *id = NULL;
+
+  g_variant_get_child (parameters, 1, "&s", &id);
+  g_ptr_array_add ((GPtrArray *) user_data, g_strdup (id));
+}
+
+static void
+count_transmit_done (GObject      *source_object,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+  GError *error = NULL;
+  gint response_code = -1;
+  g_autoptr (YggMetadata) response_metadata = NULL;
+  g_autoptr (GBytes) response_data = NULL;
+
+  g_assert_true (ygg_worker_transmit_finish (YGG_WORKER (source_object),
+                                             res,
+                                             &response_code,
+                                             &response_metadata,
+                                             &response_data,
+                                             &error));
+  g_assert_no_error (error);
+  (*(guint *) user_data)++;
+}
+
+static void
+test_worker_transmit_spool (TestFixture   *fixture,
+                            gconstpointer  user_data)
+{
+  g_autoptr (GPtrArray) received = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr (YggMetadata) metadata = ygg_metadata_new ();
+  g_autoptr (GBytes) data = g_bytes_new_static ("hello", 5);
+  const gchar *ids[] = { "1", "2", "3" };
+  guint n_done = 0;
+
+  fixture->dispatcher->transmit_func = record_transmit_id;
+  fixture->dispatcher->transmit_func_user_data = received;
+
+  emit_dispatcher_event (fixture, YGG_DISPATCHER_EVENT_UNEXPECTED_DISCONNECT);
+  for (guint i = 0; i < G_N_ELEMENTS (ids); i++) {
+    ygg_worker_transmit (fixture->worker, "test", ids[i], "", metadata, data, NULL, count_transmit_done, &n_done);
+  }
+  while (g_main_context_iteration (NULL, FALSE));
+
+  g_autoptr (GVariant) metrics = ygg_worker_get_metrics (fixture->worker);
+  guint spooled = 0;
+  g_assert_true (g_variant_lookup (metrics, "spooled", "u", &spooled));
+  g_assert_cmpuint (spooled, ==, G_N_ELEMENTS (ids));
+  g_assert_cmpuint (received->len, ==, 0);
+
+  /* Spooled messages are transmitted in order once the dispatcher reconnects */
+  emit_dispatcher_event (fixture, YGG_DISPATCHER_EVENT_CONNECTION_RESTORED);
+  while (n_done < G_N_ELEMENTS (ids))
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (received->len, ==, G_N_ELEMENTS (ids));
+  for (guint i = 0; i < G_N_ELEMENTS (ids); i++) {
+    g_assert_cmpstr (g_ptr_array_index (received, i), ==, ids[i]);
+  }
+
+  g_clear_pointer (&metrics, g_variant_unref);
+  metrics = ygg_worker_get_metrics (fixture->worker);
+  g_assert_true (g_variant_lookup (metrics, "spooled", "u", &spooled));
+  g_assert_cmpuint (spooled, ==, 0);
+}
+
+typedef struct {
+  guint8 *data;
+  guint  *n_freed;
+} Payload;
+
+static void
+payload_free (gpointer user_data)
+{
+  Payload *payload = (Payload *) user_data;
+
+  g_free (payload->data);
+  (*payload->n_freed)++;
+  g_free (payload);
+}
+
+static void
+test_worker_transmit_spool_memory (TestFixture   *fixture,
+                                   gconstpointer  user_data)
+{
+  const guint n_messages = 16;
+  const gsize payload_size = 64 * 1024;
+  guint n_freed = 0;
+  guint n_done = 0;
+
+  emit_dispatcher_event (fixture, YGG_DISPATCHER_EVENT_UNEXPECTED_DISCONNECT);
+  for (guint i = 0; i < n_messages; i++) {
+    g_autofree gchar *id = g_strdup_printf ("%u", i);
+    Payload *payload = g_new0 (Payload, 1);
+    payload->data = g_malloc0 (payload_size);
+    payload->n_freed = &n_freed;
+    g_autoptr (GBytes) data = g_bytes_new_with_free_func (payload->data, payload_size, payload_free, payload);
+    ygg_worker_transmit (fixture->worker, "test", id, "", NULL, data, NULL, count_transmit_done, &n_done);
+  }
+  while (g_main_context_iteration (NULL, FALSE));
+
+  /* Payloads spooled to disk are no longer held in memory */
+  g_autoptr (GVariant) metrics = ygg_worker_get_metrics (fixture->worker);
+  guint spooled = 0;
+  g_assert_true (g_variant_lookup (metrics, "spooled", "u", &spooled));
+  g_assert_cmpuint (spooled, ==, n_messages);
+  g_assert_cmpuint (n_freed, ==, n_messages);
+
+  /* They are read back in full when the dispatcher reconnects */
+  emit_dispatcher_event (fixture, YGG_DISPATCHER_EVENT_CONNECTION_RESTORED);
+  while (n_done < n_messages)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpuint (fixture->dispatcher->bytes_received, ==, n_messages * payload_size);
+}
+
+static void
+test_worker_transmit_retry (TestFixture   *fixture,
+                            gconstpointer  user_data)
+{
+  GError *error = NULL;
+  g_autoptr (GBytes) data = g_bytes_new_static ("hello", 5);
+
+  fixture->dispatcher->n_transmit_failures = 2;
+  g_assert_true (transmit_and_wait (fixture->worker, data, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (fixture->dispatcher->n_transmit_failures, ==, 0);
+
+  g_autoptr (GVariant) metrics = ygg_worker_get_metrics (fixture->worker);
+  g_assert_cmpuint (lookup_counter (metrics, "transmits"), ==, 3);
+  g_assert_cmpuint (lookup_counter (metrics, "transmit-errors"), ==, 2);
+}
+
+static void
+test_worker_transmit_retry_spool (TestFixture   *fixture,
+                                  gconstpointer  user_data)
+{
+  g_autoptr (GPtrArray) received = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr (GBytes) data = g_bytes_new_static ("hello", 5);
+  const gchar *ids[] = { "1", "2", "3" };
+  guint n_done = 0;
+  guint spooled = 0;
+
+  fixture->dispatcher->transmit_func = record_transmit_id;
+  fixture->dispatcher->transmit_func_user_data = received;
+
+  /* The first message fails and waits to be retried while the dispatcher
+   * disconnects and the others are spooled */
+  fixture->dispatcher->n_transmit_failures = 1;
+  ygg_worker_transmit (fixture->worker, "test", ids[0], "", NULL, data, NULL, count_transmit_done, &n_done);
+  while (fixture->dispatcher->n_transmit_failures > 0)
+    g_main_context_iteration (NULL, TRUE);
+  emit_dispatcher_event (fixture, YGG_DISPATCHER_EVENT_UNEXPECTED_DISCONNECT);
+  for (guint i = 1; i < G_N_ELEMENTS (ids); i++) {
+    ygg_worker_transmit (fixture->worker, "test", ids[i], "", NULL, data, NULL, count_transmit_done, &n_done);
+  }
+  while (spooled < G_N_ELEMENTS (ids)) {
+    g_main_context_iteration (NULL, TRUE);
+    g_autoptr (GVariant) metrics = ygg_worker_get_metrics (fixture->worker);
+    g_assert_true (g_variant_lookup (metrics, "spooled", "u", &spooled));
+  }
+
+  /* The retried message keeps its place ahead of the later ones */
+  emit_dispatcher_event (fixture, YGG_DISPATCHER_EVENT_CONNECTION_RESTORED);
+  while (n_done < G_N_ELEMENTS (ids))
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (received->len, ==, G_N_ELEMENTS (ids));
+  for (guint i = 0; i < G_N_ELEMENTS (ids); i++) {
+    g_assert_cmpstr (g_ptr_array_index (received, i), ==, ids[i]);
+  }
+}
+
+static void
+transmit_batch_offline_done (GObject      *source_object,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+  DispatchResult *result = (DispatchResult *) user_data;
+
+  g_assert_null (ygg_worker_transmit_batch_finish (YGG_WORKER (source_object), res, &result->error));
+  result->done = TRUE;
+}
+
+static void
+test_worker_transmit_batch_offline (TestFixture   *fixture,
+                                    gconstpointer  user_data)
+{
+  g_autoptr (GBytes) data = g_bytes_new_static ("record", 6);
+  YggTransmitItem items[] = {
+    { .addr = "test", .id = "1", .data = data },
+    { .addr = "test", .id = "2", .data = data },
+  };
+  DispatchResult result = { FALSE, NULL };
+
+  /* Batches are not spooled, so they fail instead of being held */
+  emit_dispatcher_event (fixture, YGG_DISPATCHER_EVENT_UNEXPECTED_DISCONNECT);
+  ygg_worker_transmit_batch (fixture->worker,
+                             items,
+                             G_N_ELEMENTS (items),
+                             0,
+                             NULL,
+                             transmit_batch_offline_done,
+                             &result);
+  while (!result.done)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_error (result.error, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED);
+  g_clear_error (&result.error);
+  g_assert_cmpuint (fixture->dispatcher->bytes_received, ==, 0);
+}
+
+static void
+test_worker_transmit_stream_offline (TestFixture   *fixture,
+                                     gconstpointer  user_data)
+{
+  g_autoptr (GInputStream) stream = g_memory_input_stream_new_from_data ("record", 6, NULL);
+  DispatchResult result = { FALSE, NULL };
+
+  /* Chunks are not spooled, so the stream fails instead of being held */
+  emit_dispatcher_event (fixture, YGG_DISPATCHER_EVENT_UNEXPECTED_DISCONNECT);
+  ygg_worker_transmit_stream (fixture->worker,
+                              "test",
+                              "1",
+                              NULL,
+                              NULL,
+                              stream,
+                              0,
+                              NULL,
+                              transmit_stream_done,
+                              &result);
+  while (!result.done)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_error (result.error, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED);
+  g_clear_error (&result.error);
+  g_assert_cmpuint (fixture->dispatcher->n_chunks, ==, 0);
+}
+
+static void
+count_message_rx (YggWorker  *worker,
+                  YggMessage *message,
+                  gpointer    user_data)
+{
+  (*(guint *) user_data)++;
+}
+
+static void
+test_worker_journal (TestFixture   *fixture,
+                     gconstpointer  user_data)
+{
+  GError *error = NULL;
+  g_autoptr (GBytes) data = g_bytes_new_static ("hello", 5);
+  DispatchResult first = { FALSE, NULL };
+  DispatchResult second = { FALSE, NULL };
+  guint n_handled = 0;
+
+  g_autofree gchar *directory = g_dir_make_tmp ("test-ygg-worker-XXXXXX", &error);
+  g_assert_no_error (error);
+  g_autofree gchar *path = g_build_filename (directory, "ygg_worker_journal.journal", NULL);
+
+  g_clear_object (&fixture->worker);
+  fixture->worker = g_object_new (YGG_TYPE_WORKER,
+                                  "directive", "ygg_worker_journal",
+                                  "remote-content", FALSE,
+                                  "journal-directory", directory,
+                                  NULL);
+  ygg_worker_set_message_rx_func (fixture->worker, count_message_rx, &n_handled, NULL);
+  g_assert_true (connect_and_wait (fixture->worker, &error));
+  g_assert_no_error (error);
+  g_assert_true (g_file_test (path, G_FILE_TEST_IS_REGULAR));
+
+  /* A redelivered message is acknowledged but not handled again */
+  dispatch (fixture->connection, "ygg_worker_journal", "message-1", NULL, data, dispatch_done, &first);
+  dispatch (fixture->connection, "ygg_worker_journal", "message-1", NULL, data, dispatch_done, &second);
+  while (!first.done || !second.done || n_handled < 1)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_no_error (first.error);
+  g_assert_no_error (second.error);
+  g_assert_cmpuint (n_handled, ==, 1);
+
+  g_autoptr (GVariant) metrics = ygg_worker_get_metrics (fixture->worker);
+  g_assert_cmpuint (lookup_counter (metrics, "dispatch-duplicates"), ==, 1);
+  guint journal_pending = 0;
+  g_assert_true (g_variant_lookup (metrics, "journal-pending", "u", &journal_pending));
+  g_assert_cmpuint (journal_pending, ==, 0);
+
+  g_clear_object (&fixture->worker);
+  g_unlink (path);
+  g_rmdir (directory);
+}
+
+static void
+test_worker_journal_replay (TestFixture   *fixture,
+                            gconstpointer  user_data)
+{
+  GError *error = NULL;
+  YggMessage *received = NULL;
+  g_autoptr (GBytes) data = g_bytes_new_static ("hello", 5);
+  DispatchResult redelivered = { FALSE, NULL };
+
+  g_autofree gchar *directory = g_dir_make_tmp ("test-ygg-worker-XXXXXX", &error);
+  g_assert_no_error (error);
+  g_autofree gchar *path = g_build_filename (directory, "ygg_worker_journal.journal", NULL);
+
+  /* Leave a message pending, as if the worker had stopped while handling it */
+  YggJournal *journal = ygg_journal_open (path, 16, FALSE, &error);
+  g_assert_no_error (error);
+  g_autoptr (GVariant) parameters = g_variant_ref_sink (g_variant_new ("(sss@a{ss}@ay)",
+                                                                       "test",
+                                                                       "message-1",
+                                                                       "",
+                                                                       g_variant_new_parsed ("@a{ss} {}"),
+                                                                       g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, "hello", 5, 1)));
+  YggJournalEntry *entry = NULL;
+  g_assert_true (ygg_journal_append (journal, parameters, &entry, &error));
+  g_assert_no_error (error);
+  ygg_journal_free (journal);
+
+  g_clear_object (&fixture->worker);
+  fixture->worker = g_object_new (YGG_TYPE_WORKER,
+                                  "directive", "ygg_worker_journal",
+                                  "remote-content", FALSE,
+                                  "journal-directory", directory,
+                                  NULL);
+  ygg_worker_set_message_rx_func (fixture->worker, handle_message_rx, &received, NULL);
+  g_assert_true (connect_and_wait (fixture->worker, &error));
+  g_assert_no_error (error);
+
+  /* The pending message is handled once the worker starts */
+  while (received == NULL)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpstr (ygg_message_get_id (received), ==, "message-1");
+  g_assert_cmpmem (g_bytes_get_data (ygg_message_get_data (received), NULL), 5, "hello", 5);
+  g_clear_pointer (&received, ygg_message_unref);
+
+  g_autoptr (GVariant) metrics = ygg_worker_get_metrics (fixture->worker);
+  guint journal_pending = 0;
+  g_assert_true (g_variant_lookup (metrics, "journal-pending", "u", &journal_pending));
+  g_assert_cmpuint (journal_pending, ==, 0);
+
+  /* The replayed message is recognized if the dispatcher delivers it again */
+  dispatch (fixture->connection, "ygg_worker_journal", "message-1", NULL, data, dispatch_done, &redelivered);
+  while (!redelivered.done)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_no_error (redelivered.error);
+  g_assert_null (received);
+
+  g_clear_pointer (&metrics, g_variant_unref);
+  metrics = ygg_worker_get_metrics (fixture->worker);
+  g_assert_cmpuint (lookup_counter (metrics, "dispatch-duplicates"), ==, 1);
+
+  g_clear_object (&fixture->worker);
+  g_unlink (path);
+  g_rmdir (directory);
+}
+
+typedef struct {
+  GDBusConnection *connection;
+  const gchar     *directive;
+} ReplyTarget;
+
+static void
+reply_to_transmit (GVariant *parameters,
+                   gpointer  user_data)
+{
+  ReplyTarget *target = (ReplyTarget *) user_data;
+  g_autofree gchar *name = g_strjoin (".", "com.redhat.Yggdrasil1.Worker1", target->directive, NULL);
+  g_autofree gchar *path = g_strjoin ("/", "/com/redhat/Yggdrasil1/Worker1", target->directive, NULL);
+  const gchar *id = NULL;
+
+  g_variant_get_child (parameters, 1, "&s", &id);
+  g_dbus_connection_call (target->connection,
+                          name,
+                          path,
+                          "com.redhat.Yggdrasil1.Worker1",
+                          "Dispatch",
+                          g_variant_new ("(sss@a{ss}@ay)",
+                                         "test",
+                                         "reply-1",
+                                         id,
+                                         g_variant_new_parsed ("@a{ss} {}"),
+                                         g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, "pong", 4, 1)),
+                          NULL,
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          NULL,
+                          NULL);
+}
+
+static void
+test_worker_request (TestFixture   *fixture,
+                     gconstpointer  user_data)
+{
+  GError *error = NULL;
+  g_autoptr (GBytes) data = g_bytes_new_static ("ping", 4);
+  g_autoptr (GBytes) expected = g_bytes_new_static ("pong", 4);
+  g_autoptr (GAsyncResult) result = NULL;
+  guint n_handled = 0;
+
+  ReplyTarget target = { fixture->connection, "ygg_worker_test" };
+
+  ygg_worker_set_message_rx_func (fixture->worker, count_message_rx, &n_handled, NULL);
+  wait_for_worker (fixture->connection, "ygg_worker_test");
+  fixture->dispatcher->transmit_func = reply_to_transmit;
+  fixture->dispatcher->transmit_func_user_data = &target;
+
+  ygg_worker_request_async (fixture->worker, "test", "request-1", NULL, data, 5000, NULL, connect_done, &result);
+  while (result == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_autoptr (YggMessage) reply = ygg_worker_request_finish (fixture->worker, result, &error);
+  g_assert_no_error (error);
+  g_assert_cmpstr (ygg_message_get_id (reply), ==, "reply-1");
+  g_assert_cmpstr (ygg_message_get_response_to (reply), ==, "request-1");
+  g_assert_true (g_bytes_equal (ygg_message_get_data (reply), expected));
+
+  /* The reply went to the request, not the rx function */
+  g_assert_cmpuint (n_handled, ==, 0);
+}
+
+static void
+test_worker_request_busy (TestFixture   *fixture,
+                          gconstpointer  user_data)
+{
+  GError *error = NULL;
+  BlockingState state = { 0 };
+  ReplyTarget target = { fixture->connection, "ygg_worker_bounded" };
+  g_autoptr (GBytes) data = g_bytes_new_static ("ping", 4);
+  g_autoptr (GBytes) expected = g_bytes_new_static ("pong", 4);
+  g_autoptr (GAsyncResult) result = NULL;
+
+  g_mutex_init (&state.lock);
+  g_cond_init (&state.cond);
+
+  g_autoptr (YggWorker) worker = g_object_new (YGG_TYPE_WORKER,
+                                               "directive", "ygg_worker_bounded",
+                                               "max-concurrency", 1,
+                                               "max-in-flight", 1,
+                                               NULL);
+  ygg_worker_set_rx_func (worker, handle_rx_blocking, &state, NULL);
+  g_assert_true (ygg_worker_connect (worker, &error));
+  g_assert_no_error (error);
+  wait_for_worker (fixture->connection, "ygg_worker_bounded");
+  fixture->dispatcher->transmit_func = reply_to_transmit;
+  fixture->dispatcher->transmit_func_user_data = &target;
+
+  dispatch_and_wait (fixture->connection, "ygg_worker_bounded", data, &error);
+  g_assert_no_error (error);
+  g_mutex_lock (&state.lock);
+  while (!state.started)
+    g_cond_wait (&state.cond, &state.lock);
+  g_mutex_unlock (&state.lock);
+
+  /* The rx queue is full, but a reply to a request is never queued */
+  ygg_worker_request_async (worker, "test", "request-1", NULL, data, 5000, NULL, connect_done, &result);
+  while (result == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_autoptr (YggMessage) reply = ygg_worker_request_finish (worker, result, &error);
+  g_assert_no_error (error);
+  g_assert_cmpstr (ygg_message_get_response_to (reply), ==, "request-1");
+  g_assert_true (g_bytes_equal (ygg_message_get_data (reply), expected));
+
+  g_mutex_lock (&state.lock);
+  state.released = TRUE;
+  g_cond_broadcast (&state.cond);
+  g_mutex_unlock (&state.lock);
+
+  guint queue_depth = 1;
+  while (queue_depth > 0) {
+    g_main_context_iteration (NULL, FALSE);
+    g_object_get (worker, "queue-depth", &queue_depth, NULL);
+  }
+
+  g_mutex_clear (&state.lock);
+  g_cond_clear (&state.cond);
+}
+
+static void
+test_worker_request_timeout (TestFixture   *fixture,
+                             gconstpointer  user_data)
+{
+  GError *error = NULL;
+  g_autoptr (GBytes) data = g_bytes_new_static ("ping", 4);
+  g_autoptr (GAsyncResult) result = NULL;
+
+  ygg_worker_request_async (fixture->worker, "test", "request-1", NULL, data, 50, NULL, connect_done, &result);
+  while (result == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_autoptr (YggMessage) reply = ygg_worker_request_finish (fixture->worker, result, &error);
+  g_assert_null (reply);
+  g_assert_error (error, YGG_WORKER_ERROR, YGG_WORKER_ERROR_TIMED_OUT);
+  g_clear_error (&error);
+}
+
+typedef struct {
+  GArray *points;
+  gint64  last_timestamp;
+} TraceState;
+
+static void
+handle_trace (YggWorker     *worker,
+              YggTracePoint  point,
+              const gchar   *id,
+              const gchar   *response_to,
+              gint64         timestamp,
+              gpointer       user_data)
+{
+  TraceState *state = (TraceState *) user_data;
+
+  g_assert_cmpint (timestamp, >=, state->last_timestamp);
+  state->last_timestamp = timestamp;
+  g_array_append_val (state->points, point);
+}
+
+static void
+test_worker_trace (TestFixture   *fixture,
+                   gconstpointer  user_data)
+{
+  GError *error = NULL;
+  TraceState state = { g_array_new (FALSE, FALSE, sizeof (YggTracePoint)), 0 };
+  g_autoptr (GBytes) data = g_bytes_new_static ("hello", 5);
+  const YggTracePoint expected_rx[] = {
+    YGG_TRACE_POINT_DISPATCH_RECEIVED,
+    YGG_TRACE_POINT_QUEUED,
+    YGG_TRACE_POINT_BEGIN_SENT,
+    YGG_TRACE_POINT_HANDLER_STARTED,
+    YGG_TRACE_POINT_HANDLER_FINISHED,
+    YGG_TRACE_POINT_END_SENT,
+  };
+  const YggTracePoint expected_tx[] = {
+    YGG_TRACE_POINT_TRANSMIT_ISSUED,
+    YGG_TRACE_POINT_TRANSMIT_COMPLETED,
+  };
+
+  ygg_worker_set_trace_func (fixture->worker, handle_trace, &state, NULL);
+  wait_for_worker (fixture->connection, "ygg_worker_test");
+
+  dispatch_and_wait (fixture->connection, "ygg_worker_test", data, &error);
+  g_assert_no_error (error);
+  while (state.points->len < G_N_ELEMENTS (expected_rx))
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpmem (state.points->data, state.points->len * sizeof (YggTracePoint),
+                   expected_rx, sizeof (expected_rx));
+
+  g_array_set_size (state.points, 0);
+  g_assert_true (transmit_and_wait (fixture->worker, data, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_cmpmem (state.points->data, state.points->len * sizeof (YggTracePoint),
+                   expected_tx, sizeof (expected_tx));
+
+  ygg_worker_set_trace_func (fixture->worker, NULL, NULL, NULL);
+  g_array_unref (state.points);
+}
+
+static void
+test_worker_transmit_latency (TestFixture   *fixture,
+                              gconstpointer  user_data)
+{
+  const guint n_transmits = 1000;
+  GError *error = NULL;
+  g_autoptr (GBytes) data = g_bytes_new_static ("hello", 5);
+
+  if (!g_test_perf ()) {
+    g_test_skip ("not running in perf mode");
+    return;
+  }
+
+  /* Warm up the connection and the dispatcher proxy */
+  g_assert_true (transmit_and_wait (fixture->worker, data, NULL, &error));
+  g_assert_no_error (error);
+
+  g_test_timer_start ();
+  for (guint i = 0; i < n_transmits; i++) {
+    g_assert_true (transmit_and_wait (fixture->worker, data, NULL, &error));
+    g_assert_no_error (error);
+  }
+  gdouble elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed / n_transmits * G_USEC_PER_SEC,
+                           "%.2f us per transmit", elapsed / n_transmits * G_USEC_PER_SEC);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  setlocale (LC_ALL, "");
+  g_setenv ("DBUS_STARTER_BUS_TYPE", "session", TRUE);
+  g_test_init (&argc, &argv,
+#if GLIB_CHECK_VERSION(2, 60, 0)
+               G_TEST_OPTION_ISOLATE_DIRS,
+#endif
+               NULL);
+
+  g_test_add ("/ygg/worker/connect",
+              TestFixture,
+              NULL,
+              fixture_setup,
+              test_worker_connect,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/connect_async",
+              TestFixture,
+              NULL,
+              fixture_setup,
+              test_worker_connect_async,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/connect_async/cancel",
+              TestFixture,
+              NULL,
+              fixture_setup,
+              test_worker_connect_async_cancel,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/emit_event/before_connect",
+              TestFixture,
+              NULL,
+              fixture_setup,
+              test_worker_emit_event_before_connect,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/transmit",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_transmit,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/transmit/binary",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_transmit_binary,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/transmit/throughput",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_transmit_throughput,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/max_concurrency",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_max_concurrency,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/max_in_flight",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_max_in_flight,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/max_in_flight/stream",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_max_in_flight_stream,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/priority",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_priority,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/transmit/batch",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_transmit_batch,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/transmit/batch/throughput",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_transmit_batch_throughput,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/transmit/stream",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_transmit_stream,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/message_rx",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_message_rx,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/message/metadata_copy",
+              TestFixture,
+              NULL,
+              fixture_setup,
+              test_worker_message_metadata_copy,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/message_pool",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_message_pool,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/transmit/spool",
+              TestFixture,
+              NULL,
+              spool_fixture_setup,
+              test_worker_transmit_spool,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/transmit/spool/memory",
+              TestFixture,
+              NULL,
+              spool_fixture_setup,
+              test_worker_transmit_spool_memory,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/transmit/retry",
+              TestFixture,
+              NULL,
+              spool_fixture_setup,
+              test_worker_transmit_retry,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/transmit/retry/spool",
+              TestFixture,
+              NULL,
+              spool_fixture_setup,
+              test_worker_transmit_retry_spool,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/transmit/batch/offline",
+              TestFixture,
+              NULL,
+              spool_fixture_setup,
+              test_worker_transmit_batch_offline,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/transmit/stream/offline",
+              TestFixture,
+              NULL,
+              spool_fixture_setup,
+              test_worker_transmit_stream_offline,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/journal",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_journal,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/journal/replay",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_journal_replay,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/request",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_request,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/request/busy",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_request_busy,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/request/timeout",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_request_timeout,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/stream_rx",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_stream_rx,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/stream_rx/limit",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_stream_rx_limit,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/set_features",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_set_features,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/emit_event/coalesce_working",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_working_event_coalescing,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/metrics",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_metrics,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/trace",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_trace,
+              fixture_teardown);
+
+  g_test_add ("/ygg/worker/transmit/latency",
+              TestFixture,
+              NULL,
+              dispatcher_fixture_setup,
+              test_worker_transmit_latency,
               fixture_teardown);
 
   return g_test_run ();
@@ -0,0 +1,87 @@
+/*
+ * ygg-journal-private.h
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * YggJournal:
+ *
+ * An append-only log of received messages, memory-mapped from a file. Each
+ * message is recorded as the "(sssa{ss}ay)" parameters of
+ * com.redhat.Yggdrasil1.Worker1.Dispatch and stays pending until it is
+ * completed. Messages still pending when the journal is reopened are
+ * recovered. The journal also remembers the IDs of recently recorded messages,
+ * completed or not, across reopening, so that redelivered messages can be
+ * recognized. It is safe to use from several threads.
+ */
+typedef struct _YggJournal YggJournal;
+
+/**
+ * YggJournalEntry:
+ *
+ * A pending message in a #YggJournal. It is freed when it is completed, or
+ * when the journal is freed.
+ */
+typedef struct _YggJournalEntry YggJournalEntry;
+
+/**
+ * YggJournalFunc:
+ * @entry: A pending #YggJournalEntry.
+ * @value: (transfer none): The message recorded by @entry.
+ * @user_data: (closure): Data passed to ygg_journal_foreach_pending().
+ *
+ * Signature of a function invoked by ygg_journal_foreach_pending().
+ */
+typedef void (* YggJournalFunc) (YggJournalEntry *entry,
+                                 GVariant        *value,
+                                 gpointer         user_data);
+
+YggJournal *ygg_journal_open (const gchar  *path,
+                              guint         dedup_size,
+                              gboolean      sync,
+                              GError      **error);
+
+void ygg_journal_free (YggJournal *journal);
+
+gboolean ygg_journal_append (YggJournal       *journal,
+                             GVariant         *value,
+                             YggJournalEntry **entry,
+                             GError          **error);
+
+void ygg_journal_complete (YggJournal      *journal,
+                           YggJournalEntry *entry);
+
+gboolean ygg_journal_lookup_id (YggJournal  *journal,
+                                const gchar *id);
+
+void ygg_journal_foreach_pending (YggJournal     *journal,
+                                  YggJournalFunc  func,
+                                  gpointer        user_data);
+
+guint ygg_journal_get_n_pending (YggJournal *journal);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (YggJournal, ygg_journal_free)
+
+G_END_DECLS
@@ -0,0 +1,663 @@
+/*
+ * ygg-journal.c
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "ygg-journal-private.h"
+
+/*
+ * The journal file starts with a header holding JOURNAL_MAGIC, followed by
+ * records. Each record is a JournalRecord holding the little-endian size of
+ * the serialized message and its state, followed by the message itself,
+ * padded to 8 bytes. A record with a size of 0 marks the end of the journal.
+ *
+ * A record is appended by writing the message, its state and the end marker
+ * after it, and only then its size, so a record is never found half-written.
+ * Completing a record rewrites its state. When a record does not fit, the
+ * journal is compacted: the pending records and the remembered IDs are copied
+ * into a new file, which then replaces the journal. Each remembered ID is kept
+ * as a record of its own, holding just the NUL-terminated ID, so that
+ * completed messages are still recognized after the journal is reopened.
+ *
+ * The new file is the smallest power-of-two multiple of JOURNAL_INITIAL_SIZE
+ * that is at least twice as large as the records copied into it, so a journal
+ * that grew for a large message shrinks again. For the same reason, the
+ * journal is also compacted when a record is completed if the live records
+ * would take up less than a quarter of the file.
+ */
+
+#define JOURNAL_MAGIC "YGGJRNL1"
+#define JOURNAL_HEADER_SIZE 16
+#define JOURNAL_INITIAL_SIZE (256 * 1024)
+#define JOURNAL_RECORD_PENDING 1
+#define JOURNAL_RECORD_DONE 2
+#define JOURNAL_RECORD_ID 3
+#define JOURNAL_ALIGN(n) (((n) + 7) & ~(gsize) 7)
+
+#define JOURNAL_VALUE_TYPE G_VARIANT_TYPE ("(sssa{ss}ay)")
+
+typedef struct {
+  guint32 size;
+  guint32 state;
+} JournalRecord;
+
+struct _YggJournalEntry {
+  GList   link;
+  gsize   offset;
+  guint32 size;
+};
+
+struct _YggJournal {
+  GMutex      lock;
+  gchar      *path;
+  gboolean    sync;
+  gint        fd;
+  guint8     *map;
+  gsize       capacity;
+  gsize       write_offset;
+  gsize       live_bytes;
+  GQueue      pending;
+  guint       dedup_size;
+  GQueue      recent_ids;
+  GHashTable *recent_index;
+  gsize       id_bytes;
+};
+
+static inline gsize
+record_length (guint32 size)
+{
+  return sizeof (JournalRecord) + JOURNAL_ALIGN (size);
+}
+
+static inline JournalRecord *
+journal_record (YggJournal *journal,
+                gsize       offset)
+{
+  return (JournalRecord *) (journal->map + offset);
+}
+
+/**
+ * journal_set_field:
+ * @field: A field of a #JournalRecord in the journal's mapping.
+ * @value: The value to store in little-endian byte order.
+ *
+ * Stores @value with a full barrier, so that the writes before it reach the
+ * mapping first.
+ */
+static inline void
+journal_set_field (guint32 *field,
+                   guint32  value)
+{
+  g_atomic_int_set ((gint *) field, (gint) GUINT32_TO_LE (value));
+}
+
+/**
+ * journal_flush:
+ * @journal: A #YggJournal.
+ * @offset: The start of the modified range.
+ * @length: The length of the modified range.
+ *
+ * Writes a modified range of the mapping to disk if the journal was opened
+ * with @sync set. Otherwise the kernel writes it back in its own time; it
+ * survives the process either way.
+ */
+static void
+journal_flush (YggJournal *journal,
+               gsize       offset,
+               gsize       length)
+{
+  if (!journal->sync) {
+    return;
+  }
+
+  gsize page_size = (gsize) sysconf (_SC_PAGESIZE);
+  gsize start = offset - offset % page_size;
+  if (msync (journal->map + start, offset + length - start, MS_SYNC) < 0) {
+    g_warning ("unable to sync journal %s: %s", journal->path, g_strerror (errno));
+  }
+}
+
+static guint8 *
+journal_map (gint          fd,
+             gsize         capacity,
+             const gchar  *path,
+             GError      **error)
+{
+  gpointer map = mmap (NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    int saved_errno = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                 "unable to map journal %s: %s", path, g_strerror (saved_errno));
+    return NULL;
+  }
+
+  return map;
+}
+
+/**
+ * journal_remember_id:
+ * @journal: A #YggJournal, locked.
+ * @id: A message ID.
+ *
+ * Makes @id the most recently recorded ID, forgetting the least recently
+ * recorded one if the journal already remembers its @dedup_size IDs.
+ */
+static void
+journal_remember_id (YggJournal  *journal,
+                     const gchar *id)
+{
+  if (journal->dedup_size == 0) {
+    return;
+  }
+
+  GList *link = g_hash_table_lookup (journal->recent_index, id);
+  if (link != NULL) {
+    g_queue_unlink (&journal->recent_ids, link);
+    g_queue_push_head_link (&journal->recent_ids, link);
+    return;
+  }
+
+  if (g_queue_get_length (&journal->recent_ids) >= journal->dedup_size) {
+    gchar *oldest = g_queue_pop_tail (&journal->recent_ids);
+    g_hash_table_remove (journal->recent_index, oldest);
+    journal->id_bytes -= record_length (strlen (oldest) + 1);
+    g_free (oldest);
+  }
+  journal->id_bytes += record_length (strlen (id) + 1);
+  g_queue_push_head (&journal->recent_ids, g_strdup (id));
+  g_hash_table_insert (journal->recent_index, journal->recent_ids.head->data, journal->recent_ids.head);
+}
+
+/**
+ * journal_recover:
+ * @journal: A newly opened #YggJournal.
+ *
+ * Scans the records of the journal, remembering the ID of each and keeping an
+ * entry for each that is still pending. Scanning stops at the end marker, or
+ * at the first record that cannot be valid; new records are appended there.
+ */
+static void
+journal_recover (YggJournal *journal)
+{
+  gsize offset = JOURNAL_HEADER_SIZE;
+
+  while (offset + sizeof (JournalRecord) <= journal->capacity) {
+    JournalRecord *record = journal_record (journal, offset);
+    guint32 size = GUINT32_FROM_LE (record->size);
+    guint32 state = GUINT32_FROM_LE (record->state);
+
+    if (size == 0) {
+      break;
+    }
+    if (record_length (size) > journal->capacity - offset ||
+        (state != JOURNAL_RECORD_PENDING && state != JOURNAL_RECORD_DONE && state != JOURNAL_RECORD_ID) ||
+        (state == JOURNAL_RECORD_ID && ((const gchar *) (record + 1))[size - 1] != '\0')) {
+      g_warning ("journal %s is corrupt after offset %" G_GSIZE_FORMAT "; discarding the rest",
+                 journal->path, offset);
+      break;
+    }
+
+    if (state == JOURNAL_RECORD_ID) {
+      journal_remember_id (journal, (const gchar *) (record + 1));
+      offset += record_length (size);
+      continue;
+    }
+
+    g_autoptr (GVariant) value = g_variant_ref_sink (g_variant_new_from_data (JOURNAL_VALUE_TYPE,
+                                                                              record + 1,
+                                                                              size,
+                                                                              FALSE,
+                                                                              NULL,
+                                                                              NULL));
+    const gchar *id = NULL;
+    g_variant_get_child (value, 1, "&s", &id);
+    journal_remember_id (journal, id);
+
+    if (state == JOURNAL_RECORD_PENDING) {
+      YggJournalEntry *entry = g_new0 (YggJournalEntry, 1);
+      entry->link.data = entry;
+      entry->offset = offset;
+      entry->size = size;
+      g_queue_push_tail_link (&journal->pending, &entry->link);
+      journal->live_bytes += record_length (size);
+    }
+
+    offset += record_length (size);
+  }
+
+  journal->write_offset = offset;
+  if (journal->write_offset + sizeof (JournalRecord) <= journal->capacity) {
+    journal_set_field (&journal_record (journal, journal->write_offset)->size, 0);
+    journal_flush (journal, journal->write_offset, sizeof (JournalRecord));
+  }
+}
+
+/**
+ * ygg_journal_open:
+ * @path: The path of the journal file. It is created if it does not exist.
+ * @dedup_size: The number of recently recorded message IDs to remember.
+ * @sync: Whether to write every change to disk before returning, so that the
+ * journal survives a power failure as well as the process exiting.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Opens the journal at @path and recovers its pending messages, which are then
+ * available from ygg_journal_foreach_pending().
+ *
+ * Returns: (transfer full) (nullable): A #YggJournal, or %NULL on error.
+ */
+YggJournal *
+ygg_journal_open (const gchar  *path,
+                  guint         dedup_size,
+                  gboolean      sync,
+                  GError      **error)
+{
+  gint fd = g_open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    int saved_errno = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                 "unable to open journal %s: %s", path, g_strerror (saved_errno));
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat (fd, &st) < 0) {
+    int saved_errno = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                 "unable to open journal %s: %s", path, g_strerror (saved_errno));
+    g_close (fd, NULL);
+    return NULL;
+  }
+
+  gboolean created = st.st_size == 0;
+  gsize capacity = created ? JOURNAL_INITIAL_SIZE : (gsize) st.st_size;
+  if (created && ftruncate (fd, capacity) < 0) {
+    int saved_errno = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                 "unable to create journal %s: %s", path, g_strerror (saved_errno));
+    g_close (fd, NULL);
+    return NULL;
+  }
+  if (capacity < JOURNAL_HEADER_SIZE + sizeof (JournalRecord) || capacity % 8 != 0) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s is not a journal", path);
+    g_close (fd, NULL);
+    return NULL;
+  }
+
+  guint8 *map = journal_map (fd, capacity, path, error);
+  if (map == NULL) {
+    g_close (fd, NULL);
+    return NULL;
+  }
+  if (created) {
+    memcpy (map, JOURNAL_MAGIC, strlen (JOURNAL_MAGIC));
+  } else if (memcmp (map, JOURNAL_MAGIC, strlen (JOURNAL_MAGIC)) != 0) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s is not a journal", path);
+    munmap (map, capacity);
+    g_close (fd, NULL);
+    return NULL;
+  }
+
+  YggJournal *journal = g_new0 (YggJournal, 1);
+  g_mutex_init (&journal->lock);
+  journal->path = g_strdup (path);
+  journal->sync = sync;
+  journal->fd = fd;
+  journal->map = map;
+  journal->capacity = capacity;
+  g_queue_init (&journal->pending);
+  journal->dedup_size = dedup_size;
+  g_queue_init (&journal->recent_ids);
+  journal->recent_index = g_hash_table_new (g_str_hash, g_str_equal);
+
+  if (created) {
+    journal_flush (journal, 0, JOURNAL_HEADER_SIZE);
+  }
+  journal_recover (journal);
+
+  return journal;
+}
+
+/**
+ * ygg_journal_free:
+ * @journal: (transfer full): A #YggJournal.
+ *
+ * Closes @journal. Its pending entries are freed, but their messages remain
+ * pending in the journal file.
+ */
+void
+ygg_journal_free (YggJournal *journal)
+{
+  GList *link = NULL;
+
+  while ((link = g_queue_pop_head_link (&journal->pending)) != NULL) {
+    g_free (link->data);
+  }
+  while ((link = g_queue_pop_head_link (&journal->recent_ids)) != NULL) {
+    g_free (link->data);
+    g_list_free_1 (link);
+  }
+  g_hash_table_unref (journal->recent_index);
+
+  munmap (journal->map, journal->capacity);
+  g_close (journal->fd, NULL);
+  g_free (journal->path);
+  g_mutex_clear (&journal->lock);
+  g_free (journal);
+}
+
+/**
+ * journal_capacity_for:
+ * @needed: The number of bytes a journal file must hold.
+ *
+ * Returns: The size of a journal file holding @needed bytes: the smallest
+ * power-of-two multiple of JOURNAL_INITIAL_SIZE that is at least twice
+ * @needed.
+ */
+static gsize
+journal_capacity_for (gsize needed)
+{
+  gsize capacity = JOURNAL_INITIAL_SIZE;
+  while (capacity < 2 * needed) {
+    capacity *= 2;
+  }
+
+  return capacity;
+}
+
+/**
+ * journal_needed:
+ * @journal: A #YggJournal, locked.
+ *
+ * Returns: The number of bytes the header, the pending records, the
+ * remembered IDs and the end marker take up once the journal is compacted.
+ */
+static gsize
+journal_needed (YggJournal *journal)
+{
+  return JOURNAL_HEADER_SIZE + journal->id_bytes + journal->live_bytes + sizeof (JournalRecord);
+}
+
+/**
+ * journal_rewrite:
+ * @journal: A #YggJournal, locked.
+ * @reserve: The number of bytes to leave free after the copied records.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Compacts the journal: copies the pending records and then the remembered
+ * IDs, oldest first, into a new journal file sized by journal_capacity_for(),
+ * and replaces the journal with it. Recovering the IDs after the pending
+ * records restores the order in which the IDs were last used. The journal is
+ * left untouched on error.
+ *
+ * Returns: %TRUE on success, or %FALSE on error.
+ */
+static gboolean
+journal_rewrite (YggJournal  *journal,
+                 gsize        reserve,
+                 GError     **error)
+{
+  gsize capacity = journal_capacity_for (journal_needed (journal) + reserve);
+
+  g_autofree gchar *new_path = g_strconcat (journal->path, ".new", NULL);
+  gint fd = g_open (new_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    int saved_errno = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                 "unable to create journal %s: %s", new_path, g_strerror (saved_errno));
+    return FALSE;
+  }
+  if (ftruncate (fd, capacity) < 0) {
+    int saved_errno = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                 "unable to grow journal %s: %s", new_path, g_strerror (saved_errno));
+    g_close (fd, NULL);
+    g_unlink (new_path);
+    return FALSE;
+  }
+  guint8 *map = journal_map (fd, capacity, new_path, error);
+  if (map == NULL) {
+    g_close (fd, NULL);
+    g_unlink (new_path);
+    return FALSE;
+  }
+
+  memcpy (map, journal->map, JOURNAL_HEADER_SIZE);
+  gsize offset = JOURNAL_HEADER_SIZE;
+  for (GList *link = journal->pending.head; link != NULL; link = link->next) {
+    YggJournalEntry *entry = link->data;
+    gsize length = record_length (entry->size);
+    memcpy (map + offset, journal->map + entry->offset, length);
+    offset += length;
+  }
+  for (GList *link = journal->recent_ids.tail; link != NULL; link = link->prev) {
+    const gchar *id = link->data;
+    gsize size = strlen (id) + 1;
+    JournalRecord *record = (JournalRecord *) (map + offset);
+    record->size = GUINT32_TO_LE ((guint32) size);
+    record->state = GUINT32_TO_LE (JOURNAL_RECORD_ID);
+    memcpy (record + 1, id, size);
+    offset += record_length (size);
+  }
+
+  if ((journal->sync && fsync (fd) < 0) || g_rename (new_path, journal->path) < 0) {
+    int saved_errno = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                 "unable to replace journal %s: %s", journal->path, g_strerror (saved_errno));
+    munmap (map, capacity);
+    g_close (fd, NULL);
+    g_unlink (new_path);
+    return FALSE;
+  }
+
+  gsize write_offset = offset;
+  offset = JOURNAL_HEADER_SIZE;
+  for (GList *link = journal->pending.head; link != NULL; link = link->next) {
+    YggJournalEntry *entry = link->data;
+    entry->offset = offset;
+    offset += record_length (entry->size);
+  }
+
+  munmap (journal->map, journal->capacity);
+  g_close (journal->fd, NULL);
+  journal->fd = fd;
+  journal->map = map;
+  journal->capacity = capacity;
+  journal->write_offset = write_offset;
+
+  return TRUE;
+}
+
+/**
+ * ygg_journal_append:
+ * @journal: A #YggJournal.
+ * @value: (transfer none): A message of type "(sssa{ss}ay)".
+ * @entry: (out) (transfer none): Return location for the pending entry of
+ * @value.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Records @value as pending and remembers its ID.
+ *
+ * Returns: %TRUE if @value was recorded, or %FALSE on error.
+ */
+gboolean
+ygg_journal_append (YggJournal       *journal,
+                    GVariant         *value,
+                    YggJournalEntry **entry,
+                    GError          **error)
+{
+  g_return_val_if_fail (g_variant_is_of_type (value, JOURNAL_VALUE_TYPE), FALSE);
+
+  gsize size = g_variant_get_size (value);
+  if (size == 0 || size > G_MAXUINT32 - 8) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+                 "message of %" G_GSIZE_FORMAT " bytes cannot be journaled", size);
+    return FALSE;
+  }
+  gsize length = record_length (size);
+
+  g_mutex_lock (&journal->lock);
+  if (journal->write_offset + length + sizeof (JournalRecord) > journal->capacity &&
+      !journal_rewrite (journal, length, error)) {
+    g_mutex_unlock (&journal->lock);
+    return FALSE;
+  }
+
+  gsize offset = journal->write_offset;
+  JournalRecord *record = journal_record (journal, offset);
+  g_variant_store (value, record + 1);
+  memset ((guint8 *) (record + 1) + size, 0, JOURNAL_ALIGN (size) - size);
+  journal_set_field (&record->state, JOURNAL_RECORD_PENDING);
+  journal_set_field (&journal_record (journal, offset + length)->size, 0);
+  journal_set_field (&record->size, (guint32) size);
+  journal_flush (journal, offset, length + sizeof (JournalRecord));
+
+  YggJournalEntry *appended = g_new0 (YggJournalEntry, 1);
+  appended->link.data = appended;
+  appended->offset = offset;
+  appended->size = (guint32) size;
+  g_queue_push_tail_link (&journal->pending, &appended->link);
+  journal->live_bytes += length;
+  journal->write_offset += length;
+
+  const gchar *id = NULL;
+  g_variant_get_child (value, 1, "&s", &id);
+  journal_remember_id (journal, id);
+  g_mutex_unlock (&journal->lock);
+
+  *entry = appended;
+
+  return TRUE;
+}
+
+/**
+ * ygg_journal_complete:
+ * @journal: A #YggJournal.
+ * @entry: (transfer full): A pending entry of @journal.
+ *
+ * Marks the message of @entry as done, so that it is not recovered when the
+ * journal is reopened, and frees @entry.
+ */
+void
+ygg_journal_complete (YggJournal      *journal,
+                      YggJournalEntry *entry)
+{
+  g_mutex_lock (&journal->lock);
+  journal_set_field (&journal_record (journal, entry->offset)->state, JOURNAL_RECORD_DONE);
+  journal_flush (journal, entry->offset, sizeof (JournalRecord));
+
+  g_queue_unlink (&journal->pending, &entry->link);
+  journal->live_bytes -= record_length (entry->size);
+  g_free (entry);
+
+  /* Shrink a journal that grew for records that are now done */
+  GError *error = NULL;
+  if (journal->capacity > JOURNAL_INITIAL_SIZE && 4 * journal_needed (journal) <= journal->capacity &&
+      !journal_rewrite (journal, 0, &error)) {
+    g_warning ("unable to compact journal: %s", error->message);
+    g_clear_error (&error);
+  }
+  g_mutex_unlock (&journal->lock);
+}
+
+/**
+ * ygg_journal_lookup_id:
+ * @journal: A #YggJournal.
+ * @id: A message ID.
+ *
+ * Checks whether a message with @id is among the most recently recorded
+ * messages, including those recorded before the journal was reopened.
+ *
+ * Returns: %TRUE if a message with @id was recently recorded.
+ */
+gboolean
+ygg_journal_lookup_id (YggJournal  *journal,
+                       const gchar *id)
+{
+  g_mutex_lock (&journal->lock);
+  GList *link = g_hash_table_lookup (journal->recent_index, id);
+  if (link != NULL) {
+    g_queue_unlink (&journal->recent_ids, link);
+    g_queue_push_head_link (&journal->recent_ids, link);
+  }
+  g_mutex_unlock (&journal->lock);
+
+  return link != NULL;
+}
+
+/**
+ * ygg_journal_foreach_pending:
+ * @journal: A #YggJournal.
+ * @func: (scope call): The function to call for each pending entry.
+ * @user_data: (closure): Data to pass to @func.
+ *
+ * Calls @func for each pending entry of @journal, in the order the messages
+ * were recorded. The journal is not locked while @func runs, so it may
+ * complete the entry.
+ */
+void
+ygg_journal_foreach_pending (YggJournal     *journal,
+                             YggJournalFunc  func,
+                             gpointer        user_data)
+{
+  g_mutex_lock (&journal->lock);
+  guint n_pending = g_queue_get_length (&journal->pending);
+  YggJournalEntry **entries = g_new (YggJournalEntry *, n_pending);
+  GVariant **values = g_new (GVariant *, n_pending);
+  guint i = 0;
+  for (GList *link = journal->pending.head; link != NULL; link = link->next, i++) {
+    YggJournalEntry *entry = link->data;
+    g_autoptr (GBytes) bytes = g_bytes_new (journal_record (journal, entry->offset) + 1, entry->size);
+    entries[i] = entry;
+    values[i] = g_variant_ref_sink (g_variant_new_from_bytes (JOURNAL_VALUE_TYPE, bytes, FALSE));
+  }
+  g_mutex_unlock (&journal->lock);
+
+  for (i = 0; i < n_pending; i++) {
+    func (entries[i], values[i], user_data);
+    g_variant_unref (values[i]);
+  }
+  g_free (entries);
+  g_free (values);
+}
+
+/**
+ * ygg_journal_get_n_pending:
+ * @journal: A #YggJournal.
+ *
+ * Returns: The number of messages in @journal that are not yet complete.
+ */
+guint
+ygg_journal_get_n_pending (YggJournal *journal)
+{
+  g_mutex_lock (&journal->lock);
+  guint n_pending = g_queue_get_length (&journal->pending);
+  g_mutex_unlock (&journal->lock);
+
+  return n_pending;
+}
@@ -0,0 +1,129 @@
+/*
+ * ygg-log.c
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string.h>
+
+#include "ygg-log-private.h"
+
+/**
+ * ygg_log_debug_enabled:
+ *
+ * Checks whether debug messages logged in the library's log domain will be
+ * written by the default log writer. Callers use this to skip formatting
+ * expensive debug output that would otherwise be thrown away.
+ *
+ * Returns: %TRUE if debug messages for the library's log domain are enabled.
+ */
+gboolean
+ygg_log_debug_enabled (void)
+{
+#if GLIB_CHECK_VERSION(2, 68, 0)
+  return !g_log_writer_default_would_drop (G_LOG_LEVEL_DEBUG, G_LOG_DOMAIN);
+#else
+  const gchar *domains = g_getenv ("G_MESSAGES_DEBUG");
+  if (domains == NULL) {
+    return FALSE;
+  }
+  if (strcmp (domains, "all") == 0) {
+    return TRUE;
+  }
+
+  g_auto (GStrv) names = g_strsplit_set (domains, " ,", -1);
+  return g_strv_contains ((const gchar * const *) names, G_LOG_DOMAIN);
+#endif
+}
+
+/**
+ * ygg_log_payload_limit:
+ *
+ * Reads the YGG_DEBUG_PAYLOAD_LIMIT environment variable.
+ *
+ * Returns: The maximum number of characters to print for any single value, or
+ * 0 if values should be printed in full.
+ */
+static gsize
+ygg_log_payload_limit (void)
+{
+  const gchar *limit = g_getenv ("YGG_DEBUG_PAYLOAD_LIMIT");
+  if (limit == NULL) {
+    return 0;
+  }
+  return (gsize) g_ascii_strtoull (limit, NULL, 10);
+}
+
+static void
+print_bounded (GVariant *value,
+               gsize     limit,
+               GString  *string)
+{
+  if (g_variant_is_of_type (value, G_VARIANT_TYPE_BYTESTRING)) {
+    g_string_append_printf (string, "<%" G_GSIZE_FORMAT " bytes>", g_variant_get_size (value));
+    return;
+  }
+
+  if (g_variant_is_of_type (value, G_VARIANT_TYPE_TUPLE)) {
+    gsize n_children = g_variant_n_children (value);
+    g_string_append_c (string, '(');
+    for (gsize i = 0; i < n_children; i++) {
+      g_autoptr (GVariant) child = g_variant_get_child_value (value, i);
+      if (i > 0) {
+        g_string_append (string, ", ");
+      }
+      print_bounded (child, limit, string);
+    }
+    g_string_append_c (string, ')');
+    return;
+  }
+
+  g_autofree gchar *printed = g_variant_print (value, FALSE);
+  glong length = g_utf8_strlen (printed, -1);
+  if ((gsize) length <= limit) {
+    g_string_append (string, printed);
+    return;
+  }
+
+  g_autofree gchar *prefix = g_utf8_substring (printed, 0, limit);
+  g_string_append_printf (string, "%s... <%ld characters>", prefix, length);
+}
+
+/**
+ * ygg_log_print_variant:
+ * @value: A #GVariant.
+ *
+ * Formats @value for debug output. By default this is equivalent to
+ * g_variant_print(). If the YGG_DEBUG_PAYLOAD_LIMIT environment variable is
+ * set to a positive number, byte arrays are replaced by their size and every
+ * other value is truncated to at most that many characters.
+ *
+ * Returns: (transfer full): A newly allocated string.
+ */
+gchar *
+ygg_log_print_variant (GVariant *value)
+{
+  gsize limit = ygg_log_payload_limit ();
+  if (limit == 0) {
+    return g_variant_print (value, TRUE);
+  }
+
+  GString *string = g_string_new (NULL);
+  print_bounded (value, limit, string);
+  return g_string_free (string, FALSE);
+}
@@ -0,0 +1,106 @@
+/*
+ * ygg-message-private.h
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "ygg-journal-private.h"
+#include "ygg-message.h"
+#include "ygg-metadata-private.h"
+#include "ygg-worker.h"
+
+G_BEGIN_DECLS
+
+/**
+ * YGG_MESSAGE_POOL_STRINGS_SIZE:
+ *
+ * The number of bytes a pooled message reserves for its addr, id and
+ * response_to strings. Messages whose strings do not fit are allocated to size
+ * and are not pooled.
+ */
+#define YGG_MESSAGE_POOL_STRINGS_SIZE 192
+
+/**
+ * YggMessagePool:
+ *
+ * A free list of message allocations, shared by the receive and transmit paths
+ * of a worker. It is safe to use from several threads.
+ */
+typedef struct _YggMessagePool YggMessagePool;
+
+/*
+ * A message and its strings are a single allocation: @addr, @id and
+ * @response_to point into @strings.
+ */
+struct _YggMessage {
+  gint             ref_count;
+  YggMessagePool  *pool;
+  YggMessage      *next_free;
+  YggWorker       *worker;
+  gchar           *addr;
+  gchar           *id;
+  gchar           *response_to;
+  YggMetadata     *metadata;
+  GBytes          *data;
+  gint             priority;
+  guint            sequence;
+  GInputStream    *stream;
+  gint64           timestamp;
+  guint            attempts;
+  gboolean         spooled;
+  YggJournalEntry *journal_entry;
+  gsize            strings_size;
+  gchar            strings[];
+};
+
+YggMessagePool *ygg_message_pool_new (guint max_size);
+
+void ygg_message_pool_free (YggMessagePool *pool);
+
+void ygg_message_pool_set_max_size (YggMessagePool *pool,
+                                    guint           max_size);
+
+void ygg_message_pool_get_stats (YggMessagePool *pool,
+                                 guint64        *allocated,
+                                 guint64        *reused);
+
+YggMessage *ygg_message_new (YggWorker      *worker,
+                             YggMessagePool *pool,
+                             const gchar    *addr,
+                             const gchar    *id,
+                             const gchar    *response_to,
+                             YggMetadata    *metadata,
+                             GBytes         *data);
+
+YggMessage *ygg_message_new_from_variant (YggWorker       *worker,
+                                          YggMessagePool  *pool,
+                                          GVariant        *parameters,
+                                          GError         **error);
+
+void ygg_message_drop_payload (YggMessage *message);
+
+void ygg_message_restore_payload (YggMessage *message,
+                                  GVariant   *parameters);
+
+GVariant *ygg_message_to_variant (YggMessage *message);
+
+G_END_DECLS
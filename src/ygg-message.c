@@ -0,0 +1,504 @@
+/*
+ * ygg-message.c
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string.h>
+
+#include "ygg-message-private.h"
+#include "ygg-worker-private.h"
+
+G_DEFINE_BOXED_TYPE (YggMessage, ygg_message, ygg_message_ref, ygg_message_unref)
+
+struct _YggMessagePool {
+  GMutex      lock;
+  YggMessage *free_list;
+  guint       n_free;
+  guint       max_size;
+  guint64     allocated;
+  guint64     reused;
+};
+
+/**
+ * ygg_message_pool_new:
+ * @max_size: The maximum number of free messages to keep.
+ *
+ * Creates a new, empty #YggMessagePool.
+ *
+ * Returns: (transfer full): A new #YggMessagePool.
+ */
+YggMessagePool *
+ygg_message_pool_new (guint max_size)
+{
+  YggMessagePool *pool = g_new0 (YggMessagePool, 1);
+
+  g_mutex_init (&pool->lock);
+  pool->max_size = max_size;
+
+  return pool;
+}
+
+static void
+message_pool_trim (YggMessagePool *pool)
+{
+  while (pool->n_free > pool->max_size) {
+    YggMessage *message = pool->free_list;
+    pool->free_list = message->next_free;
+    pool->n_free--;
+    g_free (message);
+  }
+}
+
+/**
+ * ygg_message_pool_free:
+ * @pool: (transfer full): A #YggMessagePool.
+ *
+ * Frees @pool and the messages on its free list. Messages allocated from @pool
+ * must not outlive it.
+ */
+void
+ygg_message_pool_free (YggMessagePool *pool)
+{
+  pool->max_size = 0;
+  message_pool_trim (pool);
+  g_mutex_clear (&pool->lock);
+  g_free (pool);
+}
+
+/**
+ * ygg_message_pool_set_max_size:
+ * @pool: A #YggMessagePool.
+ * @max_size: The maximum number of free messages to keep.
+ *
+ * Changes the number of free messages @pool keeps, freeing any beyond it.
+ */
+void
+ygg_message_pool_set_max_size (YggMessagePool *pool,
+                               guint           max_size)
+{
+  g_mutex_lock (&pool->lock);
+  pool->max_size = max_size;
+  message_pool_trim (pool);
+  g_mutex_unlock (&pool->lock);
+}
+
+/**
+ * ygg_message_pool_get_stats:
+ * @pool: A #YggMessagePool.
+ * @allocated: (out): Return location for the number of messages allocated.
+ * @reused: (out): Return location for the number of messages taken from the
+ * free list instead.
+ */
+void
+ygg_message_pool_get_stats (YggMessagePool *pool,
+                            guint64        *allocated,
+                            guint64        *reused)
+{
+  g_mutex_lock (&pool->lock);
+  *allocated = pool->allocated;
+  *reused = pool->reused;
+  g_mutex_unlock (&pool->lock);
+}
+
+static YggMessage *
+message_alloc (YggMessagePool *pool,
+               gsize           strings_size)
+{
+  YggMessage *message = NULL;
+
+  if (pool != NULL) {
+    g_mutex_lock (&pool->lock);
+    if (strings_size <= YGG_MESSAGE_POOL_STRINGS_SIZE && pool->free_list != NULL) {
+      message = pool->free_list;
+      pool->free_list = message->next_free;
+      pool->n_free--;
+      pool->reused++;
+    } else {
+      pool->allocated++;
+    }
+    g_mutex_unlock (&pool->lock);
+  }
+
+  if (message == NULL) {
+    /* Allocations that fit are rounded up so that they can be pooled. */
+    if (pool != NULL && strings_size <= YGG_MESSAGE_POOL_STRINGS_SIZE) {
+      strings_size = YGG_MESSAGE_POOL_STRINGS_SIZE;
+    }
+    message = g_malloc (sizeof (YggMessage) + strings_size);
+    message->strings_size = strings_size;
+  }
+
+  message->ref_count = 1;
+  message->pool = pool;
+  message->next_free = NULL;
+  message->priority = 0;
+  message->sequence = 0;
+  message->stream = NULL;
+  message->timestamp = 0;
+  message->attempts = 0;
+  message->spooled = FALSE;
+  message->journal_entry = NULL;
+
+  return message;
+}
+
+static void
+message_release (YggMessage *message)
+{
+  YggMessagePool *pool = message->pool;
+
+  if (pool != NULL && message->strings_size == YGG_MESSAGE_POOL_STRINGS_SIZE) {
+    g_mutex_lock (&pool->lock);
+    if (pool->n_free < pool->max_size) {
+      message->next_free = pool->free_list;
+      pool->free_list = message;
+      pool->n_free++;
+      message = NULL;
+    }
+    g_mutex_unlock (&pool->lock);
+  }
+
+  g_free (message);
+}
+
+static gchar *
+message_copy_string (gchar       **dest,
+                     const gchar  *src)
+{
+  gsize size = strlen (src) + 1;
+  gchar *str = *dest;
+
+  memcpy (str, src, size);
+  *dest += size;
+
+  return str;
+}
+
+/**
+ * ygg_message_new:
+ * @worker: (transfer none): The #YggWorker that received or sends the message.
+ * @pool: (nullable): The #YggMessagePool of @worker, or %NULL.
+ * @addr: (transfer none): Address of the message.
+ * @id: (transfer none): ID of the message.
+ * @response_to: (transfer none) (nullable): ID of a message to respond to.
+ * @metadata: (transfer none) (nullable): Key/value pairs to associate with the
+ * message.
+ * @data: (transfer none): The data of the message.
+ *
+ * Creates a new #YggMessage, taking it from @pool if possible. The message
+ * holds a reference on @worker, which keeps @pool alive. A message created
+ * without @metadata has none, and is serialized with an empty table.
+ *
+ * Returns: (transfer full): A newly created #YggMessage.
+ */
+YggMessage *
+ygg_message_new (YggWorker      *worker,
+                 YggMessagePool *pool,
+                 const gchar    *addr,
+                 const gchar    *id,
+                 const gchar    *response_to,
+                 YggMetadata    *metadata,
+                 GBytes         *data)
+{
+  gsize strings_size = strlen (addr) + 1 + strlen (id) + 1;
+  if (response_to != NULL) {
+    strings_size += strlen (response_to) + 1;
+  }
+
+  YggMessage *message = message_alloc (pool, strings_size);
+  gchar *strings = message->strings;
+
+  message->worker = g_object_ref (worker);
+  message->addr = message_copy_string (&strings, addr);
+  message->id = message_copy_string (&strings, id);
+  message->response_to = response_to != NULL ? message_copy_string (&strings, response_to) : NULL;
+  message->metadata = metadata != NULL ? g_object_ref (metadata) : NULL;
+  message->data = g_bytes_ref (data);
+
+  return message;
+}
+
+/*
+ * Metadata borrowed from the parameters of a message keeps all of them alive,
+ * payload included, for as long as the metadata lives. Up to this size of
+ * parameters, that is cheaper than copying the metadata.
+ */
+#define MESSAGE_METADATA_BORROW_LIMIT (16 * 1024)
+
+/**
+ * message_metadata_new:
+ * @parameters: A "(sssa{ss}ay)" #GVariant.
+ * @value: The "a{ss}" child of @parameters.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Creates the metadata of a message from @value. It borrows the strings of
+ * @value if @parameters is small; otherwise it borrows them from a copy of
+ * @value, so that @parameters can be freed along with the message's data.
+ *
+ * Returns: (transfer full) (nullable): A new #YggMetadata.
+ */
+static YggMetadata *
+message_metadata_new (GVariant  *parameters,
+                      GVariant  *value,
+                      GError   **error)
+{
+  if (g_variant_get_size (parameters) <= MESSAGE_METADATA_BORROW_LIMIT) {
+    return ygg_metadata_new_from_variant (value, error);
+  }
+
+  g_autoptr (GBytes) bytes = g_bytes_new (g_variant_get_data (value), g_variant_get_size (value));
+  g_autoptr (GVariant) copy = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE ("a{ss}"), bytes, FALSE));
+
+  return ygg_metadata_new_from_variant (copy, error);
+}
+
+/**
+ * ygg_message_new_from_variant:
+ * @worker: (transfer none): The #YggWorker that received the message.
+ * @pool: (nullable): The #YggMessagePool of @worker, or %NULL.
+ * @parameters: A "(sssa{ss}ay)" #GVariant, as passed to
+ * com.redhat.Yggdrasil1.Worker1.Dispatch.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Creates a new #YggMessage from the parameters of a Dispatch call. The data
+ * of the message references @parameters rather than copying the payload. So
+ * does its metadata, unless @parameters is large.
+ *
+ * Returns: (transfer full) (nullable): A newly created #YggMessage.
+ */
+YggMessage *
+ygg_message_new_from_variant (YggWorker       *worker,
+                              YggMessagePool  *pool,
+                              GVariant        *parameters,
+                              GError         **error)
+{
+  GError *err = NULL;
+  GVariantIter iter;
+  g_variant_iter_init (&iter, parameters);
+
+  const gchar *addr = NULL;
+  g_variant_iter_next (&iter, "&s", &addr);
+
+  const gchar *id = NULL;
+  g_variant_iter_next (&iter, "&s", &id);
+
+  const gchar *response_to = NULL;
+  g_variant_iter_next (&iter, "&s", &response_to);
+
+  g_autoptr (GVariant) metadata_value = g_variant_iter_next_value (&iter);
+  g_autoptr (YggMetadata) metadata = message_metadata_new (parameters, metadata_value, &err);
+  if (err != NULL) {
+    g_propagate_error (error, err);
+    return NULL;
+  }
+
+  /* Reference the payload in place within the message body. */
+  g_autoptr (GVariant) data_value = g_variant_iter_next_value (&iter);
+  g_autoptr (GBytes) data = g_variant_get_data_as_bytes (data_value);
+
+  return ygg_message_new (worker, pool, addr, id, response_to, metadata, data);
+}
+
+/**
+ * ygg_message_drop_payload:
+ * @message: A #YggMessage that is being transmitted.
+ *
+ * Releases the metadata and data of @message while a serialized copy of it is
+ * kept elsewhere, such as in the segment file of a spool. Until
+ * ygg_message_restore_payload() is called, @message must not be serialized.
+ */
+void
+ygg_message_drop_payload (YggMessage *message)
+{
+  g_clear_object (&message->metadata);
+  g_clear_pointer (&message->data, g_bytes_unref);
+}
+
+/**
+ * ygg_message_restore_payload:
+ * @message: A #YggMessage.
+ * @parameters: The "(sssa{ss}ay)" #GVariant @message was serialized as.
+ *
+ * Restores the metadata and data released by ygg_message_drop_payload() from
+ * @parameters. The data references @parameters rather than copying it, as
+ * does the metadata unless @parameters is large. Does nothing if @message
+ * still has its payload.
+ */
+void
+ygg_message_restore_payload (YggMessage *message,
+                             GVariant   *parameters)
+{
+  if (message->data != NULL) {
+    return;
+  }
+
+  g_autoptr (GVariant) metadata_value = g_variant_get_child_value (parameters, 3);
+  g_autoptr (GVariant) data_value = g_variant_get_child_value (parameters, 4);
+  message->metadata = message_metadata_new (parameters, metadata_value, NULL);
+  message->data = g_variant_get_data_as_bytes (data_value);
+}
+
+/**
+ * ygg_message_to_variant:
+ * @message: A #YggMessage.
+ *
+ * Serializes @message as the parameters of a
+ * com.redhat.Yggdrasil1.Dispatcher1.Transmit call.
+ *
+ * Returns: (transfer floating): A "(sssa{ss}ay)" #GVariant.
+ */
+GVariant *
+ygg_message_to_variant (YggMessage *message)
+{
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("(sssa{ss}ay)"));
+  g_variant_builder_add (&builder, "s", message->addr);
+  g_variant_builder_add (&builder, "s", message->id);
+  g_variant_builder_add (&builder, "s", message->response_to != NULL ? message->response_to : "");
+  if (message->metadata != NULL) {
+    g_autoptr (GVariant) metadata = ygg_metadata_ref_variant (message->metadata);
+    g_variant_builder_add_value (&builder, metadata);
+  } else {
+    g_variant_builder_add_value (&builder, g_variant_new_array (G_VARIANT_TYPE ("{ss}"), NULL, 0));
+  }
+  /* Wrap the caller's payload without copying it. Unlike a bytestring, this
+   * preserves embedded NUL bytes and never reads past the end of @data. */
+  g_variant_builder_add_value (&builder, g_variant_new_from_bytes (G_VARIANT_TYPE_BYTESTRING, message->data, TRUE));
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * ygg_message_ref:
+ * @message: A #YggMessage.
+ *
+ * Increases the reference count of @message. A message passed to a
+ * #YggMessageRxFunc is only valid while the function runs; take a reference to
+ * keep it for longer.
+ *
+ * Returns: (transfer full): @message.
+ */
+YggMessage *
+ygg_message_ref (YggMessage *message)
+{
+  g_return_val_if_fail (message != NULL, NULL);
+
+  g_atomic_int_inc (&message->ref_count);
+
+  return message;
+}
+
+/**
+ * ygg_message_unref:
+ * @message: (transfer full): A #YggMessage.
+ *
+ * Decreases the reference count of @message, freeing it when the count drops
+ * to 0.
+ */
+void
+ygg_message_unref (YggMessage *message)
+{
+  g_return_if_fail (message != NULL);
+
+  if (!g_atomic_int_dec_and_test (&message->ref_count)) {
+    return;
+  }
+
+  YggWorker *worker = message->worker;
+
+  g_clear_object (&message->metadata);
+  g_clear_pointer (&message->data, g_bytes_unref);
+  g_clear_object (&message->stream);
+  message_release (message);
+
+  /* This may be the last reference on the worker, which frees the pool. */
+  ygg_worker_release (worker);
+}
+
+/**
+ * ygg_message_get_addr:
+ * @message: A #YggMessage.
+ *
+ * Returns: (transfer none): The address of the message.
+ */
+const gchar *
+ygg_message_get_addr (YggMessage *message)
+{
+  g_return_val_if_fail (message != NULL, NULL);
+
+  return message->addr;
+}
+
+/**
+ * ygg_message_get_id:
+ * @message: A #YggMessage.
+ *
+ * Returns: (transfer none): The ID of the message.
+ */
+const gchar *
+ygg_message_get_id (YggMessage *message)
+{
+  g_return_val_if_fail (message != NULL, NULL);
+
+  return message->id;
+}
+
+/**
+ * ygg_message_get_response_to:
+ * @message: A #YggMessage.
+ *
+ * Returns: (transfer none) (nullable): The ID of the message this message
+ * responds to. It is empty or %NULL if the message is not a response.
+ */
+const gchar *
+ygg_message_get_response_to (YggMessage *message)
+{
+  g_return_val_if_fail (message != NULL, NULL);
+
+  return message->response_to;
+}
+
+/**
+ * ygg_message_get_metadata:
+ * @message: A #YggMessage.
+ *
+ * Returns: (transfer none) (nullable): The key/value pairs associated with the
+ * message, or %NULL if a message being sent has none. They are shared with
+ * every holder of @message and must not be modified.
+ */
+YggMetadata *
+ygg_message_get_metadata (YggMessage *message)
+{
+  g_return_val_if_fail (message != NULL, NULL);
+
+  return message->metadata;
+}
+
+/**
+ * ygg_message_get_data:
+ * @message: A #YggMessage.
+ *
+ * Returns: (transfer none): The data of the message.
+ */
+GBytes *
+ygg_message_get_data (YggMessage *message)
+{
+  g_return_val_if_fail (message != NULL, NULL);
+
+  return message->data;
+}
@@ -0,0 +1,59 @@
+/*
+ * ygg-message.h
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include "ygg-metadata.h"
+
+G_BEGIN_DECLS
+
+#define YGG_TYPE_MESSAGE (ygg_message_get_type ())
+
+/**
+ * YggMessage:
+ *
+ * A message received from the dispatcher. #YggMessage is reference counted
+ * and may be shared between threads; its fields are read with the
+ * ygg_message_get_*() functions. The #YggMetadata returned by
+ * ygg_message_get_metadata() must not be modified.
+ */
+typedef struct _YggMessage YggMessage;
+
+GType ygg_message_get_type (void) G_GNUC_CONST;
+
+YggMessage *ygg_message_ref (YggMessage *message);
+
+void ygg_message_unref (YggMessage *message);
+
+const gchar *ygg_message_get_addr (YggMessage *message);
+
+const gchar *ygg_message_get_id (YggMessage *message);
+
+const gchar *ygg_message_get_response_to (YggMessage *message);
+
+YggMetadata *ygg_message_get_metadata (YggMessage *message);
+
+GBytes *ygg_message_get_data (YggMessage *message);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (YggMessage, ygg_message_unref)
+
+G_END_DECLS
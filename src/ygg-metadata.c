@@ -19,10 +19,41 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include <string.h>
+
 #include "ygg-metadata.h"
+#include "ygg-metadata-private.h"
 
 G_DEFINE_QUARK (ygg-metadata-error-quark, ygg_metadata_error)
 
+/*
+ * Metadata tables are typically small (a handful of short keys per message),
+ * so entries are kept in a flat array sorted by key and looked up by binary
+ * search. Only once a table grows beyond INDEX_THRESHOLD entries is a hash
+ * index built on top of the array.
+ *
+ * A table created from a serialized "a{ss}" GVariant is a read-only view: it
+ * keeps a reference on the variant and its entries point into the variant's
+ * data. The strings are copied only when the table is first modified.
+ *
+ * The serialized form of a table is cached along with the version of the table
+ * it was built from; every modification bumps the version. Serializing a table
+ * that is not being modified is safe from several threads at once, so the cache
+ * is guarded by its own lock.
+ */
+#define INDEX_THRESHOLD 16
+
+/**
+ * Entry:
+ * @key: The key; the start of a single allocation holding both strings.
+ * @value: The value; points into the same allocation as @key.
+ */
+typedef struct
+{
+  gchar *key;
+  gchar *value;
+} Entry;
+
 struct _YggMetadata
 {
   GObject parent_instance;
@@ -30,11 +61,158 @@ struct _YggMetadata
 
 typedef struct
 {
-  GHashTable *metadata;
+  GArray     *entries;
+  GHashTable *index;
+  GVariant   *source;
+  guint       version;
+  GVariant   *cache;
+  guint       cache_version;
+  GMutex      cache_lock;
 } YggMetadataPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (YggMetadata, ygg_metadata, G_TYPE_OBJECT)
 
+static void
+entry_clear (gpointer data)
+{
+  Entry *entry = (Entry *) data;
+  g_free (entry->key);
+}
+
+static Entry
+entry_new (const gchar *key,
+           const gchar *value)
+{
+  gsize key_len = strlen (key) + 1;
+  gsize value_len = strlen (value) + 1;
+  Entry entry;
+
+  entry.key = g_malloc (key_len + value_len);
+  entry.value = entry.key + key_len;
+  memcpy (entry.key, key, key_len);
+  memcpy (entry.value, value, value_len);
+
+  return entry;
+}
+
+static GArray *
+entries_new (guint reserved_size)
+{
+  GArray *entries = g_array_sized_new (FALSE, FALSE, sizeof (Entry), reserved_size);
+  g_array_set_clear_func (entries, entry_clear);
+  return entries;
+}
+
+/**
+ * metadata_find:
+ * @priv: A #YggMetadataPrivate.
+ * @key: The key to look up.
+ * @position: (out): Return location for the position of @key in the entries
+ * array, or of where it would be inserted.
+ *
+ * Returns: %TRUE if @key was found.
+ */
+static gboolean
+metadata_find (YggMetadataPrivate *priv,
+               const gchar        *key,
+               guint              *position)
+{
+  guint low = 0;
+  guint high = priv->entries->len;
+
+  while (low < high) {
+    guint mid = low + (high - low) / 2;
+    gint cmp = strcmp (key, g_array_index (priv->entries, Entry, mid).key);
+    if (cmp == 0) {
+      *position = mid;
+      return TRUE;
+    }
+    if (cmp < 0) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+
+  *position = low;
+  return FALSE;
+}
+
+static void
+metadata_build_index (YggMetadataPrivate *priv)
+{
+  priv->index = g_hash_table_new (g_str_hash, g_str_equal);
+  for (guint i = 0; i < priv->entries->len; i++) {
+    Entry *entry = &g_array_index (priv->entries, Entry, i);
+    g_hash_table_insert (priv->index, entry->key, entry->value);
+  }
+}
+
+/**
+ * metadata_insert:
+ * @priv: A #YggMetadataPrivate.
+ * @entry: (transfer full): The entry to insert, replacing any entry with the
+ * same key.
+ *
+ * Returns: %TRUE if the key did not exist.
+ */
+static gboolean
+metadata_insert (YggMetadataPrivate *priv,
+                 Entry               entry)
+{
+  guint position = 0;
+  gboolean found = metadata_find (priv, entry.key, &position);
+
+  if (found) {
+    Entry *old = &g_array_index (priv->entries, Entry, position);
+    if (priv->source == NULL) {
+      entry_clear (old);
+    }
+    *old = entry;
+  } else {
+    g_array_insert_val (priv->entries, position, entry);
+  }
+
+  if (priv->index != NULL) {
+    g_hash_table_replace (priv->index, entry.key, entry.value);
+  } else if (priv->entries->len > INDEX_THRESHOLD) {
+    metadata_build_index (priv);
+  }
+
+  return !found;
+}
+
+/**
+ * metadata_make_writable:
+ * @priv: A #YggMetadataPrivate.
+ *
+ * Copies the entries of a read-only view out of its source variant and drops
+ * the reference on the variant.
+ */
+static void
+metadata_make_writable (YggMetadataPrivate *priv)
+{
+  GArray *entries = entries_new (priv->entries->len);
+
+  for (guint i = 0; i < priv->entries->len; i++) {
+    Entry *borrowed = &g_array_index (priv->entries, Entry, i);
+    Entry entry = entry_new (borrowed->key, borrowed->value);
+    g_array_append_val (entries, entry);
+  }
+
+  g_array_unref (priv->entries);
+  priv->entries = entries;
+  g_clear_pointer (&priv->source, g_variant_unref);
+  g_mutex_lock (&priv->cache_lock);
+  g_clear_pointer (&priv->cache, g_variant_unref);
+  g_mutex_unlock (&priv->cache_lock);
+
+  if (priv->index != NULL) {
+    g_hash_table_unref (priv->index);
+    metadata_build_index (priv);
+  }
+}
+
 /**
  * ygg_metadata_new: (constructor)
  *
@@ -56,6 +234,10 @@ ygg_metadata_new (void)
  *
  * Creates a new #YggMetadata instance by reading values from @variant.
  *
+ * If @variant is not floating and is in normal form, the new instance refers to
+ * its data rather than copying it, and holds a reference on @variant until the
+ * instance is first modified with ygg_metadata_set().
+ *
  * Returns: (transfer full): A new #YggMetadata instance.
  */
 YggMetadata *
@@ -63,23 +245,39 @@ ygg_metadata_new_from_variant (GVariant  *variant,
                                GError   **error)
 {
   if (!g_variant_check_format_string (variant, "a{ss}", FALSE)) {
-    if (error != NULL) {
-      *error = g_error_new (YGG_METADATA_ERROR,
-                            YGG_METADATA_ERROR_INVALID_FORMAT_STRING,
-                            "%s is not a valid format string",
-                            g_variant_print (variant, TRUE));
-      return NULL;
-    }
+    g_autofree gchar *printed = g_variant_print (variant, TRUE);
+    g_set_error (error,
+                 YGG_METADATA_ERROR,
+                 YGG_METADATA_ERROR_INVALID_FORMAT_STRING,
+                 "%s is not a valid format string",
+                 printed);
+    return NULL;
   }
 
   YggMetadata *obj = ygg_metadata_new ();
+  YggMetadataPrivate *priv = ygg_metadata_get_instance_private (obj);
+  /* A floating variant belongs to whoever sinks it, so it cannot be borrowed. */
+  gboolean borrow = !g_variant_is_floating (variant) && g_variant_is_normal_form (variant);
+
+  g_array_unref (priv->entries);
+  if (borrow) {
+    priv->entries = g_array_sized_new (FALSE, FALSE, sizeof (Entry), g_variant_n_children (variant));
+    priv->source = g_variant_ref (variant);
+  } else {
+    priv->entries = entries_new (g_variant_n_children (variant));
+  }
 
   GVariantIter iter;
   gchar *key;
   gchar *value;
   g_variant_iter_init (&iter, variant);
   while (g_variant_iter_next (&iter, "{&s&s}", &key, &value)) {
-    ygg_metadata_set (obj, key, value);
+    if (borrow) {
+      Entry entry = { key, value };
+      metadata_insert (priv, entry);
+    } else {
+      metadata_insert (priv, entry_new (key, value));
+    }
   }
 
   return obj;
@@ -100,9 +298,13 @@ ygg_metadata_get (YggMetadata *self,
 {
   YggMetadataPrivate *priv = ygg_metadata_get_instance_private (self);
 
-  gpointer value = g_hash_table_lookup (priv->metadata, key);
-  if (value != NULL) {
-    return (const gchar *) value;
+  if (priv->index != NULL) {
+    return (const gchar *) g_hash_table_lookup (priv->index, key);
+  }
+
+  guint position = 0;
+  if (metadata_find (priv, key, &position)) {
+    return g_array_index (priv->entries, Entry, position).value;
   }
   return NULL;
 }
@@ -124,7 +326,12 @@ ygg_metadata_set (YggMetadata *self,
 {
   YggMetadataPrivate *priv = ygg_metadata_get_instance_private (self);
 
-  return g_hash_table_insert (priv->metadata, (gpointer) g_strdup (key), (gpointer) g_strdup (value));
+  if (priv->source != NULL) {
+    metadata_make_writable (priv);
+  }
+  priv->version++;
+
+  return metadata_insert (priv, entry_new (key, value));
 }
 
 /**
@@ -134,7 +341,8 @@ ygg_metadata_set (YggMetadata *self,
  * key/value pair.
  * @user_data: User data to pass to the function.
  *
- * Calls the given function for each of the key/value pairs in the #YggMetadata.
+ * Calls the given function for each of the key/value pairs in the #YggMetadata,
+ * in ascending order of keys.
  */
 void
 ygg_metadata_foreach (YggMetadata            *self,
@@ -143,12 +351,9 @@ ygg_metadata_foreach (YggMetadata            *self,
 {
   YggMetadataPrivate *priv = ygg_metadata_get_instance_private (self);
 
-  GHashTableIter iter;
-  g_hash_table_iter_init (&iter, priv->metadata);
-  gpointer key = NULL;
-  gpointer value = NULL;
-  while (g_hash_table_iter_next (&iter, &key, &value)) {
-    func ((const gchar *) key, (const gchar *) value, user_data);
+  for (guint i = 0; i < priv->entries->len; i++) {
+    Entry *entry = &g_array_index (priv->entries, Entry, i);
+    func (entry->key, entry->value, user_data);
   }
 }
 
@@ -161,13 +366,51 @@ builder_foreach (const gchar *key,
   g_variant_builder_add (builder, "{ss}", key, value);
 }
 
+/**
+ * ygg_metadata_ref_variant:
+ * @metadata: A #YggMetadata.
+ *
+ * Serializes the metadata table into a #GVariant of type "a{ss}". The result is
+ * cached, so calling this again without modifying @metadata in between returns
+ * the same #GVariant without serializing the table again. Unmodified read-only
+ * metadata returns the variant it was created from.
+ *
+ * Returns: (transfer full): A new, non-floating reference to the serialized
+ * table. Free it with g_variant_unref().
+ */
+GVariant *
+ygg_metadata_ref_variant (YggMetadata *self)
+{
+  YggMetadataPrivate *priv = ygg_metadata_get_instance_private (self);
+
+  if (priv->source != NULL) {
+    return g_variant_ref (priv->source);
+  }
+
+  g_mutex_lock (&priv->cache_lock);
+  if (priv->cache == NULL || priv->cache_version != priv->version) {
+    GVariantBuilder builder;
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
+    ygg_metadata_foreach (self, builder_foreach, &builder);
+    g_clear_pointer (&priv->cache, g_variant_unref);
+    priv->cache = g_variant_ref_sink (g_variant_builder_end (&builder));
+    priv->cache_version = priv->version;
+  }
+  GVariant *value = g_variant_ref (priv->cache);
+  g_mutex_unlock (&priv->cache_lock);
+
+  return value;
+}
+
 GVariant *
 ygg_metadata_to_variant (YggMetadata *self)
 {
-  GVariantBuilder builder;
-  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
-  ygg_metadata_foreach (self, builder_foreach, &builder);
-  return g_variant_builder_end (&builder);
+  /* Wrap the cached serialization in a new floating variant, so that callers
+   * can pass the result on to a GVariant constructor without copying it. */
+  g_autoptr (GVariant) value = ygg_metadata_ref_variant (self);
+  g_autoptr (GBytes) data = g_variant_get_data_as_bytes (value);
+
+  return g_variant_new_from_bytes (G_VARIANT_TYPE ("a{ss}"), data, TRUE);
 }
 
 static void
@@ -176,7 +419,11 @@ ygg_metadata_finalize (GObject *object)
   YggMetadata *self = (YggMetadata *) object;
   YggMetadataPrivate *priv = ygg_metadata_get_instance_private (self);
 
-  g_hash_table_unref (priv->metadata);
+  g_array_unref (priv->entries);
+  g_clear_pointer (&priv->index, g_hash_table_unref);
+  g_clear_pointer (&priv->source, g_variant_unref);
+  g_clear_pointer (&priv->cache, g_variant_unref);
+  g_mutex_clear (&priv->cache_lock);
 
   G_OBJECT_CLASS (ygg_metadata_parent_class)->finalize (object);
 }
@@ -193,5 +440,6 @@ static void
 ygg_metadata_init (YggMetadata *self)
 {
   YggMetadataPrivate *priv = ygg_metadata_get_instance_private (self);
-  priv->metadata = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  priv->entries = entries_new (0);
+  g_mutex_init (&priv->cache_lock);
 }
@@ -0,0 +1,90 @@
+/*
+ * ygg-metrics-private.h
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * YGG_METRICS_N_BUCKETS:
+ *
+ * The number of buckets in each latency histogram. The upper bounds of the
+ * buckets are fixed; the last bucket has no upper bound.
+ */
+#define YGG_METRICS_N_BUCKETS 16
+
+typedef enum
+{
+  YGG_METRICS_DISPATCH_RECEIVED,
+  YGG_METRICS_DISPATCH_REJECTED,
+  YGG_METRICS_DISPATCH_ERRORS,
+  YGG_METRICS_DISPATCH_DUPLICATES,
+  YGG_METRICS_MESSAGES_HANDLED,
+  YGG_METRICS_BYTES_RECEIVED,
+  YGG_METRICS_TRANSMITS,
+  YGG_METRICS_TRANSMIT_ERRORS,
+  YGG_METRICS_BYTES_TRANSMITTED,
+  YGG_METRICS_N_COUNTERS
+} YggMetricsCounter;
+
+typedef enum
+{
+  YGG_METRICS_DISPATCH_LATENCY,
+  YGG_METRICS_HANDLER_DURATION,
+  YGG_METRICS_TRANSMIT_ROUND_TRIP,
+  YGG_METRICS_N_HISTOGRAMS
+} YggMetricsHistogram;
+
+typedef struct
+{
+  gsize count;
+  gsize sum;
+  gsize buckets[YGG_METRICS_N_BUCKETS];
+} YggMetricsHistogramData;
+
+/**
+ * YggMetrics:
+ *
+ * Counters and latency histograms of a worker. All fields are updated with
+ * atomic operations, so no lock is needed to record or read them. A
+ * zero-filled #YggMetrics is ready to use.
+ */
+typedef struct
+{
+  gsize                   counters[YGG_METRICS_N_COUNTERS];
+  YggMetricsHistogramData histograms[YGG_METRICS_N_HISTOGRAMS];
+} YggMetrics;
+
+void ygg_metrics_add (YggMetrics        *metrics,
+                      YggMetricsCounter  counter,
+                      gsize              value);
+
+void ygg_metrics_observe (YggMetrics          *metrics,
+                          YggMetricsHistogram  histogram,
+                          gint64               value_us);
+
+void ygg_metrics_snapshot (YggMetrics      *metrics,
+                           GVariantBuilder *builder);
+
+G_END_DECLS
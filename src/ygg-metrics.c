@@ -0,0 +1,141 @@
+/*
+ * ygg-metrics.c
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "ygg-metrics-private.h"
+
+static const gchar *counter_names[YGG_METRICS_N_COUNTERS] = {
+  "dispatch-received",
+  "dispatch-rejected",
+  "dispatch-errors",
+  "dispatch-duplicates",
+  "messages-handled",
+  "bytes-received",
+  "transmits",
+  "transmit-errors",
+  "bytes-transmitted",
+};
+
+static const gchar *histogram_names[YGG_METRICS_N_HISTOGRAMS] = {
+  "dispatch-latency-us",
+  "handler-duration-us",
+  "transmit-round-trip-us",
+};
+
+/* Upper bounds of the histogram buckets in microseconds. The last bucket
+ * collects everything above the last bound. */
+static const gint64 bucket_bounds[YGG_METRICS_N_BUCKETS - 1] = {
+  50, 100, 250, 500,
+  1000, 2500, 5000, 10000,
+  25000, 50000, 100000, 250000,
+  500000, 1000000, 5000000,
+};
+
+/**
+ * ygg_metrics_add:
+ * @metrics: A #YggMetrics.
+ * @counter: The counter to increase.
+ * @value: The amount to add to @counter.
+ *
+ * Atomically adds @value to @counter.
+ */
+void
+ygg_metrics_add (YggMetrics        *metrics,
+                 YggMetricsCounter  counter,
+                 gsize              value)
+{
+  g_return_if_fail (counter < YGG_METRICS_N_COUNTERS);
+
+  g_atomic_pointer_add (&metrics->counters[counter], value);
+}
+
+/**
+ * ygg_metrics_observe:
+ * @metrics: A #YggMetrics.
+ * @histogram: The histogram to record a value in.
+ * @value_us: A duration in microseconds.
+ *
+ * Atomically records @value_us in the matching bucket of @histogram.
+ */
+void
+ygg_metrics_observe (YggMetrics          *metrics,
+                     YggMetricsHistogram  histogram,
+                     gint64               value_us)
+{
+  g_return_if_fail (histogram < YGG_METRICS_N_HISTOGRAMS);
+
+  YggMetricsHistogramData *data = &metrics->histograms[histogram];
+  guint bucket = 0;
+
+  if (value_us < 0) {
+    value_us = 0;
+  }
+  while (bucket < G_N_ELEMENTS (bucket_bounds) && value_us > bucket_bounds[bucket]) {
+    bucket++;
+  }
+
+  g_atomic_pointer_add (&data->buckets[bucket], 1);
+  g_atomic_pointer_add (&data->sum, (gsize) value_us);
+  g_atomic_pointer_add (&data->count, 1);
+}
+
+/**
+ * ygg_metrics_snapshot:
+ * @metrics: A #YggMetrics.
+ * @builder: A #GVariantBuilder of type "a{sv}".
+ *
+ * Adds the current value of every counter to @builder as a "t", and every
+ * histogram as a "(tta(tt))" holding the number of recorded values, their sum
+ * and the upper bound and count of each bucket. The last bucket's upper bound
+ * is %G_MAXUINT64.
+ *
+ * Values are read one at a time, so a snapshot taken while values are being
+ * recorded may be slightly inconsistent across fields.
+ */
+void
+ygg_metrics_snapshot (YggMetrics      *metrics,
+                      GVariantBuilder *builder)
+{
+  for (guint i = 0; i < YGG_METRICS_N_COUNTERS; i++) {
+    guint64 value = GPOINTER_TO_SIZE (g_atomic_pointer_get (&metrics->counters[i]));
+    g_variant_builder_add (builder, "{sv}", counter_names[i], g_variant_new_uint64 (value));
+  }
+
+  for (guint i = 0; i < YGG_METRICS_N_HISTOGRAMS; i++) {
+    YggMetricsHistogramData *data = &metrics->histograms[i];
+    GVariantBuilder buckets;
+
+    g_variant_builder_init (&buckets, G_VARIANT_TYPE ("a(tt)"));
+    for (guint j = 0; j < YGG_METRICS_N_BUCKETS; j++) {
+      guint64 bound = j < G_N_ELEMENTS (bucket_bounds) ? (guint64) bucket_bounds[j] : G_MAXUINT64;
+      guint64 count = GPOINTER_TO_SIZE (g_atomic_pointer_get (&data->buckets[j]));
+      g_variant_builder_add (&buckets, "(tt)", bound, count);
+    }
+
+    g_variant_builder_add (builder,
+                           "{sv}",
+                           histogram_names[i],
+                           g_variant_new ("(tta(tt))",
+                                          (guint64) GPOINTER_TO_SIZE (g_atomic_pointer_get (&data->count)),
+                                          (guint64) GPOINTER_TO_SIZE (g_atomic_pointer_get (&data->sum)),
+                                          &buckets));
+  }
+}
@@ -0,0 +1,64 @@
+/*
+ * ygg-spool-private.h
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * YggSpool:
+ *
+ * A first-in, first-out queue of serialized #GVariant values, each with an
+ * associated pointer. Values are held in memory up to a limit; beyond it, they
+ * are appended to an unlinked segment file and read back when their turn
+ * comes. A #YggSpool is not thread-safe.
+ */
+typedef struct _YggSpool YggSpool;
+
+YggSpool *ygg_spool_new (const gchar         *directory,
+                         gsize                memory_limit,
+                         const GVariantType  *type,
+                         GDestroyNotify       user_data_free);
+
+void ygg_spool_free (YggSpool *spool);
+
+gboolean ygg_spool_push (YggSpool  *spool,
+                         GVariant  *value,
+                         gpointer   user_data,
+                         GError   **error);
+
+void ygg_spool_insert_sorted (YggSpool     *spool,
+                              GVariant     *value,
+                              gpointer      user_data,
+                              GCompareFunc  compare);
+
+gboolean ygg_spool_pop (YggSpool  *spool,
+                        GVariant **value,
+                        gpointer  *user_data,
+                        GError   **error);
+
+guint ygg_spool_get_length (YggSpool *spool);
+
+guint ygg_spool_get_length_on_disk (YggSpool *spool);
+
+G_END_DECLS
@@ -0,0 +1,392 @@
+/*
+ * ygg-spool.c
+ *
+ * Copyright 2023 Link Dupont <link@sub-pop.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "ygg-spool-private.h"
+
+/*
+ * Every value in the spool has an entry in a queue, in order. An entry whose
+ * value did not fit within the memory limit has a NULL value; its serialized
+ * form is in the segment file instead, as a 32-bit little-endian size followed
+ * by the data. Values on disk are appended and read back in queue order, so
+ * the file is only ever written at its end and read from the front. Once
+ * every value on disk has been read, the file is closed, which frees it.
+ */
+
+typedef struct {
+  GVariant *value;
+  gpointer  user_data;
+} SpoolEntry;
+
+struct _YggSpool {
+  gchar          *directory;
+  gsize           memory_limit;
+  gsize           memory_used;
+  GVariantType   *type;
+  GDestroyNotify  user_data_free;
+  GQueue          entries;
+  gint            fd;
+  guint64         write_offset;
+  guint64         read_offset;
+  guint           n_on_disk;
+  gboolean        broken;
+};
+
+/**
+ * ygg_spool_new:
+ * @directory: (nullable): The directory to create the segment file in, or
+ * %NULL for the system temporary directory.
+ * @memory_limit: The number of bytes of serialized values to hold in memory.
+ * @type: The type of the values in the spool.
+ * @user_data_free: (nullable): Called on the pointers of values that are
+ * still in the spool when it is freed.
+ *
+ * Creates a new, empty #YggSpool.
+ *
+ * Returns: (transfer full): A new #YggSpool.
+ */
+YggSpool *
+ygg_spool_new (const gchar        *directory,
+               gsize               memory_limit,
+               const GVariantType *type,
+               GDestroyNotify      user_data_free)
+{
+  YggSpool *spool = g_new0 (YggSpool, 1);
+
+  spool->directory = g_strdup (directory != NULL ? directory : g_get_tmp_dir ());
+  spool->memory_limit = memory_limit;
+  spool->type = g_variant_type_copy (type);
+  spool->user_data_free = user_data_free;
+  g_queue_init (&spool->entries);
+  spool->fd = -1;
+
+  return spool;
+}
+
+static void
+spool_close_segment (YggSpool *spool)
+{
+  if (spool->fd >= 0) {
+    g_close (spool->fd, NULL);
+    spool->fd = -1;
+  }
+  spool->write_offset = 0;
+  spool->read_offset = 0;
+  spool->broken = FALSE;
+}
+
+/**
+ * ygg_spool_free:
+ * @spool: (transfer full): A #YggSpool.
+ *
+ * Frees @spool and the values still in it.
+ */
+void
+ygg_spool_free (YggSpool *spool)
+{
+  SpoolEntry *entry = NULL;
+
+  while ((entry = g_queue_pop_head (&spool->entries)) != NULL) {
+    g_clear_pointer (&entry->value, g_variant_unref);
+    if (spool->user_data_free != NULL) {
+      spool->user_data_free (entry->user_data);
+    }
+    g_free (entry);
+  }
+
+  spool_close_segment (spool);
+  g_variant_type_free (spool->type);
+  g_free (spool->directory);
+  g_free (spool);
+}
+
+static gboolean
+spool_open_segment (YggSpool  *spool,
+                    GError   **error)
+{
+  if (spool->fd >= 0) {
+    return TRUE;
+  }
+
+  g_autofree gchar *path = g_build_filename (spool->directory, "ygg-spool-XXXXXX", NULL);
+  spool->fd = g_mkstemp_full (path, O_RDWR, 0600);
+  if (spool->fd < 0) {
+    int saved_errno = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                 "unable to create spool segment in %s: %s", spool->directory, g_strerror (saved_errno));
+    return FALSE;
+  }
+
+  /* Nothing outlives the process, so the file is freed as soon as it closes */
+  g_unlink (path);
+
+  return TRUE;
+}
+
+static gboolean
+spool_write (YggSpool       *spool,
+             gconstpointer   data,
+             gsize           size,
+             GError        **error)
+{
+  const guint8 *bytes = data;
+
+  while (size > 0) {
+    gssize n_written = pwrite (spool->fd, bytes, size, spool->write_offset);
+    if (n_written < 0) {
+      int saved_errno = errno;
+      if (saved_errno == EINTR) {
+        continue;
+      }
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                   "unable to write spool segment: %s", g_strerror (saved_errno));
+      return FALSE;
+    }
+    bytes += n_written;
+    size -= n_written;
+    spool->write_offset += n_written;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+spool_read (YggSpool  *spool,
+            gpointer   data,
+            gsize      size,
+            GError   **error)
+{
+  guint8 *bytes = data;
+
+  while (size > 0) {
+    gssize n_read = pread (spool->fd, bytes, size, spool->read_offset);
+    if (n_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n_read <= 0) {
+      int saved_errno = n_read < 0 ? errno : EIO;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                   "unable to read spool segment: %s", g_strerror (saved_errno));
+      return FALSE;
+    }
+    bytes += n_read;
+    size -= n_read;
+    spool->read_offset += n_read;
+  }
+
+  return TRUE;
+}
+
+/**
+ * ygg_spool_push:
+ * @spool: A #YggSpool.
+ * @value: (transfer floating): A #GVariant of the spool's type.
+ * @user_data: A pointer to keep with @value.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Appends @value to @spool. @value is kept in memory if it fits within the
+ * memory limit and no earlier value is on disk; otherwise it is written to the
+ * segment file.
+ *
+ * Returns: %TRUE if @value was added, or %FALSE if it could not be written.
+ */
+gboolean
+ygg_spool_push (YggSpool  *spool,
+                GVariant  *value,
+                gpointer   user_data,
+                GError   **error)
+{
+  g_autoptr (GVariant) owned = g_variant_ref_sink (value);
+  g_return_val_if_fail (g_variant_is_of_type (owned, spool->type), FALSE);
+
+  gsize size = g_variant_get_size (owned);
+  SpoolEntry *entry = g_new0 (SpoolEntry, 1);
+  entry->user_data = user_data;
+
+  if (spool->n_on_disk == 0 && spool->memory_used + size <= spool->memory_limit) {
+    entry->value = g_steal_pointer (&owned);
+    spool->memory_used += size;
+  } else {
+    if (size > G_MAXUINT32) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+                   "value of %" G_GSIZE_FORMAT " bytes is too large to spool", size);
+      g_free (entry);
+      return FALSE;
+    }
+
+    guint64 offset = spool->write_offset;
+    guint32 header = GUINT32_TO_LE ((guint32) size);
+    if (!spool_open_segment (spool, error) ||
+        !spool_write (spool, &header, sizeof (header), error) ||
+        !spool_write (spool, g_variant_get_data (owned), size, error)) {
+      /* Drop whatever part of the record made it to disk */
+      spool->write_offset = offset;
+      g_free (entry);
+      return FALSE;
+    }
+    spool->n_on_disk++;
+  }
+
+  g_queue_push_tail (&spool->entries, entry);
+
+  return TRUE;
+}
+
+/**
+ * ygg_spool_insert_sorted:
+ * @spool: A #YggSpool.
+ * @value: (transfer floating): A #GVariant of the spool's type.
+ * @user_data: A pointer to keep with @value.
+ * @compare: A #GCompareFunc ordering the pointers kept with values.
+ *
+ * Inserts @value before the first value in @spool whose pointer @compare
+ * orders after @user_data, or at the end if there is none. This puts a value
+ * that was taken out of @spool back in its place. @value is always kept in
+ * memory, since the segment file can only be appended to, even if that goes
+ * beyond the memory limit.
+ */
+void
+ygg_spool_insert_sorted (YggSpool     *spool,
+                         GVariant     *value,
+                         gpointer      user_data,
+                         GCompareFunc  compare)
+{
+  g_autoptr (GVariant) owned = g_variant_ref_sink (value);
+  g_return_if_fail (g_variant_is_of_type (owned, spool->type));
+
+  SpoolEntry *entry = g_new0 (SpoolEntry, 1);
+  spool->memory_used += g_variant_get_size (owned);
+  entry->value = g_steal_pointer (&owned);
+  entry->user_data = user_data;
+
+  GList *link = spool->entries.head;
+  while (link != NULL && compare (((SpoolEntry *) link->data)->user_data, user_data) <= 0) {
+    link = link->next;
+  }
+  if (link != NULL) {
+    g_queue_insert_before (&spool->entries, link, entry);
+  } else {
+    g_queue_push_tail (&spool->entries, entry);
+  }
+}
+
+/**
+ * ygg_spool_pop:
+ * @spool: A #YggSpool.
+ * @value: (out) (transfer full) (optional): Return location for the oldest
+ * value in the spool.
+ * @user_data: (out) (optional): Return location for the pointer kept with it.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Removes the oldest value from @spool. If the value was on disk and cannot be
+ * read back, @value is set to %NULL and @error is set, but the value is still
+ * removed and @user_data is still returned.
+ *
+ * Returns: %TRUE if a value was removed, or %FALSE if @spool is empty.
+ */
+gboolean
+ygg_spool_pop (YggSpool  *spool,
+               GVariant **value,
+               gpointer  *user_data,
+               GError   **error)
+{
+  SpoolEntry *entry = g_queue_pop_head (&spool->entries);
+  if (entry == NULL) {
+    return FALSE;
+  }
+
+  GVariant *popped = g_steal_pointer (&entry->value);
+  if (popped != NULL) {
+    spool->memory_used -= g_variant_get_size (popped);
+  } else {
+    GError *err = NULL;
+    guint32 header = 0;
+
+    /* Once a record cannot be read, the records after it cannot be found */
+    if (spool->broken) {
+      g_set_error (&err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "an earlier spool record was lost");
+    } else if (spool_read (spool, &header, sizeof (header), &err)) {
+      gsize size = GUINT32_FROM_LE (header);
+      if (size > spool->write_offset - spool->read_offset) {
+        g_set_error (&err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "spool record is truncated");
+      } else {
+        gpointer data = g_malloc (size);
+        if (spool_read (spool, data, size, &err)) {
+          g_autoptr (GBytes) bytes = g_bytes_new_take (data, size);
+          popped = g_variant_ref_sink (g_variant_new_from_bytes (spool->type, bytes, FALSE));
+        } else {
+          g_free (data);
+        }
+      }
+    }
+    if (err != NULL) {
+      spool->broken = TRUE;
+      g_propagate_error (error, err);
+    }
+
+    if (--spool->n_on_disk == 0) {
+      spool_close_segment (spool);
+    }
+  }
+
+  if (value != NULL) {
+    *value = popped;
+  } else {
+    g_clear_pointer (&popped, g_variant_unref);
+  }
+  if (user_data != NULL) {
+    *user_data = entry->user_data;
+  }
+  g_free (entry);
+
+  return TRUE;
+}
+
+/**
+ * ygg_spool_get_length:
+ * @spool: A #YggSpool.
+ *
+ * Returns: The number of values in @spool.
+ */
+guint
+ygg_spool_get_length (YggSpool *spool)
+{
+  return g_queue_get_length (&spool->entries);
+}
+
+/**
+ * ygg_spool_get_length_on_disk:
+ * @spool: A #YggSpool.
+ *
+ * Returns: The number of values in @spool that are held in its segment file.
+ */
+guint
+ygg_spool_get_length_on_disk (YggSpool *spool)
+{
+  return spool->n_on_disk;
+}
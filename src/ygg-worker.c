@@ -19,130 +19,79 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include <errno.h>
+
 #include <gio/gio.h>
 
 #include "ygg-worker.h"
-#include "ygg-constants.h"
+#include "ygg-worker-private.h"
+#include "ygg-log-private.h"
+#include "ygg-message-private.h"
+#include "ygg-journal-private.h"
+#include "ygg-metrics-private.h"
+#include "ygg-spool-private.h"
 
-typedef struct {
-  YggWorker   *worker;
-  gchar       *addr;
-  gchar       *id;
-  gchar       *response_to;
-  YggMetadata *metadata;
-  GBytes      *data;
-} Message;
+G_DEFINE_QUARK (ygg-worker-error-quark, ygg_worker_error)
+
+static GDBusNodeInfo *dispatcher_node_info;
+static GDBusNodeInfo *worker_node_info;
+static GDBusNodeInfo *metrics_node_info;
+
+static const gchar metrics_introspection_xml[] =
+  "<node>"
+  "  <interface name='com.redhat.Yggdrasil1.Worker1.Metrics'>"
+  "    <property name='Metrics' type='a{sv}' access='read'/>"
+  "  </interface>"
+  "</node>";
+
+#define INTERFACE_RESOURCE_PATH "/com/redhat/Yggdrasil1/libygg/"
+
+/* The number of recently journaled message IDs a worker remembers */
+#define WORKER_JOURNAL_DEDUP_SIZE 4096
 
 /**
- * message_new:
- * @worker: (transfer none): A #YggWorker.
- * @addr: (transfer none): Address of the message.
- * @id: (transfer none): ID of the message.
- * @response_to: (transfer none) (nullable): ID of a message to respond to.
- * @metadata: (transfer none) (nullable): Key/value pairs to associate with the
- * message.
- * @data: (transfer none): The data of the message.
+ * load_node_info:
+ * @name: The file name of an interface description.
+ * @override_variable: The name of an environment variable.
+ * @error: (out) (optional): Return location for a #GError.
  *
- * Creates a new #Message.
+ * Parses the interface description @name that is compiled into the library.
+ * If @override_variable is set in the environment, the description is read
+ * from the file it names instead, which lets developers try out changes to an
+ * interface without rebuilding the library.
  *
- * Returns: (transfer full): A newly created #Message;
+ * Returns: (transfer full) (nullable): The parsed description.
  */
-static Message *
-message_new (YggWorker   *worker,
-             gchar       *addr,
-             gchar       *id,
-             gchar       *response_to,
-             YggMetadata *metadata,
-             GBytes      *data)
-{
-  Message *message = (Message *) g_new0 (Message, 1);
-
-  message->worker = g_object_ref (worker);
-  message->addr = g_strdup (addr);
-  message->id = g_strdup (id);
-  message->response_to = g_strdup (response_to);
-  message->metadata = g_object_ref (metadata);
-  message->data = g_bytes_ref (data);
-
-  return message;
-}
-
-static Message *
-message_new_from_variant (YggWorker  *worker,
-                          GVariant   *parameters,
-                          GError    **error)
+static GDBusNodeInfo *
+load_node_info (const gchar  *name,
+                const gchar  *override_variable,
+                GError      **error)
 {
-  GError *err = NULL;
-  GVariantIter iter;
-  g_variant_iter_init (&iter, parameters);
+  const gchar *override_path = g_getenv (override_variable);
+  g_autoptr (GBytes) xml_data = NULL;
 
-  g_autofree gchar *addr = NULL;
-  g_variant_iter_next (&iter, "s", &addr);
+  if (override_path != NULL && override_path[0] != '\0') {
+    gchar *contents = NULL;
+    gsize length = 0;
 
-  g_autofree gchar *id = NULL;
-  g_variant_iter_next (&iter, "s", &id);
-
-  g_autofree gchar *response_to = NULL;
-  g_variant_iter_next (&iter, "s", &response_to);
+    g_debug ("loading %s from %s", name, override_path);
+    if (!g_file_get_contents (override_path, &contents, &length, error)) {
+      return NULL;
+    }
+    xml_data = g_bytes_new_take (contents, length);
+  } else {
+    g_autofree gchar *resource_path = g_strconcat (INTERFACE_RESOURCE_PATH, name, NULL);
 
-  g_autoptr (YggMetadata) metadata = ygg_metadata_new_from_variant (g_variant_iter_next_value (&iter), &err);
-  if (err != NULL && error != NULL) {
-    g_critical ("failed to create metadata from variant: %s", err->message);
-    g_propagate_error (error, err);
-    return NULL;
+    xml_data = g_resources_lookup_data (resource_path, G_RESOURCE_LOOKUP_FLAGS_NONE, error);
+    if (xml_data == NULL) {
+      return NULL;
+    }
   }
 
-  GBytes *data = g_variant_get_data_as_bytes (g_variant_iter_next_value (&iter));
-
-  Message *msg = message_new (worker,
-                              addr,
-                              id,
-                              response_to,
-                              metadata,
-                              data);
-  return msg;
-}
-
-static void
-metadata_foreach_builder_add (const gchar *key,
-                              const gchar *val,
-                              gpointer     user_data)
-{
-  GVariantBuilder *builder = (GVariantBuilder *) user_data;
-  g_variant_builder_add (builder, "{ss}", key, val);
-}
-
-static GVariant *
-message_to_variant (Message *msg)
-{
-  GVariantBuilder builder;
-  g_variant_builder_init (&builder, G_VARIANT_TYPE ("(sssa{ss}ay)"));
-  g_variant_builder_add (&builder, "s", msg->addr);
-  g_variant_builder_add (&builder, "s", msg->id);
-  g_variant_builder_add (&builder, "s", msg->response_to);
-  g_variant_builder_open (&builder, G_VARIANT_TYPE( "a{ss}"));
-  ygg_metadata_foreach (msg->metadata, metadata_foreach_builder_add, &builder);
-  g_variant_builder_close (&builder);
-  g_variant_builder_add_value (&builder, g_variant_new_bytestring (g_bytes_get_data (msg->data, NULL)));
-  return g_variant_builder_end (&builder);
-}
-
-static void
-message_free (Message *message)
-{
-  g_free (message->addr);
-  g_free (message->id);
-  g_free (message->response_to);
-  g_object_unref (message->metadata);
-  g_bytes_unref (message->data);
-  g_free (message);
+  /* Both file contents and resource data are nul-terminated. */
+  return g_dbus_node_info_new_for_xml (g_bytes_get_data (xml_data, NULL), error);
 }
 
-G_DEFINE_QUARK (ygg-worker-error-quark, ygg_worker_error)
-
-static GDBusNodeInfo *dispatcher_node_info;
-static GDBusNodeInfo *worker_node_info;
-
 struct _YggWorker
 {
   GObject parent_instance;
@@ -150,18 +99,71 @@ struct _YggWorker
 
 typedef struct
 {
-  gchar         *directive;
-  gboolean       remote_content;
-  YggMetadata   *features;
-  YggRxFunc      rx_func;
-  gpointer       rx_func_user_data;
-  GDestroyNotify rx_func_data_notify;
-  YggEventFunc   event_func;
-  gpointer       event_func_user_data;
-  GDestroyNotify event_func_data_notify;
-  guint          bus_id;
-  gchar         *bus_name;
-  gchar         *object_path;
+  gchar           *directive;
+  gboolean         remote_content;
+  YggMetadata     *features;
+  YggRxFunc        rx_func;
+  gpointer         rx_func_user_data;
+  GDestroyNotify   rx_func_data_notify;
+  YggMessageRxFunc message_rx_func;
+  gpointer         message_rx_func_user_data;
+  GDestroyNotify   message_rx_func_data_notify;
+  YggStreamRxFunc  stream_rx_func;
+  gpointer         stream_rx_func_user_data;
+  GDestroyNotify   stream_rx_func_data_notify;
+  GHashTable      *assemblies;
+  guint            assemblies_expire_id;
+  YggEventFunc     event_func;
+  gpointer         event_func_user_data;
+  GDestroyNotify   event_func_data_notify;
+  guint            bus_id;
+  GTask           *connect_task;
+  GSource         *connect_cancelled_source;
+  gint64           connect_started;
+  gint64           time_to_ready;
+  gchar           *bus_name;
+  gchar           *object_path;
+  GDBusConnection *connection;
+  guint            registration_id;
+  guint            signal_subscription_id;
+  GDBusProxy      *dispatcher_proxy;
+  GCancellable    *dispatcher_proxy_cancellable;
+  guint            dispatcher_watch_id;
+  GQueue           pending_calls;
+  GQueue           pending_signals;
+  guint            max_concurrency;
+  GThreadPool     *rx_pool;
+  guint            max_in_flight;
+  gint             queue_depth;
+  gchar           *priority_key;
+  guint            sequence;
+  gint             transmit_sequence;
+  GMutex           lock;
+  guint            working_event_interval;
+  gint             coalesced_events;
+  GHashTable      *working_events;
+  GMutex           events_lock;
+  YggMessagePool  *message_pool;
+  guint            message_pool_size;
+  gboolean         spool_enabled;
+  guint            spool_memory_limit;
+  gchar           *spool_directory;
+  YggSpool        *spool;
+  guint            spool_in_flight;
+  gint             spooled;
+  gboolean         dispatcher_offline;
+  gchar           *journal_directory;
+  gboolean         journal_sync;
+  YggJournal      *journal;
+  GHashTable      *requests;
+  GMutex           requests_lock;
+  YggMetrics       metrics;
+  guint            metrics_registration_id;
+  YggTraceFunc     trace_func;
+  gpointer         trace_func_user_data;
+  GDestroyNotify   trace_func_data_notify;
+  GMainContext    *context;
+  GThread         *owner;
 } YggWorkerPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (YggWorker, ygg_worker, G_TYPE_OBJECT)
@@ -170,14 +172,51 @@ enum {
   PROP_DIRECTIVE = 1,
   PROP_REMOTE_CONTENT,
   PROP_FEATURES,
+  PROP_MAX_CONCURRENCY,
+  PROP_MAX_IN_FLIGHT,
+  PROP_QUEUE_DEPTH,
+  PROP_PRIORITY_KEY,
+  PROP_WORKING_EVENT_INTERVAL,
+  PROP_COALESCED_EVENTS,
+  PROP_MESSAGE_POOL_SIZE,
+  PROP_SPOOL,
+  PROP_SPOOL_MEMORY_LIMIT,
+  PROP_SPOOL_DIRECTORY,
+  PROP_JOURNAL_DIRECTORY,
+  PROP_JOURNAL_SYNC,
   N_PROPS
 };
 
 static GParamSpec *properties [N_PROPS];
 
+/**
+ * worker_trace:
+ * @worker: A #YggWorker.
+ * @point: The #YggTracePoint a message has reached.
+ * @id: The ID of the message.
+ * @response_to: (nullable): The ID of the message it is in response to.
+ *
+ * Invokes the worker's #YggTraceFunc, if one is set. When tracing is disabled
+ * this costs a single comparison.
+ */
+static inline void
+worker_trace (YggWorker     *self,
+              YggTracePoint  point,
+              const gchar   *id,
+              const gchar   *response_to)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  if (G_LIKELY (priv->trace_func == NULL)) {
+    return;
+  }
+
+  priv->trace_func (self, point, id, response_to, g_get_monotonic_time (), priv->trace_func_user_data);
+}
+
 /**
  * invoke_rx:
- * @user_data: (transfer full): The received #Message.
+ * @user_data: (transfer full): The received #YggMessage.
  *
  * A #GSourceFunc that handles com.redhat.Yggdrasil1.Worker1.Dispatch
  * asynchronously.
@@ -189,444 +228,2986 @@ static gboolean
 invoke_rx (gpointer user_data)
 {
   g_debug ("invoke_rx");
-  Message *msg = (Message *) user_data;
+  YggMessage *msg = (YggMessage *) user_data;
   YggWorker *self = YGG_WORKER (msg->worker);
   YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
   GError *err = NULL;
 
   g_assert_null (err);
-  if (!ygg_worker_emit_event (self, YGG_WORKER_EVENT_BEGIN, msg->id, "", &err)) {
-    if (err != NULL) {
-      g_critical ("%s", err->message);
-      goto out;
-    }
+  if (ygg_worker_emit_event (self, YGG_WORKER_EVENT_BEGIN, msg->id, "", &err)) {
+    worker_trace (self, YGG_TRACE_POINT_BEGIN_SENT, msg->id, msg->response_to);
+  } else if (err != NULL) {
+    /* The message is handled, and its journal entry completed, regardless */
+    g_critical ("%s", err->message);
+    g_clear_error (&err);
+  }
+
+  gint64 started = g_get_monotonic_time ();
+  ygg_metrics_observe (&priv->metrics, YGG_METRICS_DISPATCH_LATENCY, started - msg->timestamp);
+  worker_trace (self, YGG_TRACE_POINT_HANDLER_STARTED, msg->id, msg->response_to);
+
+  if (msg->stream != NULL) {
+    g_assert_nonnull (priv->stream_rx_func);
+    priv->stream_rx_func (self,
+                          g_strdup (msg->addr),
+                          g_strdup (msg->id),
+                          g_strdup (msg->response_to),
+                          g_object_ref (msg->metadata),
+                          g_object_ref (msg->stream),
+                          priv->stream_rx_func_user_data);
+  } else if (priv->message_rx_func != NULL) {
+    priv->message_rx_func (self, msg, priv->message_rx_func_user_data);
+  } else {
+    g_assert_nonnull (priv->rx_func);
+    priv->rx_func (self,
+                   g_strdup (msg->addr),
+                   g_strdup (msg->id),
+                   g_strdup (msg->response_to),
+                   g_object_ref (msg->metadata),
+                   g_bytes_ref (msg->data),
+                   priv->rx_func_user_data);
   }
 
-  g_assert_nonnull (priv->rx_func);
-  priv->rx_func (self,
-                 g_strdup (msg->addr),
-                 g_strdup (msg->id),
-                 g_strdup (msg->response_to),
-                 g_object_ref (msg->metadata),
-                 g_bytes_ref (msg->data),
-                 priv->rx_func_user_data);
+  ygg_metrics_observe (&priv->metrics, YGG_METRICS_HANDLER_DURATION, g_get_monotonic_time () - started);
+  ygg_metrics_add (&priv->metrics, YGG_METRICS_MESSAGES_HANDLED, 1);
+  worker_trace (self, YGG_TRACE_POINT_HANDLER_FINISHED, msg->id, msg->response_to);
+
+  if (msg->journal_entry != NULL) {
+    ygg_journal_complete (priv->journal, msg->journal_entry);
+    msg->journal_entry = NULL;
+  }
 
   g_assert_null (err);
-  if (!ygg_worker_emit_event (self, YGG_WORKER_EVENT_END, msg->id, "", &err)) {
-    if (err != NULL) {
-      g_critical ("%s", err->message);
-      goto out;
-    }
+  if (ygg_worker_emit_event (self, YGG_WORKER_EVENT_END, msg->id, "", &err)) {
+    worker_trace (self, YGG_TRACE_POINT_END_SENT, msg->id, msg->response_to);
+  } else if (err != NULL) {
+    g_critical ("%s", err->message);
+    g_clear_error (&err);
   }
 
-out:
-  message_free (msg);
+  (void) g_atomic_int_dec_and_test (&priv->queue_depth);
+  ygg_message_unref (msg);
 
   return G_SOURCE_REMOVE;
 }
 
-static void
-dbus_proxy_call_done (GObject      *source_object,
-                      GAsyncResult *result,
-                      gpointer      user_data)
+/**
+ * message_priority_from_metadata:
+ * @worker: A #YggWorker.
+ * @message: A received #YggMessage.
+ *
+ * Looks up the worker's #YggWorker:priority-key in the metadata of @message.
+ *
+ * Returns: A #GSource priority for handling @message.
+ */
+static gint
+message_priority_from_metadata (YggWorker  *self,
+                                YggMessage *message)
 {
-  g_debug ("dbus_proxy_call_done");
-  GDBusProxy *proxy = G_DBUS_PROXY (source_object);
-  GTask *task = G_TASK (user_data);
-  GError *err = NULL;
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
 
-  g_assert_null (err);
-  GVariant *response = g_dbus_proxy_call_finish (proxy, result, &err);
-  if (err != NULL) {
-    g_critical ("unable to call com.redhat.Yggdrasil1.Dispatcher1.Transmit: %s", err->message);
-    g_task_return_error (task, err);
-    return;
+  if (priv->priority_key == NULL) {
+    return G_PRIORITY_DEFAULT_IDLE;
   }
 
-  g_task_return_pointer (task, response, (GDestroyNotify) g_variant_unref);
+  const gchar *value = ygg_metadata_get (message->metadata, priv->priority_key);
+  if (g_strcmp0 (value, "high") == 0) {
+    return G_PRIORITY_HIGH_IDLE;
+  } else if (g_strcmp0 (value, "low") == 0) {
+    return G_PRIORITY_LOW;
+  }
+  return G_PRIORITY_DEFAULT_IDLE;
 }
 
 /**
- * invoke_tx:
- * @user_data: (transfer none): the #GTask responsible for invoke_tx.
- *
- * A #GSourceFunc that invokes com.redhat.Yggdrasil1.Dispatcher1.Transmit
- * synchronously and attaches the response to a #GTask.
+ * message_compare_priority:
  *
- * Returns: #G_SOURCE_REMOVE, indicating that this callback should only be
- * invoked once.
+ * A #GCompareDataFunc that orders the worker's thread pool queue by message
+ * priority, and by arrival within the same priority.
  */
-static gboolean
-invoke_tx (gpointer user_data)
+static gint
+message_compare_priority (gconstpointer a,
+                          gconstpointer b,
+                          gpointer      user_data)
 {
-  g_debug ("invoke_tx");
-  GTask *task = G_TASK (user_data);
-  GError *err = NULL;
-
-  Message *message = (Message *) g_task_get_task_data (task);
-  g_return_val_if_fail (message != NULL, G_SOURCE_REMOVE);
+  const YggMessage *message_a = (const YggMessage *) a;
+  const YggMessage *message_b = (const YggMessage *) b;
 
-  GDBusInterfaceInfo *interface_info = g_dbus_node_info_lookup_interface (dispatcher_node_info, "com.redhat.Yggdrasil1.Dispatcher1");
-  g_assert_nonnull (interface_info);
-
-  g_assert_null (err);
-  GDBusProxy *proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_STARTER,
-                                                     G_DBUS_PROXY_FLAGS_NONE,
-                                                     interface_info,
-                                                     "com.redhat.Yggdrasil1.Dispatcher1",
-                                                     "/com/redhat/Yggdrasil1/Dispatcher1",
-                                                     "com.redhat.Yggdrasil1.Dispatcher1",
-                                                     NULL,
-                                                     &err);
-  if (err != NULL) {
-    g_critical ("unable to get proxy object for com.redhat.Yggdrasil1.Dispatcher1: %s", err->message);
-    g_task_return_error (task, err);
-    return G_SOURCE_REMOVE;
+  if (message_a->priority != message_b->priority) {
+    return message_a->priority < message_b->priority ? -1 : 1;
   }
+  if (message_a->sequence != message_b->sequence) {
+    return message_a->sequence < message_b->sequence ? -1 : 1;
+  }
+  return 0;
+}
 
-  GVariant *parameters = message_to_variant (message);
-  g_autofree gchar *printed_params = g_variant_print (parameters, TRUE);
-  g_debug ("Transmit parameters: %s", printed_params);
-
-  g_dbus_proxy_call (proxy,
-                     "Transmit",
-                     parameters,
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1,
-                     NULL,
-                     (GAsyncReadyCallback) dbus_proxy_call_done,
-                     task);
+static gboolean
+worker_release_idle (gpointer user_data)
+{
+  g_object_unref (user_data);
 
   return G_SOURCE_REMOVE;
 }
 
-static void
-handle_method_call (GDBusConnection       *connection,
-                    const gchar           *sender,
-                    const gchar           *object_path,
-                    const gchar           *interface_name,
-                    const gchar           *method_name,
-                    GVariant              *parameters,
-                    GDBusMethodInvocation *invocation,
-                    gpointer               user_data)
+/**
+ * ygg_worker_release:
+ * @worker: (transfer full): A #YggWorker.
+ *
+ * Drops a reference on @worker that may be the last one. Off the thread that
+ * created @worker, such as on one of its thread pool threads, the reference is
+ * dropped from an idle source on the worker's main context instead, so that
+ * the worker is never disposed of from within its own thread pool or away from
+ * the context its bus name is owned on.
+ */
+void
+ygg_worker_release (YggWorker *self)
 {
-  YggWorker *self = YGG_WORKER (user_data);
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
 
-  g_autofree gchar *print_params = g_variant_print (parameters, TRUE);
-  g_debug ("%s parameters: %s", method_name, print_params);
+  if (g_thread_self () == priv->owner) {
+    g_object_unref (self);
+    return;
+  }
 
-  if (g_strcmp0 (method_name, "Dispatch") == 0) {
-    GError *err = NULL;
+  GSource *source = g_idle_source_new ();
+  g_source_set_callback (source, worker_release_idle, self, NULL);
+  g_source_attach (source, priv->context);
+  g_source_unref (source);
+}
 
-    Message *msg = message_new_from_variant (self, parameters, &err);
-    if (err != NULL) {
-      g_dbus_method_invocation_return_gerror (invocation, err);
-      return;
-    }
+/**
+ * invoke_rx_thread:
+ * @data: (transfer full): The received #YggMessage.
+ * @user_data: Unused.
+ *
+ * A #GFunc that runs invoke_rx() on one of the worker's thread pool threads.
+ */
+static void
+invoke_rx_thread (gpointer data,
+                  gpointer user_data)
+{
+  invoke_rx (data);
+}
 
-    g_idle_add (invoke_rx, msg);
-    g_dbus_method_invocation_return_value (invocation, NULL);
-    return;
-  } else {
-    g_dbus_method_invocation_return_error (invocation,
-                                           YGG_WORKER_ERROR,
-                                           YGG_WORKER_ERROR_UNKNOWN_METHOD,
-                                           "unknown method: %s",
-                                           method_name);
-    return;
-  }
+/**
+ * PendingCall:
+ *
+ * A com.redhat.Yggdrasil1.Dispatcher1.Transmit call that was issued before the
+ * dispatcher proxy became available.
+ */
+typedef struct {
+  GVariant            *parameters;
+  GCancellable        *cancellable;
+  GAsyncReadyCallback  callback;
+  gpointer             user_data;
+} PendingCall;
+
+static void
+pending_call_free (PendingCall *call)
+{
+  g_variant_unref (call->parameters);
+  g_clear_object (&call->cancellable);
+  g_free (call);
 }
 
+/**
+ * pending_call_fail:
+ * @call: (transfer full): A #PendingCall.
+ * @error: The #GError to complete @call with.
+ *
+ * Completes a queued call that will never be issued by invoking its callback
+ * with @error. The callback receives a #GTask without a source object, so it
+ * must collect the result with dispatcher_call_transmit_finish().
+ */
 static void
-metadata_foreach_builder_add_value (const gchar *key,
-                                    const gchar *val,
-                                    gpointer     user_data)
+pending_call_fail (PendingCall  *call,
+                   const GError *error)
 {
-  GVariantBuilder *builder = (GVariantBuilder *) user_data;
-  g_variant_builder_add (builder, "{sv}", key, g_variant_new ("s", val));
+  GTask *task = g_task_new (NULL, call->cancellable, call->callback, call->user_data);
+  g_task_set_source_tag (task, pending_call_fail);
+  g_task_return_error (task, g_error_copy (error));
+  g_object_unref (task);
+  pending_call_free (call);
 }
 
-static GVariant*
-handle_get_property (GDBusConnection  *connection,
-                     const gchar      *sender,
-                     const gchar      *object_path,
-                     const gchar      *interface_name,
-                     const gchar      *property_name,
-                     GError          **error,
-                     gpointer          user_data)
+static void
+dispatcher_proxy_new_done (GObject      *source_object,
+                           GAsyncResult *result,
+                           gpointer      user_data)
 {
-  GVariant *value = NULL;
+  GError *err = NULL;
+
+  g_assert_null (err);
+  GDBusProxy *proxy = g_dbus_proxy_new_finish (result, &err);
+  if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    /* The worker was disposed while the proxy was being created. */
+    g_error_free (err);
+    return;
+  }
 
   YggWorker *self = YGG_WORKER (user_data);
   YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
 
-  if (g_strcmp0 (property_name, "RemoteContent") == 0) {
-    value = g_variant_new_boolean (priv->remote_content);
-  } else
-  if (g_strcmp0 (property_name, "Features") == 0) {
-    g_assert_nonnull (priv->features);
-    GVariantBuilder builder;
-    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
-    ygg_metadata_foreach (priv->features, metadata_foreach_builder_add, &builder);
-    value = g_variant_builder_end (&builder);
+  g_clear_object (&priv->dispatcher_proxy_cancellable);
+
+  if (err != NULL) {
+    /* Queued calls fail with the error; creating the proxy is retried the next
+     * time the dispatcher appears on the bus or a message is transmitted. */
+    g_critical ("unable to get proxy object for com.redhat.Yggdrasil1.Dispatcher1: %s", err->message);
+    PendingCall *call = NULL;
+    while ((call = g_queue_pop_head (&priv->pending_calls)) != NULL) {
+      pending_call_fail (call, err);
+    }
+    g_error_free (err);
+    return;
   }
 
-  return value;
-}
+  g_debug ("created proxy object for com.redhat.Yggdrasil1.Dispatcher1");
+  g_clear_object (&priv->dispatcher_proxy);
+  priv->dispatcher_proxy = proxy;
 
-static gboolean
-handle_set_property (GDBusConnection  *connection,
-                     const gchar      *sender,
-                     const gchar      *object_path,
-                     const gchar      *interface_name,
-                     const gchar      *property_name,
-                     GVariant         *value,
-                     GError          **error,
-                     gpointer          user_data)
-{
-  return FALSE;
+  PendingCall *call = NULL;
+  while ((call = g_queue_pop_head (&priv->pending_calls)) != NULL) {
+    g_dbus_proxy_call (priv->dispatcher_proxy,
+                       "Transmit",
+                       call->parameters,
+                       G_DBUS_CALL_FLAGS_NONE,
+                       -1,
+                       call->cancellable,
+                       call->callback,
+                       call->user_data);
+    pending_call_free (call);
+  }
 }
 
-static const GDBusInterfaceVTable interface_vtable = {
-  handle_method_call,
-  handle_get_property,
-  handle_set_property,
-  { 0 }
-};
-
+/**
+ * dispatcher_proxy_ensure:
+ * @worker: A #YggWorker.
+ *
+ * Begins creating the com.redhat.Yggdrasil1.Dispatcher1 proxy asynchronously
+ * if the worker is connected to a bus and the proxy does not exist yet and is
+ * not already being created.
+ */
 static void
-handle_signal (GDBusConnection *connection,
-               const gchar     *sender_name,
-               const gchar     *object_path,
-               const gchar     *interface_name,
-               const gchar     *signal_name,
-               GVariant        *parameters,
-               gpointer         user_data)
+dispatcher_proxy_ensure (YggWorker *self)
 {
-  YggWorker *self = YGG_WORKER (user_data);
   YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
 
-  g_debug ("received %s signal with parameters: %s", signal_name, g_variant_print (parameters, TRUE));
+  if (priv->connection == NULL || priv->dispatcher_proxy != NULL || priv->dispatcher_proxy_cancellable != NULL) {
+    return;
+  }
 
-  YggDispatcherEvent event;
-  g_variant_get (parameters, "(u)", &event);
+  GDBusInterfaceInfo *interface_info = g_dbus_node_info_lookup_interface (dispatcher_node_info, "com.redhat.Yggdrasil1.Dispatcher1");
+  g_assert_nonnull (interface_info);
 
-  if (priv->event_func)
-    priv->event_func (event, priv->event_func_user_data);
+  priv->dispatcher_proxy_cancellable = g_cancellable_new ();
+  g_dbus_proxy_new (priv->connection,
+                    G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES | G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                    interface_info,
+                    "com.redhat.Yggdrasil1.Dispatcher1",
+                    "/com/redhat/Yggdrasil1/Dispatcher1",
+                    "com.redhat.Yggdrasil1.Dispatcher1",
+                    priv->dispatcher_proxy_cancellable,
+                    (GAsyncReadyCallback) dispatcher_proxy_new_done,
+                    self);
 }
 
-
+/**
+ * dispatcher_call_transmit:
+ * @worker: A #YggWorker.
+ * @parameters: (transfer floating): A "(sssa{ss}ay)" #GVariant.
+ * @cancellable: (nullable): A #GCancellable or %NULL.
+ * @callback: A #GAsyncReadyCallback to invoke when the call completes. It
+ * must collect the result with dispatcher_call_transmit_finish().
+ * @user_data: Data passed to @callback.
+ *
+ * Calls com.redhat.Yggdrasil1.Dispatcher1.Transmit using the worker's cached
+ * dispatcher proxy. If the proxy is not available yet, the call is queued and
+ * issued as soon as the proxy has been created. If the proxy cannot be created,
+ * or the worker is disposed first, the queued call fails instead.
+ */
 static void
-on_bus_acquired (GDBusConnection *connection,
-                 const gchar     *name,
-                 gpointer         user_data)
+dispatcher_call_transmit (YggWorker           *self,
+                          GVariant            *parameters,
+                          GCancellable        *cancellable,
+                          GAsyncReadyCallback  callback,
+                          gpointer             user_data)
 {
-  YggWorker *self = YGG_WORKER (user_data);
   YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
 
-  GDBusInterfaceInfo *interface_info = g_dbus_node_info_lookup_interface (worker_node_info, "com.redhat.Yggdrasil1.Worker1");
-  g_assert (interface_info);
+  if (priv->dispatcher_proxy != NULL) {
+    g_dbus_proxy_call (priv->dispatcher_proxy,
+                       "Transmit",
+                       parameters,
+                       G_DBUS_CALL_FLAGS_NONE,
+                       -1,
+                       cancellable,
+                       callback,
+                       user_data);
+    return;
+  }
 
-  GError *err = NULL;
-  guint registration_id = g_dbus_connection_register_object (connection,
-                                                             priv->object_path,
+  PendingCall *call = g_new0 (PendingCall, 1);
+  call->parameters = g_variant_ref_sink (parameters);
+  call->cancellable = cancellable != NULL ? g_object_ref (cancellable) : NULL;
+  call->callback = callback;
+  call->user_data = user_data;
+  g_queue_push_tail (&priv->pending_calls, call);
+
+  dispatcher_proxy_ensure (self);
+}
+
+/**
+ * dispatcher_call_transmit_finish:
+ * @source_object: (nullable): The source object passed to the callback of
+ * dispatcher_call_transmit().
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: (out) (optional): Return location for a #GError, or %NULL.
+ *
+ * Finishes a call started with dispatcher_call_transmit().
+ *
+ * Returns: (transfer full) (nullable): The reply of the call, or %NULL if it
+ * failed or was never issued.
+ */
+static GVariant *
+dispatcher_call_transmit_finish (GObject       *source_object,
+                                 GAsyncResult  *result,
+                                 GError       **error)
+{
+  if (g_async_result_is_tagged (result, pending_call_fail)) {
+    return g_task_propagate_pointer (G_TASK (result), error);
+  }
+
+  return g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), result, error);
+}
+
+static void
+on_dispatcher_appeared (GDBusConnection *connection,
+                        const gchar     *name,
+                        const gchar     *name_owner,
+                        gpointer         user_data)
+{
+  YggWorker *self = YGG_WORKER (user_data);
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  g_debug ("%s appeared with owner %s", name, name_owner);
+
+  if (priv->dispatcher_proxy != NULL) {
+    g_autofree gchar *proxy_name_owner = g_dbus_proxy_get_name_owner (priv->dispatcher_proxy);
+    if (g_strcmp0 (proxy_name_owner, name_owner) == 0) {
+      return;
+    }
+    g_clear_object (&priv->dispatcher_proxy);
+  }
+
+  dispatcher_proxy_ensure (self);
+}
+
+static void
+on_dispatcher_vanished (GDBusConnection *connection,
+                        const gchar     *name,
+                        gpointer         user_data)
+{
+  YggWorker *self = YGG_WORKER (user_data);
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  g_debug ("%s vanished", name);
+
+  /* The proxy is rebuilt when the dispatcher reappears or the next time a
+   * message is transmitted, whichever happens first. */
+  g_clear_object (&priv->dispatcher_proxy);
+}
+
+/**
+ * worker_record_transmit:
+ * @worker: A #YggWorker.
+ * @message: The #YggMessage about to be transmitted.
+ *
+ * Stamps @message with the time it is transmitted and counts it.
+ */
+static void
+worker_record_transmit (YggWorker  *self,
+                        YggMessage *message)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  message->timestamp = g_get_monotonic_time ();
+  ygg_metrics_add (&priv->metrics, YGG_METRICS_TRANSMITS, 1);
+  ygg_metrics_add (&priv->metrics, YGG_METRICS_BYTES_TRANSMITTED, g_bytes_get_size (message->data));
+  worker_trace (self, YGG_TRACE_POINT_TRANSMIT_ISSUED, message->id, message->response_to);
+}
+
+/**
+ * worker_record_transmit_done:
+ * @worker: A #YggWorker.
+ * @message: The #YggMessage whose Transmit call completed.
+ * @error: (nullable): The error the call failed with, if any.
+ *
+ * Records the round trip time of a completed Transmit call.
+ */
+static void
+worker_record_transmit_done (YggWorker    *self,
+                             YggMessage   *message,
+                             const GError *error)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  ygg_metrics_observe (&priv->metrics, YGG_METRICS_TRANSMIT_ROUND_TRIP, g_get_monotonic_time () - message->timestamp);
+  if (error != NULL) {
+    ygg_metrics_add (&priv->metrics, YGG_METRICS_TRANSMIT_ERRORS, 1);
+  }
+  worker_trace (self, YGG_TRACE_POINT_TRANSMIT_COMPLETED, message->id, message->response_to);
+}
+
+/*
+ * With a spool, transmits that fail with a transient error are retried after
+ * an exponentially growing delay, and transmits issued while the dispatcher
+ * is disconnected are held until it reconnects.
+ */
+#define SPOOL_DRAIN_MAX_IN_FLIGHT 8
+#define TRANSMIT_RETRY_MAX_ATTEMPTS 8
+#define TRANSMIT_RETRY_INITIAL_DELAY_MS 100
+#define TRANSMIT_RETRY_MAX_DELAY_MS 30000
+
+static void dbus_proxy_call_done (GObject      *source_object,
+                                  GAsyncResult *result,
+                                  gpointer      user_data);
+
+/**
+ * transmit_error_is_transient:
+ * @error: The error a Transmit call failed with.
+ *
+ * Returns: %TRUE if the call may succeed when it is retried.
+ */
+static gboolean
+transmit_error_is_transient (const GError *error)
+{
+  if (error->domain == G_DBUS_ERROR) {
+    switch (error->code) {
+      case G_DBUS_ERROR_NO_REPLY:
+      case G_DBUS_ERROR_TIMEOUT:
+      case G_DBUS_ERROR_TIMED_OUT:
+      case G_DBUS_ERROR_SERVICE_UNKNOWN:
+      case G_DBUS_ERROR_NAME_HAS_NO_OWNER:
+      case G_DBUS_ERROR_DISCONNECTED:
+      case G_DBUS_ERROR_LIMITS_EXCEEDED:
+        return TRUE;
+      default:
+        return FALSE;
+    }
+  }
+
+  return g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CLOSED) ||
+         g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT) ||
+         g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED) ||
+         g_error_matches (error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE);
+}
+
+/**
+ * transmit_retry_delay:
+ * @attempts: The number of times the transmit has been retried, including
+ * this time.
+ *
+ * Returns: The number of milliseconds to wait before retrying a transmit,
+ * doubling with every attempt up to a limit, plus up to a quarter of that as
+ * jitter.
+ */
+static guint
+transmit_retry_delay (guint attempts)
+{
+  guint delay = TRANSMIT_RETRY_INITIAL_DELAY_MS << MIN (attempts - 1, 16);
+  delay = MIN (delay, TRANSMIT_RETRY_MAX_DELAY_MS);
+
+  return delay + g_random_int_range (0, delay / 4 + 1);
+}
+
+/**
+ * transmit_issue:
+ * @task: The #GTask of a ygg_worker_transmit() call.
+ * @parameters: (transfer full) (nullable): The serialized message, or %NULL
+ * to serialize the message of @task.
+ *
+ * Calls com.redhat.Yggdrasil1.Dispatcher1.Transmit for the message of @task.
+ */
+static void
+transmit_issue (GTask    *task,
+                GVariant *parameters)
+{
+  YggWorker *self = YGG_WORKER (g_task_get_source_object (task));
+  YggMessage *message = (YggMessage *) g_task_get_task_data (task);
+
+  g_autoptr (GVariant) owned = parameters != NULL ? parameters : g_variant_ref_sink (ygg_message_to_variant (message));
+  worker_record_transmit (self, message);
+  if (ygg_log_debug_enabled ()) {
+    g_autofree gchar *printed_params = ygg_log_print_variant (owned);
+    g_debug ("Transmit parameters: %s", printed_params);
+  }
+
+  dispatcher_call_transmit (self,
+                            owned,
+                            g_task_get_cancellable (task),
+                            (GAsyncReadyCallback) dbus_proxy_call_done,
+                            task);
+}
+
+/**
+ * worker_spool_drain:
+ * @worker: A #YggWorker.
+ *
+ * Transmits spooled messages in the order they were spooled, keeping up to
+ * %SPOOL_DRAIN_MAX_IN_FLIGHT of them awaiting a reply.
+ */
+static void
+worker_spool_drain (YggWorker *self)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  while (priv->spool_in_flight < SPOOL_DRAIN_MAX_IN_FLIGHT) {
+    GVariant *parameters = NULL;
+    GTask *task = NULL;
+    GError *err = NULL;
+
+    if (!ygg_spool_pop (priv->spool, &parameters, (gpointer *) &task, &err)) {
+      break;
+    }
+    g_atomic_int_set (&priv->spooled, ygg_spool_get_length (priv->spool));
+
+    if (parameters == NULL) {
+      g_critical ("unable to read spooled message: %s", err->message);
+      g_task_return_error (task, err);
+      g_object_unref (task);
+      continue;
+    }
+
+    YggMessage *message = (YggMessage *) g_task_get_task_data (task);
+    ygg_message_restore_payload (message, parameters);
+    message->spooled = TRUE;
+    priv->spool_in_flight++;
+    transmit_issue (task, parameters);
+  }
+}
+
+/**
+ * worker_spool_task:
+ * @worker: A #YggWorker.
+ * @task: (transfer full): The #GTask of a ygg_worker_transmit() call.
+ *
+ * Appends the message of @task to the worker's spool. If it is written to the
+ * spool's segment file, the message lets go of its payload until it is popped
+ * again, so that memory use stays within #YggWorker:spool-memory-limit. The
+ * spool is drained right away unless the dispatcher is disconnected.
+ */
+static void
+worker_spool_task (YggWorker *self,
+                   GTask     *task)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  YggMessage *message = (YggMessage *) g_task_get_task_data (task);
+  guint n_on_disk = ygg_spool_get_length_on_disk (priv->spool);
+  GError *err = NULL;
+
+  if (!ygg_spool_push (priv->spool, ygg_message_to_variant (message), task, &err)) {
+    g_critical ("unable to spool message %s: %s", message->id, err->message);
+    g_task_return_error (task, err);
+    g_object_unref (task);
+    return;
+  }
+  if (ygg_spool_get_length_on_disk (priv->spool) > n_on_disk) {
+    ygg_message_drop_payload (message);
+  }
+  g_atomic_int_set (&priv->spooled, ygg_spool_get_length (priv->spool));
+  g_debug ("spooled message %s", message->id);
+
+  if (!priv->dispatcher_offline) {
+    worker_spool_drain (self);
+  }
+}
+
+/**
+ * spooled_task_compare:
+ * @a: The #GTask of a ygg_worker_transmit() call.
+ * @b: The #GTask of another ygg_worker_transmit() call.
+ *
+ * A #GCompareFunc that orders transmits in the order they were requested.
+ *
+ * Returns: A negative value if @a was requested first, a positive value if @b
+ * was, and 0 if they are the same.
+ */
+static gint
+spooled_task_compare (gconstpointer a,
+                      gconstpointer b)
+{
+  const YggMessage *message_a = (const YggMessage *) g_task_get_task_data (G_TASK (a));
+  const YggMessage *message_b = (const YggMessage *) g_task_get_task_data (G_TASK (b));
+
+  if (message_a->sequence != message_b->sequence) {
+    return message_a->sequence < message_b->sequence ? -1 : 1;
+  }
+  return 0;
+}
+
+static void
+spooled_task_abandon (GTask *task)
+{
+  g_task_return_new_error (task,
+                           G_IO_ERROR,
+                           G_IO_ERROR_CLOSED,
+                           "the worker was disposed before the message was transmitted");
+  g_object_unref (task);
+}
+
+/**
+ * transmit_retry:
+ * @user_data: (transfer none): The #GTask of a ygg_worker_transmit() call.
+ *
+ * A #GSourceFunc that retries a transmit once its backoff delay has passed. If
+ * the dispatcher has disconnected in the meantime, the message is put back in
+ * the spool ahead of the messages that were transmitted after it.
+ *
+ * Returns: #G_SOURCE_REMOVE
+ */
+static gboolean
+transmit_retry (gpointer user_data)
+{
+  GTask *task = G_TASK (user_data);
+  YggWorker *self = YGG_WORKER (g_task_get_source_object (task));
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  YggMessage *message = (YggMessage *) g_task_get_task_data (task);
+
+  if (priv->spool != NULL && priv->dispatcher_offline) {
+    if (message->spooled) {
+      message->spooled = FALSE;
+      priv->spool_in_flight--;
+    }
+    ygg_spool_insert_sorted (priv->spool, ygg_message_to_variant (message), task, spooled_task_compare);
+    g_atomic_int_set (&priv->spooled, ygg_spool_get_length (priv->spool));
+    g_debug ("spooled message %s for retry", message->id);
+    return G_SOURCE_REMOVE;
+  }
+
+  transmit_issue (task, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+dbus_proxy_call_done (GObject      *source_object,
+                      GAsyncResult *result,
+                      gpointer      user_data)
+{
+  g_debug ("dbus_proxy_call_done");
+  GTask *task = G_TASK (user_data);
+  YggWorker *self = YGG_WORKER (g_task_get_source_object (task));
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  YggMessage *message = (YggMessage *) g_task_get_task_data (task);
+  GError *err = NULL;
+
+  g_assert_null (err);
+  GVariant *response = dispatcher_call_transmit_finish (source_object, result, &err);
+  worker_record_transmit_done (self, message, err);
+
+  if (err != NULL && priv->spool != NULL && transmit_error_is_transient (err) &&
+      message->attempts + 1 < TRANSMIT_RETRY_MAX_ATTEMPTS) {
+    guint delay = transmit_retry_delay (++message->attempts);
+    g_debug ("retrying transmit of %s in %ums: %s", message->id, delay, err->message);
+    g_error_free (err);
+
+    GSource *source = g_timeout_source_new (delay);
+    g_task_attach_source (task, source, transmit_retry);
+    g_source_unref (source);
+    return;
+  }
+
+  if (message->spooled) {
+    message->spooled = FALSE;
+    priv->spool_in_flight--;
+    worker_spool_drain (self);
+  }
+
+  if (err != NULL) {
+    g_critical ("unable to call com.redhat.Yggdrasil1.Dispatcher1.Transmit: %s", err->message);
+    g_task_return_error (task, err);
+    g_object_unref (task);
+    return;
+  }
+
+  g_task_return_pointer (task, response, (GDestroyNotify) g_variant_unref);
+  g_object_unref (task);
+}
+
+/**
+ * invoke_tx:
+ * @user_data: (transfer none): the #GTask responsible for invoke_tx.
+ *
+ * A #GSourceFunc that invokes com.redhat.Yggdrasil1.Dispatcher1.Transmit
+ * asynchronously on the worker's dispatcher proxy. The response is attached
+ * to the #GTask once the call completes. If the worker has a spool and the
+ * dispatcher is disconnected, or earlier messages are still spooled, the
+ * message is spooled instead.
+ *
+ * Returns: #G_SOURCE_REMOVE, indicating that this callback should only be
+ * invoked once.
+ */
+static gboolean
+invoke_tx (gpointer user_data)
+{
+  g_debug ("invoke_tx");
+  GTask *task = G_TASK (user_data);
+  YggWorker *self = YGG_WORKER (g_task_get_source_object (task));
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  YggMessage *message = (YggMessage *) g_task_get_task_data (task);
+  g_return_val_if_fail (message != NULL, G_SOURCE_REMOVE);
+
+  if (priv->spool != NULL && (priv->dispatcher_offline || ygg_spool_get_length (priv->spool) > 0)) {
+    worker_spool_task (self, task);
+    return G_SOURCE_REMOVE;
+  }
+
+  transmit_issue (task, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * PendingSignal:
+ *
+ * A signal that was emitted before the worker acquired its bus connection.
+ */
+typedef struct {
+  gchar    *interface_name;
+  gchar    *signal_name;
+  GVariant *parameters;
+} PendingSignal;
+
+static void
+pending_signal_free (PendingSignal *pending)
+{
+  g_free (pending->interface_name);
+  g_free (pending->signal_name);
+  g_variant_unref (pending->parameters);
+  g_free (pending);
+}
+
+/**
+ * worker_emit_signal:
+ * @worker: A #YggWorker.
+ * @interface_name: D-Bus interface to emit a signal on.
+ * @signal_name: The name of the signal to emit.
+ * @parameters: (transfer floating): A #GVariant tuple with parameters for the
+ * signal.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Emits a signal from the worker's object path on its cached bus connection.
+ * If the bus has not been acquired yet, the signal is queued and emitted once
+ * it is. This function may be called from any thread.
+ *
+ * Returns: %TRUE unless an error occurred.
+ */
+static gboolean
+worker_emit_signal (YggWorker    *self,
+                    const gchar  *interface_name,
+                    const gchar  *signal_name,
+                    GVariant     *parameters,
+                    GError      **error)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  g_mutex_lock (&priv->lock);
+  if (priv->connection == NULL) {
+    PendingSignal *pending = g_new0 (PendingSignal, 1);
+    pending->interface_name = g_strdup (interface_name);
+    pending->signal_name = g_strdup (signal_name);
+    pending->parameters = g_variant_ref_sink (parameters);
+    g_queue_push_tail (&priv->pending_signals, pending);
+    g_mutex_unlock (&priv->lock);
+    return TRUE;
+  }
+  g_autoptr (GDBusConnection) connection = g_object_ref (priv->connection);
+  g_mutex_unlock (&priv->lock);
+
+  return g_dbus_connection_emit_signal (connection,
+                                        NULL,
+                                        priv->object_path,
+                                        interface_name,
+                                        signal_name,
+                                        parameters,
+                                        error);
+}
+
+/**
+ * worker_flush_pending_signals:
+ * @worker: A #YggWorker.
+ *
+ * Emits any signals that were queued before the bus was acquired, in the order
+ * in which they were emitted. Must be called with the worker's lock held.
+ */
+static void
+worker_flush_pending_signals (YggWorker *self)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  PendingSignal *pending = NULL;
+  while ((pending = g_queue_pop_head (&priv->pending_signals)) != NULL) {
+    GError *err = NULL;
+    if (!g_dbus_connection_emit_signal (priv->connection,
+                                        NULL,
+                                        priv->object_path,
+                                        pending->interface_name,
+                                        pending->signal_name,
+                                        pending->parameters,
+                                        &err)) {
+      g_critical ("unable to emit %s.%s: %s", pending->interface_name, pending->signal_name, err->message);
+      g_error_free (err);
+    }
+    pending_signal_free (pending);
+  }
+}
+
+#define STREAM_ASSEMBLY_MAX 64
+#define STREAM_ASSEMBLY_IDLE_TIMEOUT_S 60
+
+static void worker_queue_message (YggWorker  *self,
+                                  YggMessage *msg);
+
+/**
+ * StreamChunk:
+ * @message: The received #YggMessage carrying the chunk.
+ * @invocation: The Dispatch call that delivered the chunk. It is returned once
+ * the chunk has been written.
+ *
+ * A chunk of a stream waiting to be written to its #StreamAssembly.
+ */
+typedef struct {
+  YggMessage            *message;
+  GDBusMethodInvocation *invocation;
+} StreamChunk;
+
+static void
+stream_chunk_fail (StreamChunk  *chunk,
+                   const GError *error)
+{
+  g_dbus_method_invocation_return_gerror (chunk->invocation, error);
+  ygg_message_unref (chunk->message);
+  g_free (chunk);
+}
+
+/**
+ * StreamAssembly:
+ * @worker: The #YggWorker receiving the stream.
+ * @stream_id: The value of %YGG_WORKER_CHUNK_STREAM_ID.
+ * @file: The temporary file the chunks are written to.
+ * @iostream: The open @file.
+ * @cancellable: Cancels the write in progress when the assembly is dropped.
+ * @next_sequence: The sequence number of the next chunk expected.
+ * @last_activity: The monotonic time the last chunk was received or written.
+ * @chunks: The #StreamChunk queue of chunks waiting to be written.
+ * @writing: (nullable): The #StreamChunk being written.
+ * @complete: %TRUE once the final chunk has been received.
+ * @dropped: %TRUE once the assembly has been removed from the worker.
+ * @error: (nullable): The #GError chunks waiting to be written fail with when
+ * the assembly is dropped.
+ *
+ * The chunks of a stream received so far, spilled to a temporary file. Chunks
+ * are written asynchronously, one at a time and in order; each Dispatch call is
+ * returned once its chunk has been written.
+ */
+typedef struct {
+  YggWorker     *worker;
+  gchar         *stream_id;
+  GFile         *file;
+  GFileIOStream *iostream;
+  GCancellable  *cancellable;
+  guint64        next_sequence;
+  gint64         last_activity;
+  GQueue         chunks;
+  StreamChunk   *writing;
+  gboolean       complete;
+  gboolean       dropped;
+  GError        *error;
+} StreamAssembly;
+
+static void
+stream_assembly_free (StreamAssembly *assembly)
+{
+  g_io_stream_close (G_IO_STREAM (assembly->iostream), NULL, NULL);
+  g_object_unref (assembly->iostream);
+  g_file_delete (assembly->file, NULL, NULL);
+  g_object_unref (assembly->file);
+  g_object_unref (assembly->cancellable);
+  g_clear_error (&assembly->error);
+  g_free (assembly->stream_id);
+  g_free (assembly);
+}
+
+/**
+ * stream_assembly_drop:
+ * @assembly: (transfer full): A #StreamAssembly.
+ *
+ * The #GDestroyNotify of the worker's assembly table. Fails the chunks waiting
+ * to be written and cancels the write in progress, if any. The assembly is
+ * freed once that write has completed, since it may outlive the worker.
+ */
+static void
+stream_assembly_drop (StreamAssembly *assembly)
+{
+  assembly->dropped = TRUE;
+  if (assembly->error == NULL && (assembly->writing != NULL || !g_queue_is_empty (&assembly->chunks))) {
+    assembly->error = g_error_new (G_IO_ERROR, G_IO_ERROR_CLOSED, "stream %s was abandoned", assembly->stream_id);
+  }
+
+  StreamChunk *chunk = NULL;
+  while ((chunk = g_queue_pop_head (&assembly->chunks)) != NULL) {
+    stream_chunk_fail (chunk, assembly->error);
+  }
+
+  if (assembly->writing != NULL) {
+    g_cancellable_cancel (assembly->cancellable);
+    return;
+  }
+  stream_assembly_free (assembly);
+}
+
+/**
+ * stream_assembly_abort:
+ * @worker: A #YggWorker.
+ * @assembly: A #StreamAssembly of @worker.
+ * @error: (transfer full): The reason the stream is abandoned.
+ *
+ * Removes @assembly from @worker, failing the chunks waiting to be written
+ * with @error.
+ */
+static void
+stream_assembly_abort (YggWorker      *self,
+                       StreamAssembly *assembly,
+                       GError         *error)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  g_clear_error (&assembly->error);
+  assembly->error = error;
+  g_hash_table_remove (priv->assemblies, assembly->stream_id);
+}
+
+/**
+ * stream_assemblies_expire:
+ * @user_data: A #YggWorker.
+ *
+ * A #GSourceFunc that abandons the streams that have not received or written a
+ * chunk for %STREAM_ASSEMBLY_IDLE_TIMEOUT_S seconds. It runs for as long as the
+ * worker is reassembling a stream.
+ *
+ * Returns: %G_SOURCE_REMOVE once no stream is being reassembled.
+ */
+static gboolean
+stream_assemblies_expire (gpointer user_data)
+{
+  YggWorker *self = YGG_WORKER (user_data);
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  gint64 now = g_get_monotonic_time ();
+  GHashTableIter iter;
+  gpointer value = NULL;
+
+  g_hash_table_iter_init (&iter, priv->assemblies);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    StreamAssembly *assembly = (StreamAssembly *) value;
+    if (assembly->writing != NULL || now - assembly->last_activity < STREAM_ASSEMBLY_IDLE_TIMEOUT_S * G_USEC_PER_SEC) {
+      continue;
+    }
+    g_debug ("abandoning idle stream %s", assembly->stream_id);
+    g_clear_error (&assembly->error);
+    assembly->error = g_error_new (YGG_WORKER_ERROR,
+                                   YGG_WORKER_ERROR_TIMED_OUT,
+                                   "stream %s received no chunk for %d seconds",
+                                   assembly->stream_id,
+                                   STREAM_ASSEMBLY_IDLE_TIMEOUT_S);
+    g_hash_table_iter_remove (&iter);
+  }
+
+  if (g_hash_table_size (priv->assemblies) == 0) {
+    priv->assemblies_expire_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * stream_assembly_finish:
+ * @worker: A #YggWorker.
+ * @assembly: A #StreamAssembly of @worker.
+ * @chunk: (transfer full): The final chunk, which has been written.
+ *
+ * Reopens the temporary file of @assembly for reading and queues the
+ * reassembled message to be handled. The file is unlinked, so its space is
+ * released once the handler closes the stream.
+ */
+static void
+stream_assembly_finish (YggWorker      *self,
+                        StreamAssembly *assembly,
+                        StreamChunk    *chunk)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  GFileInputStream *input = NULL;
+  GError *err = NULL;
+
+  g_assert_null (err);
+  if (g_io_stream_close (G_IO_STREAM (assembly->iostream), NULL, &err)) {
+    input = g_file_read (assembly->file, NULL, &err);
+  }
+  if (input == NULL) {
+    ygg_metrics_add (&priv->metrics, YGG_METRICS_DISPATCH_ERRORS, 1);
+    stream_chunk_fail (chunk, err);
+    stream_assembly_abort (self, assembly, err);
+    return;
+  }
+
+  /* The reassembled message is delivered under the ID of the stream. */
+  YggMessage *msg = chunk->message;
+  YggMessage *stream_msg = ygg_message_new (self,
+                                            priv->message_pool,
+                                            msg->addr,
+                                            assembly->stream_id,
+                                            msg->response_to,
+                                            msg->metadata,
+                                            msg->data);
+  stream_msg->timestamp = msg->timestamp;
+  stream_msg->stream = G_INPUT_STREAM (input);
+
+  g_dbus_method_invocation_return_value (chunk->invocation, NULL);
+  ygg_message_unref (msg);
+  g_free (chunk);
+
+  /* Removing the assembly unlinks the file; the open stream keeps its data. */
+  g_hash_table_remove (priv->assemblies, assembly->stream_id);
+  worker_queue_message (self, stream_msg);
+}
+
+static void stream_assembly_write_next (StreamAssembly *assembly);
+
+static void
+stream_assembly_write_done (GObject      *source_object,
+                            GAsyncResult *result,
+                            gpointer      user_data)
+{
+  StreamAssembly *assembly = (StreamAssembly *) user_data;
+  StreamChunk *chunk = g_steal_pointer (&assembly->writing);
+  GError *err = NULL;
+
+  g_assert_null (err);
+  g_output_stream_write_all_finish (G_OUTPUT_STREAM (source_object), result, NULL, &err);
+  if (assembly->dropped) {
+    /* The worker may be gone; only the assembly is still valid. */
+    stream_chunk_fail (chunk, assembly->error);
+    g_clear_error (&err);
+    stream_assembly_free (assembly);
+    return;
+  }
+
+  YggWorker *self = assembly->worker;
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  if (err != NULL) {
+    ygg_metrics_add (&priv->metrics, YGG_METRICS_DISPATCH_ERRORS, 1);
+    stream_chunk_fail (chunk, err);
+    stream_assembly_abort (self, assembly, err);
+    return;
+  }
+
+  assembly->last_activity = g_get_monotonic_time ();
+  if (assembly->complete && g_queue_is_empty (&assembly->chunks)) {
+    stream_assembly_finish (self, assembly, chunk);
+    return;
+  }
+
+  g_dbus_method_invocation_return_value (chunk->invocation, NULL);
+  ygg_message_unref (chunk->message);
+  g_free (chunk);
+  stream_assembly_write_next (assembly);
+}
+
+/**
+ * stream_assembly_write_next:
+ * @assembly: A #StreamAssembly that is not writing a chunk.
+ *
+ * Begins writing the next chunk waiting in @assembly, if any.
+ */
+static void
+stream_assembly_write_next (StreamAssembly *assembly)
+{
+  StreamChunk *chunk = g_queue_pop_head (&assembly->chunks);
+  if (chunk == NULL) {
+    return;
+  }
+
+  gsize size = 0;
+  gconstpointer data = g_bytes_get_data (chunk->message->data, &size);
+  assembly->writing = chunk;
+  g_output_stream_write_all_async (g_io_stream_get_output_stream (G_IO_STREAM (assembly->iostream)),
+                                   data,
+                                   size,
+                                   G_PRIORITY_DEFAULT,
+                                   assembly->cancellable,
+                                   stream_assembly_write_done,
+                                   assembly);
+}
+
+/**
+ * stream_assembly_add_chunk:
+ * @worker: A #YggWorker.
+ * @msg: (transfer full): A received #YggMessage carrying a chunk of a stream.
+ * @invocation: (transfer full): The Dispatch call that delivered @msg.
+ *
+ * Queues the data of @msg to be appended to the temporary file of its stream.
+ * Chunks must arrive in sequence, and at most %STREAM_ASSEMBLY_MAX streams are
+ * reassembled at once. @invocation is returned once the chunk has been
+ * written, or as soon as it is rejected. When the final chunk has been written,
+ * the reassembled message is queued to be handled.
+ */
+static void
+stream_assembly_add_chunk (YggWorker             *self,
+                           YggMessage            *msg,
+                           GDBusMethodInvocation *invocation)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  const gchar *stream_id = ygg_metadata_get (msg->metadata, YGG_WORKER_CHUNK_STREAM_ID);
+  const gchar *sequence_value = ygg_metadata_get (msg->metadata, YGG_WORKER_CHUNK_SEQUENCE);
+  StreamAssembly *assembly = g_hash_table_lookup (priv->assemblies, stream_id);
+  guint64 sequence = 0;
+  GError *err = NULL;
+
+  g_assert_null (err);
+  if (sequence_value == NULL || !g_ascii_string_to_unsigned (sequence_value, 10, 0, G_MAXUINT64, &sequence, NULL)) {
+    g_set_error (&err,
+                 YGG_WORKER_ERROR,
+                 YGG_WORKER_ERROR_INVALID_CHUNK,
+                 "chunk of stream %s has no valid sequence number",
+                 stream_id);
+    goto out;
+  }
+
+  if (assembly != NULL && assembly->complete) {
+    /* Leave the complete stream to be delivered */
+    g_set_error (&err,
+                 YGG_WORKER_ERROR,
+                 YGG_WORKER_ERROR_INVALID_CHUNK,
+                 "stream %s is already complete",
+                 stream_id);
+    assembly = NULL;
+    goto out;
+  }
+
+  if (assembly == NULL && sequence == 0) {
+    if (g_hash_table_size (priv->assemblies) >= STREAM_ASSEMBLY_MAX) {
+      g_set_error (&err,
+                   YGG_WORKER_ERROR,
+                   YGG_WORKER_ERROR_BUSY,
+                   "worker is reassembling %u streams",
+                   STREAM_ASSEMBLY_MAX);
+      goto out;
+    }
+
+    GFileIOStream *iostream = NULL;
+    GFile *file = g_file_new_tmp ("ygg-stream-XXXXXX", &iostream, &err);
+    if (file == NULL) {
+      goto out;
+    }
+    assembly = g_new0 (StreamAssembly, 1);
+    assembly->worker = self;
+    assembly->stream_id = g_strdup (stream_id);
+    assembly->file = file;
+    assembly->iostream = iostream;
+    assembly->cancellable = g_cancellable_new ();
+    g_queue_init (&assembly->chunks);
+    g_hash_table_insert (priv->assemblies, assembly->stream_id, assembly);
+
+    if (priv->assemblies_expire_id == 0) {
+      priv->assemblies_expire_id = g_timeout_add_seconds (STREAM_ASSEMBLY_IDLE_TIMEOUT_S, stream_assemblies_expire, self);
+    }
+  }
+
+  guint64 expected = assembly != NULL ? assembly->next_sequence : 0;
+  if (assembly == NULL || sequence != expected) {
+    g_set_error (&err,
+                 YGG_WORKER_ERROR,
+                 YGG_WORKER_ERROR_INVALID_CHUNK,
+                 "expected chunk %" G_GUINT64_FORMAT " of stream %s, got chunk %" G_GUINT64_FORMAT,
+                 expected,
+                 stream_id,
+                 sequence);
+    goto out;
+  }
+  assembly->next_sequence++;
+  assembly->last_activity = g_get_monotonic_time ();
+  assembly->complete = g_strcmp0 (ygg_metadata_get (msg->metadata, YGG_WORKER_CHUNK_FINAL), "true") == 0;
+
+  StreamChunk *chunk = g_new0 (StreamChunk, 1);
+  chunk->message = msg;
+  chunk->invocation = invocation;
+  g_queue_push_tail (&assembly->chunks, chunk);
+  if (assembly->writing == NULL) {
+    stream_assembly_write_next (assembly);
+  }
+  return;
+
+out:
+  ygg_metrics_add (&priv->metrics, YGG_METRICS_DISPATCH_ERRORS, 1);
+  if (assembly != NULL) {
+    stream_assembly_abort (self, assembly, g_error_copy (err));
+  }
+  g_dbus_method_invocation_take_error (invocation, err);
+  ygg_message_unref (msg);
+}
+
+/**
+ * PendingRequest:
+ * @id: The ID of the transmitted request.
+ * @timeout: The number of milliseconds to wait for a reply, or 0.
+ * @timeout_source: (nullable): A timeout #GSource that fails the request.
+ * @cancelled_source: (nullable): A cancellable #GSource that fails the request.
+ *
+ * The task data of a ygg_worker_request_async() call. While no reply has
+ * arrived, the task is held in the worker's requests table under @id.
+ */
+typedef struct {
+  gchar   *id;
+  guint    timeout;
+  GSource *timeout_source;
+  GSource *cancelled_source;
+} PendingRequest;
+
+static void
+pending_request_free (PendingRequest *request)
+{
+  g_clear_pointer (&request->timeout_source, g_source_unref);
+  g_clear_pointer (&request->cancelled_source, g_source_unref);
+  g_free (request->id);
+  g_free (request);
+}
+
+/**
+ * worker_request_take:
+ * @worker: A #YggWorker.
+ * @id: The ID of a request.
+ * @task: (nullable): The #GTask expected under @id, or %NULL for any.
+ *
+ * Removes the pending request with @id from the worker's requests table.
+ * Whoever removes a request completes it.
+ *
+ * Returns: (transfer full) (nullable): The #GTask of the request, or %NULL if
+ * it is no longer pending.
+ */
+static GTask *
+worker_request_take (YggWorker   *self,
+                     const gchar *id,
+                     GTask       *task)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  g_mutex_lock (&priv->requests_lock);
+  GTask *found = g_hash_table_lookup (priv->requests, id);
+  if (found != NULL && (task == NULL || found == task)) {
+    g_hash_table_remove (priv->requests, id);
+  } else {
+    found = NULL;
+  }
+  g_mutex_unlock (&priv->requests_lock);
+
+  return found;
+}
+
+/**
+ * worker_request_complete:
+ * @task: (transfer full): The #GTask of a request taken with
+ * worker_request_take().
+ * @reply: (transfer full) (nullable): The reply to the request.
+ * @error: (transfer full) (nullable): The error the request failed with.
+ *
+ * Stops waiting for a reply to the request and returns @reply or @error.
+ */
+static void
+worker_request_complete (GTask      *task,
+                         YggMessage *reply,
+                         GError     *error)
+{
+  PendingRequest *request = (PendingRequest *) g_task_get_task_data (task);
+
+  if (request->timeout_source != NULL) {
+    g_source_destroy (request->timeout_source);
+  }
+  if (request->cancelled_source != NULL) {
+    g_source_destroy (request->cancelled_source);
+  }
+
+  if (error != NULL) {
+    g_task_return_error (task, error);
+  } else {
+    g_task_return_pointer (task, reply, (GDestroyNotify) ygg_message_unref);
+  }
+  g_object_unref (task);
+}
+
+/**
+ * worker_queue_message:
+ * @worker: A #YggWorker.
+ * @msg: (transfer full): A received #YggMessage.
+ *
+ * Queues @msg to be handled by invoke_rx(), on the worker's thread pool if it
+ * has one, or on the main context.
+ */
+static void
+worker_queue_message (YggWorker  *self,
+                      YggMessage *msg)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  msg->priority = message_priority_from_metadata (self, msg);
+  msg->sequence = priv->sequence++;
+
+  g_atomic_int_inc (&priv->queue_depth);
+  worker_trace (self, YGG_TRACE_POINT_QUEUED, msg->id, msg->response_to);
+  if (priv->rx_pool != NULL) {
+    g_thread_pool_push (priv->rx_pool, msg, NULL);
+  } else {
+    g_idle_add_full (msg->priority, invoke_rx, msg, NULL);
+  }
+}
+
+static void
+handle_method_call (GDBusConnection       *connection,
+                    const gchar           *sender,
+                    const gchar           *object_path,
+                    const gchar           *interface_name,
+                    const gchar           *method_name,
+                    GVariant              *parameters,
+                    GDBusMethodInvocation *invocation,
+                    gpointer               user_data)
+{
+  YggWorker *self = YGG_WORKER (user_data);
+
+  if (ygg_log_debug_enabled ()) {
+    g_autofree gchar *print_params = ygg_log_print_variant (parameters);
+    g_debug ("%s parameters: %s", method_name, print_params);
+  }
+
+  if (g_strcmp0 (method_name, "Dispatch") == 0) {
+    YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+    GError *err = NULL;
+
+    ygg_metrics_add (&priv->metrics, YGG_METRICS_DISPATCH_RECEIVED, 1);
+
+    YggMessage *msg = ygg_message_new_from_variant (self, priv->message_pool, parameters, &err);
+    if (err != NULL) {
+      ygg_metrics_add (&priv->metrics, YGG_METRICS_DISPATCH_ERRORS, 1);
+      g_dbus_method_invocation_return_gerror (invocation, err);
+      return;
+    }
+    msg->timestamp = g_get_monotonic_time ();
+    ygg_metrics_add (&priv->metrics, YGG_METRICS_BYTES_RECEIVED, g_bytes_get_size (msg->data));
+    worker_trace (self, YGG_TRACE_POINT_DISPATCH_RECEIVED, msg->id, msg->response_to);
+
+    if (priv->stream_rx_func != NULL && ygg_metadata_get (msg->metadata, YGG_WORKER_CHUNK_STREAM_ID) != NULL) {
+      /* The stream is handled once all of its chunks have been written. */
+      stream_assembly_add_chunk (self, msg, invocation);
+      return;
+    }
+
+    /* A reply to a pending request bypasses the rx function */
+    if (msg->response_to != NULL && msg->response_to[0] != '\0') {
+      GTask *request = worker_request_take (self, msg->response_to, NULL);
+      if (request != NULL) {
+        g_debug ("message %s replies to request %s", msg->id, msg->response_to);
+        worker_request_complete (request, msg, NULL);
+        g_dbus_method_invocation_return_value (invocation, NULL);
+        return;
+      }
+    }
+
+    /* Only messages that are queued for the rx function count as in flight */
+    guint max_in_flight = (guint) g_atomic_int_get (&priv->max_in_flight);
+    if (max_in_flight > 0 && (guint) g_atomic_int_get (&priv->queue_depth) >= max_in_flight) {
+      ygg_metrics_add (&priv->metrics, YGG_METRICS_DISPATCH_REJECTED, 1);
+      g_dbus_method_invocation_return_error (invocation,
+                                             YGG_WORKER_ERROR,
+                                             YGG_WORKER_ERROR_BUSY,
+                                             "worker has %u messages in flight",
+                                             max_in_flight);
+      ygg_message_unref (msg);
+      return;
+    }
+
+    /* A journaled message is recorded before the call is acknowledged */
+    if (priv->journal != NULL) {
+      if (ygg_journal_lookup_id (priv->journal, msg->id)) {
+        g_debug ("dropping duplicate message %s", msg->id);
+        ygg_metrics_add (&priv->metrics, YGG_METRICS_DISPATCH_DUPLICATES, 1);
+        ygg_message_unref (msg);
+        g_dbus_method_invocation_return_value (invocation, NULL);
+        return;
+      }
+      if (!ygg_journal_append (priv->journal, parameters, &msg->journal_entry, &err)) {
+        ygg_metrics_add (&priv->metrics, YGG_METRICS_DISPATCH_ERRORS, 1);
+        g_dbus_method_invocation_take_error (invocation, err);
+        ygg_message_unref (msg);
+        return;
+      }
+    }
+
+    worker_queue_message (self, msg);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+    return;
+  } else {
+    g_dbus_method_invocation_return_error (invocation,
+                                           YGG_WORKER_ERROR,
+                                           YGG_WORKER_ERROR_UNKNOWN_METHOD,
+                                           "unknown method: %s",
+                                           method_name);
+    return;
+  }
+}
+
+static void
+metadata_foreach_builder_add_value (const gchar *key,
+                                    const gchar *val,
+                                    gpointer     user_data)
+{
+  GVariantBuilder *builder = (GVariantBuilder *) user_data;
+  g_variant_builder_add (builder, "{sv}", key, g_variant_new ("s", val));
+}
+
+static GVariant*
+handle_get_property (GDBusConnection  *connection,
+                     const gchar      *sender,
+                     const gchar      *object_path,
+                     const gchar      *interface_name,
+                     const gchar      *property_name,
+                     GError          **error,
+                     gpointer          user_data)
+{
+  GVariant *value = NULL;
+
+  YggWorker *self = YGG_WORKER (user_data);
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  if (g_strcmp0 (property_name, "RemoteContent") == 0) {
+    value = g_variant_new_boolean (priv->remote_content);
+  } else
+  if (g_strcmp0 (property_name, "Features") == 0) {
+    g_assert_nonnull (priv->features);
+    value = ygg_metadata_ref_variant (priv->features);
+  }
+
+  return value;
+}
+
+static gboolean
+handle_set_property (GDBusConnection  *connection,
+                     const gchar      *sender,
+                     const gchar      *object_path,
+                     const gchar      *interface_name,
+                     const gchar      *property_name,
+                     GVariant         *value,
+                     GError          **error,
+                     gpointer          user_data)
+{
+  return FALSE;
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+  handle_method_call,
+  handle_get_property,
+  handle_set_property,
+  { 0 }
+};
+
+static GVariant*
+handle_metrics_get_property (GDBusConnection  *connection,
+                             const gchar      *sender,
+                             const gchar      *object_path,
+                             const gchar      *interface_name,
+                             const gchar      *property_name,
+                             GError          **error,
+                             gpointer          user_data)
+{
+  YggWorker *self = YGG_WORKER (user_data);
+
+  if (g_strcmp0 (property_name, "Metrics") == 0) {
+    return ygg_worker_get_metrics (self);
+  }
+
+  return NULL;
+}
+
+static const GDBusInterfaceVTable metrics_interface_vtable = {
+  NULL,
+  handle_metrics_get_property,
+  NULL,
+  { 0 }
+};
+
+static void
+handle_signal (GDBusConnection *connection,
+               const gchar     *sender_name,
+               const gchar     *object_path,
+               const gchar     *interface_name,
+               const gchar     *signal_name,
+               GVariant        *parameters,
+               gpointer         user_data)
+{
+  YggWorker *self = YGG_WORKER (user_data);
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  if (ygg_log_debug_enabled ()) {
+    g_autofree gchar *print_params = ygg_log_print_variant (parameters);
+    g_debug ("received %s signal with parameters: %s", signal_name, print_params);
+  }
+
+  YggDispatcherEvent event;
+  g_variant_get (parameters, "(u)", &event);
+
+  if (event == YGG_DISPATCHER_EVENT_CONNECTION_RESTORED) {
+    priv->dispatcher_offline = FALSE;
+    if (priv->spool != NULL) {
+      worker_spool_drain (self);
+    }
+  } else if (event == YGG_DISPATCHER_EVENT_UNEXPECTED_DISCONNECT ||
+             event == YGG_DISPATCHER_EVENT_RECEIVED_DISCONNECT) {
+    priv->dispatcher_offline = TRUE;
+  }
+
+  if (priv->event_func)
+    priv->event_func (event, priv->event_func_user_data);
+}
+
+/**
+ * worker_disconnect:
+ * @worker: A #YggWorker.
+ *
+ * Stops owning the worker's name, unexports its objects, stops listening for
+ * the dispatcher and forgets the bus connection, so that the worker can be
+ * connected again.
+ */
+static void
+worker_disconnect (YggWorker *self)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  if (priv->bus_id != 0) {
+    g_bus_unown_name (priv->bus_id);
+    priv->bus_id = 0;
+  }
+
+  if (priv->dispatcher_watch_id != 0) {
+    g_bus_unwatch_name (priv->dispatcher_watch_id);
+    priv->dispatcher_watch_id = 0;
+  }
+
+  if (priv->dispatcher_proxy_cancellable != NULL) {
+    g_cancellable_cancel (priv->dispatcher_proxy_cancellable);
+    g_clear_object (&priv->dispatcher_proxy_cancellable);
+  }
+  g_clear_object (&priv->dispatcher_proxy);
+
+  g_mutex_lock (&priv->lock);
+  GDBusConnection *connection = g_steal_pointer (&priv->connection);
+  g_mutex_unlock (&priv->lock);
+
+  if (connection != NULL) {
+    if (priv->signal_subscription_id != 0) {
+      g_dbus_connection_signal_unsubscribe (connection, priv->signal_subscription_id);
+      priv->signal_subscription_id = 0;
+    }
+    if (priv->registration_id != 0) {
+      g_dbus_connection_unregister_object (connection, priv->registration_id);
+      priv->registration_id = 0;
+    }
+    if (priv->metrics_registration_id != 0) {
+      g_dbus_connection_unregister_object (connection, priv->metrics_registration_id);
+      priv->metrics_registration_id = 0;
+    }
+    g_object_unref (connection);
+  }
+}
+
+/**
+ * worker_connect_complete:
+ * @worker: A #YggWorker.
+ * @error: (transfer full) (nullable): Why connecting failed, or %NULL.
+ *
+ * Finishes connecting the worker to the bus. If @error is set, the worker is
+ * disconnected with worker_disconnect() and @error is returned to the caller of
+ * ygg_worker_connect_async(), or logged if the worker was connected with
+ * ygg_worker_connect().
+ */
+static void
+worker_connect_complete (YggWorker *self,
+                         GError    *error)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  g_autoptr (GTask) task = g_steal_pointer (&priv->connect_task);
+
+  if (priv->connect_cancelled_source != NULL) {
+    g_source_destroy (priv->connect_cancelled_source);
+    g_clear_pointer (&priv->connect_cancelled_source, g_source_unref);
+  }
+
+  if (error != NULL) {
+    worker_disconnect (self);
+  }
+
+  if (task != NULL) {
+    if (error != NULL) {
+      g_task_return_error (task, error);
+    } else {
+      g_task_return_boolean (task, TRUE);
+    }
+  } else if (error != NULL) {
+    g_critical ("%s", error->message);
+    g_error_free (error);
+  }
+}
+
+static gboolean
+on_connect_cancelled (GCancellable *cancellable,
+                      gpointer      user_data)
+{
+  YggWorker *self = YGG_WORKER (user_data);
+  GError *err = NULL;
+
+  g_cancellable_set_error_if_cancelled (cancellable, &err);
+  worker_connect_complete (self, err);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+on_bus_acquired (GDBusConnection *connection,
+                 const gchar     *name,
+                 gpointer         user_data)
+{
+  YggWorker *self = YGG_WORKER (user_data);
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  GDBusInterfaceInfo *interface_info = g_dbus_node_info_lookup_interface (worker_node_info, "com.redhat.Yggdrasil1.Worker1");
+  g_assert (interface_info);
+
+  GError *err = NULL;
+  guint registration_id = g_dbus_connection_register_object (connection,
+                                                             priv->object_path,
                                                              interface_info,
                                                              &interface_vtable,
                                                              user_data,
                                                              NULL,
                                                              &err);
-  if (registration_id <= 0) {
-    g_error ("%s", err->message);
+  if (registration_id == 0) {
+    g_prefix_error (&err, "unable to export %s: ", priv->object_path);
+    worker_connect_complete (self, err);
+    return;
+  }
+
+  priv->metrics_registration_id = g_dbus_connection_register_object (connection,
+                                                                     priv->object_path,
+                                                                     metrics_node_info->interfaces[0],
+                                                                     &metrics_interface_vtable,
+                                                                     user_data,
+                                                                     NULL,
+                                                                     &err);
+  if (priv->metrics_registration_id == 0) {
+    g_critical ("unable to export metrics: %s", err->message);
+    g_clear_error (&err);
+  }
+
+  g_mutex_lock (&priv->lock);
+  g_clear_object (&priv->connection);
+  priv->connection = g_object_ref (connection);
+  worker_flush_pending_signals (self);
+  g_mutex_unlock (&priv->lock);
+  priv->registration_id = registration_id;
+
+  priv->signal_subscription_id = g_dbus_connection_signal_subscribe (connection,
+                                                                     "com.redhat.Yggdrasil1.Dispatcher1",
+                                                                     "com.redhat.Yggdrasil1.Dispatcher1",
+                                                                     "Event",
+                                                                     "/com/redhat/Yggdrasil1/Dispatcher1",
+                                                                     NULL,
+                                                                     G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                     handle_signal,
+                                                                     self,
+                                                                     NULL);
+
+  if (priv->dispatcher_watch_id == 0) {
+    priv->dispatcher_watch_id = g_bus_watch_name_on_connection (connection,
+                                                                "com.redhat.Yggdrasil1.Dispatcher1",
+                                                                G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                                on_dispatcher_appeared,
+                                                                on_dispatcher_vanished,
+                                                                self,
+                                                                NULL);
+  }
+
+  dispatcher_proxy_ensure (self);
+}
+
+static void
+on_name_acquired (GDBusConnection *connection,
+                  const gchar     *name,
+                  gpointer         user_data)
+{
+  YggWorker *self = YGG_WORKER (user_data);
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  g_mutex_lock (&priv->lock);
+  if (priv->time_to_ready == 0) {
+    priv->time_to_ready = g_get_monotonic_time () - priv->connect_started;
+  }
+  g_debug ("acquired name %s after %" G_GINT64_FORMAT "us", name, priv->time_to_ready);
+  g_mutex_unlock (&priv->lock);
+
+  worker_connect_complete (self, NULL);
+}
+
+static void
+on_name_lost (GDBusConnection *connection,
+              const gchar     *name,
+              gpointer         user_data)
+{
+  YggWorker *self = YGG_WORKER (user_data);
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  g_debug ("lost name %s", name);
+
+  if (priv->connect_task != NULL) {
+    GError *err = NULL;
+    if (connection == NULL) {
+      err = g_error_new (YGG_WORKER_ERROR, YGG_WORKER_ERROR_CONNECT_FAILED,
+                         "unable to connect to the bus");
+    } else {
+      err = g_error_new (YGG_WORKER_ERROR, YGG_WORKER_ERROR_CONNECT_FAILED,
+                         "unable to own name %s", name);
+    }
+    worker_connect_complete (self, err);
+  }
+}
+
+/**
+ * ygg_worker_new: (constructor)
+ * @directive: (transfer none): The worker directive name.
+ * @remote_content: The worker requires content from a remote URL.
+ * @features: (transfer none) (nullable): An initial table of values to use as
+ * the worker's features map.
+ *
+ * Creates a new #YggWorker instance.
+ *
+ * Returns: (transfer full): A new #YggWorker instance.
+ */
+YggWorker *
+ygg_worker_new (const gchar *directive,
+                gboolean     remote_content,
+                YggMetadata *features)
+{
+  return g_object_new (YGG_TYPE_WORKER,
+                       "directive", directive,
+                       "remote-content", remote_content,
+                       "features", features,
+                       NULL);
+}
+
+/**
+ * journal_replay_entry:
+ * @entry: A pending #YggJournalEntry.
+ * @value: The message recorded by @entry.
+ * @user_data: A #YggWorker.
+ *
+ * A #YggJournalFunc that queues a message recovered from the worker's journal
+ * as if it had just been dispatched.
+ */
+static void
+journal_replay_entry (YggJournalEntry *entry,
+                      GVariant        *value,
+                      gpointer         user_data)
+{
+  YggWorker *self = YGG_WORKER (user_data);
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  GError *err = NULL;
+
+  YggMessage *msg = ygg_message_new_from_variant (self, priv->message_pool, value, &err);
+  if (err != NULL) {
+    g_warning ("unable to replay journaled message: %s", err->message);
+    g_error_free (err);
+    ygg_journal_complete (priv->journal, entry);
+    return;
+  }
+  g_debug ("replaying journaled message %s", msg->id);
+  msg->timestamp = g_get_monotonic_time ();
+  msg->journal_entry = entry;
+  worker_queue_message (self, msg);
+}
+
+/**
+ * worker_open_journal:
+ * @worker: A #YggWorker.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Opens the journal in #YggWorker:journal-directory, if one is set, and queues
+ * the messages that were still pending in it.
+ *
+ * Returns: %TRUE on success, or %FALSE on error.
+ */
+static gboolean
+worker_open_journal (YggWorker  *self,
+                     GError    **error)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  if (priv->journal_directory == NULL || priv->journal != NULL) {
+    return TRUE;
+  }
+
+  if (g_mkdir_with_parents (priv->journal_directory, 0700) < 0) {
+    int saved_errno = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                 "unable to create %s: %s", priv->journal_directory, g_strerror (saved_errno));
+    return FALSE;
+  }
+
+  g_autofree gchar *name = g_strconcat (priv->directive, ".journal", NULL);
+  g_autofree gchar *path = g_build_filename (priv->journal_directory, name, NULL);
+  priv->journal = ygg_journal_open (path, WORKER_JOURNAL_DEDUP_SIZE, priv->journal_sync, error);
+  if (priv->journal == NULL) {
+    return FALSE;
+  }
+  ygg_journal_foreach_pending (priv->journal, journal_replay_entry, self);
+
+  return TRUE;
+}
+
+/**
+ * worker_own_name:
+ * @worker: A #YggWorker.
+ * @error: (nullable): Return location for a #GError or NULL.
+ *
+ * Validates the worker's directive and begins owning its name on the bus. The
+ * object is exported in on_bus_acquired() and the worker is ready once
+ * on_name_acquired() is invoked.
+ *
+ * Returns: %TRUE if owning the name was started.
+ */
+static gboolean
+worker_own_name (YggWorker  *self,
+                 GError    **error)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  g_assert (priv->rx_func != NULL || priv->message_rx_func != NULL);
+
+  if (g_regex_match_simple ("-", priv->directive, 0, 0)) {
+    if (error != NULL) {
+      *error = g_error_new (YGG_WORKER_ERROR,
+                            YGG_WORKER_ERROR_INVALID_DIRECTIVE,
+                            "%s is not a valid directive",
+                            priv->directive);
+    }
+    return FALSE;
+  }
+
+  if (priv->bus_id != 0) {
+    g_set_error (error, YGG_WORKER_ERROR, YGG_WORKER_ERROR_CONNECT_FAILED,
+                 "%s is already connected", priv->directive);
+    return FALSE;
+  }
+
+  if (!worker_open_journal (self, error)) {
+    return FALSE;
+  }
+
+  g_free (priv->object_path);
+  priv->object_path = g_strjoin ("/", "/com/redhat/Yggdrasil1/Worker1", priv->directive, NULL);
+  g_free (priv->bus_name);
+  priv->bus_name = g_strjoin (".", "com.redhat.Yggdrasil1.Worker1", priv->directive, NULL);
+
+  priv->connect_started = g_get_monotonic_time ();
+  priv->bus_id = g_bus_own_name (G_BUS_TYPE_STARTER,
+                                 priv->bus_name,
+                                 G_BUS_NAME_OWNER_FLAGS_NONE,
+                                 on_bus_acquired,
+                                 on_name_acquired,
+                                 on_name_lost,
+                                 self,
+                                 NULL);
+
+  return TRUE;
+}
+
+/**
+ * ygg_worker_connect:
+ * @worker: A #YggWorker.
+ * @error: (nullable): Return location for a #GError or NULL.
+ *
+ * Connects a given #YggWorker to either a system or session D-Bus connection.
+ * It then exports itself onto the bus, implementing the
+ * com.redhat.Yggdrasil1.Worker1 interface.
+ *
+ * This function returns before the worker is exported and owns its name. Use
+ * ygg_worker_connect_async() to find out when the worker is ready.
+ *
+ * Returns: TRUE if the connection to the bus was successful. If FALSE and
+ * @error is not NULL, @error will be set.
+ */
+gboolean
+ygg_worker_connect (YggWorker *self, GError **error)
+{
+  return worker_own_name (self, error);
+}
+
+/**
+ * ygg_worker_connect_async:
+ * @worker: A #YggWorker.
+ * @cancellable: (nullable): a #GCancellable or %NULL.
+ * @callback: (scope async): A #GAsyncReadyCallback to be invoked when the
+ * worker is ready or connecting failed.
+ * @user_data: (nullable): optional data passed into @callback.
+ *
+ * Connects @worker to the bus like ygg_worker_connect(), but completes only
+ * once the worker has exported the com.redhat.Yggdrasil1.Worker1 interface
+ * and owns its name, so that the dispatcher can reach it. Call
+ * ygg_worker_connect_finish() to get the result.
+ *
+ * If exporting the object or owning the name fails, or @cancellable is
+ * cancelled first, the worker releases its name and the operation fails.
+ * The time it took to become ready is available as "time-to-ready-us" in
+ * ygg_worker_get_metrics().
+ */
+void
+ygg_worker_connect_async (YggWorker           *self,
+                          GCancellable        *cancellable,
+                          GAsyncReadyCallback  callback,
+                          gpointer             user_data)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  g_autoptr (GTask) task = g_task_new (self, cancellable, callback, user_data);
+  GError *err = NULL;
+
+  g_task_set_source_tag (task, ygg_worker_connect_async);
+
+  if (g_task_return_error_if_cancelled (task)) {
+    return;
+  }
+
+  if (!worker_own_name (self, &err)) {
+    g_task_return_error (task, err);
+    return;
+  }
+
+  priv->connect_task = g_steal_pointer (&task);
+
+  if (cancellable != NULL) {
+    priv->connect_cancelled_source = g_cancellable_source_new (cancellable);
+    g_source_set_callback (priv->connect_cancelled_source,
+                           (GSourceFunc) on_connect_cancelled,
+                           self,
+                           NULL);
+    g_source_attach (priv->connect_cancelled_source, g_task_get_context (priv->connect_task));
+  }
+}
+
+/**
+ * ygg_worker_connect_finish:
+ * @worker: A #YggWorker.
+ * @res: A #GAsyncResult.
+ * @error: (out) (nullable): The return location for a recoverable error.
+ *
+ * Finishes connecting the worker started with ygg_worker_connect_async().
+ *
+ * Returns: %TRUE if the worker is exported and owns its name.
+ */
+gboolean
+ygg_worker_connect_finish (YggWorker     *self,
+                           GAsyncResult  *res,
+                           GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, self), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+/**
+ * transmit_response_parse:
+ * @response: A "(ia{ss}ay)" #GVariant returned by
+ * com.redhat.Yggdrasil1.Dispatcher1.Transmit.
+ * @response_code: (out): Return location for the response code.
+ * @response_metadata: (out): Return location for the response metadata.
+ * @response_data: (out): Return location for the response data.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Unpacks the return value of a Transmit call.
+ *
+ * Returns: %TRUE if @response_code is not negative, %FALSE otherwise.
+ */
+static gboolean
+transmit_response_parse (GVariant     *response,
+                         gint         *response_code,
+                         YggMetadata **response_metadata,
+                         GBytes      **response_data,
+                         GError      **error)
+{
+  GError *err = NULL;
+
+  if (ygg_log_debug_enabled ()) {
+    g_autofree gchar *printed_variant = ygg_log_print_variant (response);
+    g_debug ("%s", printed_variant);
+  }
+
+  GVariantIter iter;
+  g_variant_iter_init (&iter, response);
+  g_variant_iter_next (&iter, "i", response_code);
+
+  g_assert_null (err);
+  g_autoptr (GVariant) metadata_value = g_variant_iter_next_value (&iter);
+  *response_metadata = ygg_metadata_new_from_variant (metadata_value, &err);
+  if (err != NULL && error != NULL) {
+    g_propagate_error (error, err);
+    return FALSE;
+  }
+
+  g_autoptr (GVariant) data_value = g_variant_iter_next_value (&iter);
+  *response_data = g_variant_get_data_as_bytes (data_value);
+
+  return *response_code >= 0;
+}
+
+/**
+ * ygg_worker_transmit_finish:
+ * @worker: A #YggWorker instance.
+ * @res: A #GAsyncResult.
+ * @response_code: (out): An integer status code.
+ * @response_metadata: (out): A map of key/value pairs.
+ * @response_data: (out): Data received in response to the transmit.
+ * @error: (out) (nullable): The return location for a recoverable error.
+ *
+ * Finishes transmitting the data started with ygg_worker_transmit().
+ *
+ * Returns: A %TRUE on success, %FALSE on error.
+ */
+gboolean
+ygg_worker_transmit_finish (YggWorker     *self,
+                            GAsyncResult  *res,
+                            gint          *response_code,
+                            YggMetadata  **response_metadata,
+                            GBytes       **response_data,
+                            GError       **error)
+{
+  g_debug ("ygg_worker_transmit_finish");
+  g_return_val_if_fail (g_task_is_valid (res, self), FALSE);
+  GTask *task = G_TASK (res);
+  GError *err = NULL;
+
+  g_autoptr (GVariant) response = g_task_propagate_pointer (task, &err);
+  if (err != NULL) {
+    g_propagate_error (error, err);
+    return FALSE;
+  }
+
+  return transmit_response_parse (response, response_code, response_metadata, response_data, error);
+}
+
+/**
+ * ygg_worker_transmit:
+ * @worker: A #YggWorker.
+ * @addr: (transfer none): destination address of the data to be transmitted.
+ * @id: (transfer none): a UUID.
+ * @response_to: (transfer none) (nullable): a UUID the data is in response to
+ * or %NULL.
+ * @metadata: (transfer none) (nullable): Key-value pairs associated with the
+ * data or %NULL.
+ * @data: (transfer none): the data.
+ * @cancellable: (nullable): a #GCancellable or %NULL.
+ * @callback: (scope async): A #GAsyncReadyCallback to be invoked when the task is complete.
+ * @user_data: (nullable): optional data passed into @callback.
+ *
+ * Invokes the com.redhat.Yggdrasil1.Dispatcher1.Transmit D-Bus method
+ * asynchronously. To receive the response from the D-Bus method, call
+ * ygg_worker_transmit_finish().
+ */
+void
+ygg_worker_transmit (YggWorker           *self,
+                     gchar               *addr,
+                     gchar               *id,
+                     gchar               *response_to,
+                     YggMetadata         *metadata,
+                     GBytes              *data,
+                     GCancellable        *cancellable,
+                     GAsyncReadyCallback  callback,
+                     gpointer             user_data)
+{
+  g_debug ("ygg_worker_transmit");
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+  YggMessage *message = ygg_message_new (self,
+                                         priv->message_pool,
+                                         addr,
+                                         id,
+                                         response_to,
+                                         metadata,
+                                         data);
+  /* Spooled transmits are kept in the order they were requested */
+  message->sequence = (guint) g_atomic_int_add (&priv->transmit_sequence, 1);
+  g_task_set_task_data (task, message, (GDestroyNotify) ygg_message_unref);
+  GSource *source = g_idle_source_new ();
+  g_task_attach_source (task, source, invoke_tx);
+  g_source_unref (source);
+}
+
+/**
+ * ygg_transmit_result_free:
+ * @result: (transfer full): A #YggTransmitResult.
+ *
+ * Frees @result and the values it holds.
+ */
+void
+ygg_transmit_result_free (YggTransmitResult *result)
+{
+  g_clear_object (&result->response_metadata);
+  g_clear_pointer (&result->response_data, g_bytes_unref);
+  g_clear_error (&result->error);
+  g_free (result);
+}
+
+typedef struct {
+  GPtrArray *messages;
+  GPtrArray *results;
+  guint      max_in_flight;
+  guint      next;
+  guint      in_flight;
+  guint      completed;
+} TransmitBatch;
+
+typedef struct {
+  GTask *task;
+  guint  index;
+} TransmitBatchCall;
+
+static void
+transmit_batch_free (TransmitBatch *batch)
+{
+  g_ptr_array_unref (batch->messages);
+  g_ptr_array_unref (batch->results);
+  g_free (batch);
+}
+
+static void transmit_batch_launch (GTask *task);
+
+static void
+transmit_batch_call_done (GObject      *source_object,
+                          GAsyncResult *result,
+                          gpointer      user_data)
+{
+  TransmitBatchCall *call = (TransmitBatchCall *) user_data;
+  GTask *task = call->task;
+  TransmitBatch *batch = (TransmitBatch *) g_task_get_task_data (task);
+  YggTransmitResult *item_result = g_ptr_array_index (batch->results, call->index);
+  GError *err = NULL;
+
+  g_autoptr (GVariant) response = dispatcher_call_transmit_finish (source_object, result, &err);
+  worker_record_transmit_done (YGG_WORKER (g_task_get_source_object (task)),
+                               g_ptr_array_index (batch->messages, call->index),
+                               err);
+  if (err == NULL) {
+    transmit_response_parse (response,
+                             &item_result->response_code,
+                             &item_result->response_metadata,
+                             &item_result->response_data,
+                             &err);
+  }
+  if (err != NULL) {
+    item_result->response_code = -1;
+    item_result->error = err;
+  }
+  g_free (call);
+
+  batch->in_flight--;
+  batch->completed++;
+
+  if (batch->completed == batch->messages->len) {
+    g_task_return_pointer (task, g_ptr_array_ref (batch->results), (GDestroyNotify) g_ptr_array_unref);
+    g_object_unref (task);
+    return;
+  }
+
+  transmit_batch_launch (task);
+}
+
+/**
+ * transmit_batch_launch:
+ * @task: The #GTask of a batch.
+ *
+ * Issues Transmit calls for the next messages of the batch until the batch's
+ * limit of calls in flight is reached. Calls are pipelined: each is issued
+ * without waiting for the replies to earlier calls.
+ */
+static void
+transmit_batch_launch (GTask *task)
+{
+  YggWorker *self = YGG_WORKER (g_task_get_source_object (task));
+  TransmitBatch *batch = (TransmitBatch *) g_task_get_task_data (task);
+
+  while (batch->next < batch->messages->len && batch->in_flight < batch->max_in_flight) {
+    TransmitBatchCall *call = g_new0 (TransmitBatchCall, 1);
+    call->task = task;
+    call->index = batch->next++;
+    batch->in_flight++;
+
+    YggMessage *message = g_ptr_array_index (batch->messages, call->index);
+    worker_record_transmit (self, message);
+    dispatcher_call_transmit (self,
+                              ygg_message_to_variant (message),
+                              g_task_get_cancellable (task),
+                              transmit_batch_call_done,
+                              call);
+  }
+}
+
+static gboolean
+invoke_tx_batch (gpointer user_data)
+{
+  GTask *task = G_TASK (user_data);
+  TransmitBatch *batch = (TransmitBatch *) g_task_get_task_data (task);
+
+  if (batch->messages->len == 0) {
+    g_task_return_pointer (task, g_ptr_array_ref (batch->results), (GDestroyNotify) g_ptr_array_unref);
+    g_object_unref (task);
+    return G_SOURCE_REMOVE;
+  }
+
+  transmit_batch_launch (task);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * ygg_worker_transmit_batch:
+ * @worker: A #YggWorker.
+ * @items: (array length=n_items): The messages to transmit.
+ * @n_items: The number of elements in @items.
+ * @max_in_flight: The maximum number of Transmit calls awaiting a reply at
+ * any time, or 0 for no limit.
+ * @cancellable: (nullable): a #GCancellable or %NULL.
+ * @callback: (scope async): A #GAsyncReadyCallback to be invoked when every
+ * message has been transmitted.
+ * @user_data: (nullable): optional data passed into @callback.
+ *
+ * Invokes the com.redhat.Yggdrasil1.Dispatcher1.Transmit D-Bus method for each
+ * of @items. The calls are pipelined, without waiting for the reply to one
+ * call before issuing the next, up to @max_in_flight calls at a time. The
+ * values in @items are copied, so @items may be freed once this function
+ * returns. To receive the result for each message, call
+ * ygg_worker_transmit_batch_finish().
+ *
+ * Batched messages are not spooled. While the dispatcher reports that it is
+ * disconnected, the batch fails with %G_IO_ERROR_NOT_CONNECTED without
+ * transmitting any message.
+ */
+void
+ygg_worker_transmit_batch (YggWorker             *self,
+                           const YggTransmitItem *items,
+                           guint                  n_items,
+                           guint                  max_in_flight,
+                           GCancellable          *cancellable,
+                           GAsyncReadyCallback    callback,
+                           gpointer               user_data)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+
+  if (priv->dispatcher_offline) {
+    g_task_return_new_error (task,
+                             G_IO_ERROR,
+                             G_IO_ERROR_NOT_CONNECTED,
+                             "the dispatcher is disconnected");
+    g_object_unref (task);
+    return;
+  }
+
+  TransmitBatch *batch = g_new0 (TransmitBatch, 1);
+
+  batch->messages = g_ptr_array_new_full (n_items, (GDestroyNotify) ygg_message_unref);
+  batch->results = g_ptr_array_new_full (n_items, (GDestroyNotify) ygg_transmit_result_free);
+  batch->max_in_flight = max_in_flight > 0 ? max_in_flight : G_MAXUINT;
+
+  for (guint i = 0; i < n_items; i++) {
+    g_ptr_array_add (batch->messages, ygg_message_new (self,
+                                                       priv->message_pool,
+                                                       items[i].addr,
+                                                       items[i].id,
+                                                       items[i].response_to,
+                                                       items[i].metadata,
+                                                       items[i].data));
+    g_ptr_array_add (batch->results, g_new0 (YggTransmitResult, 1));
+  }
+
+  g_task_set_task_data (task, batch, (GDestroyNotify) transmit_batch_free);
+  GSource *source = g_idle_source_new ();
+  g_task_attach_source (task, source, invoke_tx_batch);
+  g_source_unref (source);
+}
+
+/**
+ * ygg_worker_transmit_batch_finish:
+ * @worker: A #YggWorker instance.
+ * @res: A #GAsyncResult.
+ * @error: (nullable): The return location for a recoverable error.
+ *
+ * Finishes transmitting the messages started with
+ * ygg_worker_transmit_batch(). The result for each message is at the same
+ * index as the message was in the items passed to
+ * ygg_worker_transmit_batch(). A message failed to transmit if its
+ * #YggTransmitResult has a negative response code; in that case its error
+ * field may hold the reason.
+ *
+ * Returns: (transfer full) (element-type YggTransmitResult): The result for
+ * each message, or %NULL on error. The results are freed along with the
+ * array.
+ */
+GPtrArray *
+ygg_worker_transmit_batch_finish (YggWorker     *self,
+                                  GAsyncResult  *res,
+                                  GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, self), NULL);
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+
+typedef struct {
+  gchar        *addr;
+  gchar        *id;
+  gchar        *response_to;
+  YggMetadata  *metadata;
+  GInputStream *stream;
+  gsize         chunk_size;
+  GBytes       *pending;
+  guint         sequence;
+  guint64       offset;
+  gint64        total_size;
+  gboolean      eof;
+  YggMessage   *chunk;
+} TransmitStream;
+
+static void
+transmit_stream_free (TransmitStream *transmit)
+{
+  g_free (transmit->addr);
+  g_free (transmit->id);
+  g_free (transmit->response_to);
+  g_clear_object (&transmit->metadata);
+  g_clear_object (&transmit->stream);
+  g_clear_pointer (&transmit->pending, g_bytes_unref);
+  g_clear_pointer (&transmit->chunk, ygg_message_unref);
+  g_free (transmit);
+}
+
+static void
+metadata_foreach_copy (const gchar *key,
+                       const gchar *value,
+                       gpointer     user_data)
+{
+  ygg_metadata_set (YGG_METADATA (user_data), key, value);
+}
+
+static void transmit_stream_read (GTask *task);
+
+static void
+transmit_stream_chunk_done (GObject      *source_object,
+                            GAsyncResult *result,
+                            gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+  TransmitStream *transmit = (TransmitStream *) g_task_get_task_data (task);
+  GError *err = NULL;
+
+  g_autoptr (GVariant) response = dispatcher_call_transmit_finish (source_object, result, &err);
+  worker_record_transmit_done (YGG_WORKER (g_task_get_source_object (task)), transmit->chunk, err);
+  g_clear_pointer (&transmit->chunk, ygg_message_unref);
+  if (err != NULL) {
+    g_task_return_error (task, err);
+    g_object_unref (task);
+    return;
+  }
+
+  gint response_code = 0;
+  g_variant_get_child (response, 0, "i", &response_code);
+  if (response_code < 0) {
+    g_task_return_new_error (task,
+                             YGG_WORKER_ERROR,
+                             YGG_WORKER_ERROR_TRANSMIT_FAILED,
+                             "dispatcher rejected chunk %u of stream %s with response code %i",
+                             transmit->sequence - 1,
+                             transmit->id,
+                             response_code);
+    g_object_unref (task);
+    return;
+  }
+
+  if (transmit->eof) {
+    g_task_return_boolean (task, TRUE);
+    g_object_unref (task);
+    return;
+  }
+
+  transmit_stream_read (task);
+}
+
+/**
+ * transmit_stream_send:
+ * @task: The #GTask of a stream transmit.
+ * @final: Whether this is the last chunk of the stream.
+ *
+ * Transmits the stream's pending chunk as a message of its own, tagged with
+ * the chunk metadata keys.
+ */
+static void
+transmit_stream_send (GTask    *task,
+                      gboolean  final)
+{
+  YggWorker *self = YGG_WORKER (g_task_get_source_object (task));
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  TransmitStream *transmit = (TransmitStream *) g_task_get_task_data (task);
+
+  g_autoptr (GBytes) chunk = transmit->pending != NULL ? g_steal_pointer (&transmit->pending) : g_bytes_new (NULL, 0);
+  transmit->offset += g_bytes_get_size (chunk);
+
+  g_autoptr (YggMetadata) metadata = ygg_metadata_new ();
+  if (transmit->metadata != NULL) {
+    ygg_metadata_foreach (transmit->metadata, metadata_foreach_copy, metadata);
+  }
+  g_autofree gchar *sequence = g_strdup_printf ("%u", transmit->sequence++);
+  ygg_metadata_set (metadata, YGG_WORKER_CHUNK_STREAM_ID, transmit->id);
+  ygg_metadata_set (metadata, YGG_WORKER_CHUNK_SEQUENCE, sequence);
+  if (transmit->total_size >= 0 || final) {
+    guint64 total_size = transmit->total_size >= 0 ? (guint64) transmit->total_size : transmit->offset;
+    g_autofree gchar *size = g_strdup_printf ("%" G_GUINT64_FORMAT, total_size);
+    ygg_metadata_set (metadata, YGG_WORKER_CHUNK_TOTAL_SIZE, size);
+  }
+  if (final) {
+    ygg_metadata_set (metadata, YGG_WORKER_CHUNK_FINAL, "true");
   }
 
-  g_dbus_connection_signal_subscribe (connection,
-                                      "com.redhat.Yggdrasil1.Dispatcher1",
-                                      "com.redhat.Yggdrasil1.Dispatcher1",
-                                      "Event",
-                                      "/com/redhat/Yggdrasil1/Dispatcher1",
-                                      NULL,
-                                      G_DBUS_SIGNAL_FLAGS_NONE,
-                                      handle_signal,
-                                      self,
-                                      NULL);
+  g_autofree gchar *chunk_id = g_uuid_string_random ();
+  YggMessage *message = ygg_message_new (self,
+                                         priv->message_pool,
+                                         transmit->addr,
+                                         chunk_id,
+                                         transmit->response_to,
+                                         metadata,
+                                         chunk);
+  worker_record_transmit (self, message);
+  transmit->chunk = message;
+  dispatcher_call_transmit (self,
+                            ygg_message_to_variant (message),
+                            g_task_get_cancellable (task),
+                            transmit_stream_chunk_done,
+                            task);
 }
 
 static void
-on_name_acquired (GDBusConnection *connection,
-                  const gchar     *name,
-                  gpointer         user_data)
+transmit_stream_read_done (GObject      *source_object,
+                           GAsyncResult *result,
+                           gpointer      user_data)
 {
-  g_debug ("acquired name %s", name);
+  GTask *task = G_TASK (user_data);
+  TransmitStream *transmit = (TransmitStream *) g_task_get_task_data (task);
+  GError *err = NULL;
+
+  GBytes *chunk = g_input_stream_read_bytes_finish (G_INPUT_STREAM (source_object), result, &err);
+  if (err != NULL) {
+    g_task_return_error (task, err);
+    g_object_unref (task);
+    return;
+  }
+
+  if (g_bytes_get_size (chunk) == 0) {
+    /* End of stream: whatever is pending is the final chunk. */
+    g_bytes_unref (chunk);
+    transmit->eof = TRUE;
+    transmit_stream_send (task, TRUE);
+    return;
+  }
+
+  if (transmit->pending == NULL) {
+    /* First chunk: read ahead to learn whether it is also the last one. */
+    transmit->pending = chunk;
+    transmit_stream_read (task);
+    return;
+  }
+
+  transmit_stream_send (task, FALSE);
+  transmit->pending = chunk;
 }
 
 static void
-on_name_lost (GDBusConnection *connection,
-              const gchar     *name,
-              gpointer         user_data)
+transmit_stream_read (GTask *task)
 {
-  g_debug ("lost name %s", name);
+  TransmitStream *transmit = (TransmitStream *) g_task_get_task_data (task);
+
+  g_input_stream_read_bytes_async (transmit->stream,
+                                   transmit->chunk_size,
+                                   G_PRIORITY_DEFAULT,
+                                   g_task_get_cancellable (task),
+                                   transmit_stream_read_done,
+                                   task);
 }
 
-/**
- * ygg_worker_new: (constructor)
- * @directive: (transfer none): The worker directive name.
- * @remote_content: The worker requires content from a remote URL.
- * @features: (transfer none) (nullable): An initial table of values to use as
- * the worker's features map.
- *
- * Creates a new #YggWorker instance.
- *
- * Returns: (transfer full): A new #YggWorker instance.
- */
-YggWorker *
-ygg_worker_new (const gchar *directive,
-                gboolean     remote_content,
-                YggMetadata *features)
+static gboolean
+invoke_tx_stream (gpointer user_data)
 {
-  return g_object_new (YGG_TYPE_WORKER,
-                       "directive", directive,
-                       "remote-content", remote_content,
-                       "features", features,
-                       NULL);
+  transmit_stream_read (G_TASK (user_data));
+
+  return G_SOURCE_REMOVE;
 }
 
 /**
- * ygg_worker_connect:
+ * ygg_worker_transmit_stream:
  * @worker: A #YggWorker.
- * @error: (nullable): Return location for a #GError or NULL.
+ * @addr: (transfer none): destination address of the data to be transmitted.
+ * @id: (transfer none): a UUID identifying the stream.
+ * @response_to: (transfer none) (nullable): a UUID the data is in response to
+ * or %NULL.
+ * @metadata: (transfer none) (nullable): Key-value pairs associated with the
+ * data or %NULL.
+ * @stream: (transfer none): a #GInputStream to read the data from.
+ * @chunk_size: the maximum size of each chunk, or 0 for
+ * %YGG_WORKER_DEFAULT_CHUNK_SIZE.
+ * @cancellable: (nullable): a #GCancellable or %NULL.
+ * @callback: (scope async): A #GAsyncReadyCallback to be invoked when the task is complete.
+ * @user_data: (nullable): optional data passed into @callback.
  *
- * Connects a given #YggWorker to either a system or session D-Bus connection.
- * It then exports itself onto the bus, implementing the
- * com.redhat.Yggdrasil1.Worker1 interface.
+ * Reads @stream until its end and transmits the data as a sequence of messages
+ * of at most @chunk_size bytes each, so that memory use does not depend on the
+ * size of the stream. Each chunk is sent with the
+ * com.redhat.Yggdrasil1.Dispatcher1.Transmit D-Bus method as a message with
+ * its own ID, carrying @metadata plus %YGG_WORKER_CHUNK_STREAM_ID (set to
+ * @id), %YGG_WORKER_CHUNK_SEQUENCE and %YGG_WORKER_CHUNK_TOTAL_SIZE. The last
+ * chunk also carries %YGG_WORKER_CHUNK_FINAL. The next chunk is only read
+ * once the previous one has been accepted by the dispatcher. To receive the
+ * result, call ygg_worker_transmit_stream_finish().
  *
- * Returns: TRUE if the connection to the bus was successful. If FALSE and
- * @error is not NULL, @error will be set.
+ * Chunks are not spooled. While the dispatcher reports that it is
+ * disconnected, the stream fails with %G_IO_ERROR_NOT_CONNECTED without
+ * reading from @stream.
  */
-gboolean
-ygg_worker_connect (YggWorker *self, GError **error)
+void
+ygg_worker_transmit_stream (YggWorker           *self,
+                            const gchar         *addr,
+                            const gchar         *id,
+                            const gchar         *response_to,
+                            YggMetadata         *metadata,
+                            GInputStream        *stream,
+                            gsize                chunk_size,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data)
 {
   YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
-  g_assert_nonnull (priv->rx_func);
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
 
-  if (g_regex_match_simple ("-", priv->directive, 0, 0)) {
-    if (error != NULL) {
-      *error = g_error_new (YGG_WORKER_ERROR,
-                            YGG_WORKER_ERROR_INVALID_DIRECTIVE,
-                            "%s is not a valid directive",
-                            priv->directive);
-    }
-    return FALSE;
+  if (priv->dispatcher_offline) {
+    g_task_return_new_error (task,
+                             G_IO_ERROR,
+                             G_IO_ERROR_NOT_CONNECTED,
+                             "the dispatcher is disconnected");
+    g_object_unref (task);
+    return;
   }
 
-  priv->object_path = g_strjoin ("/", "/com/redhat/Yggdrasil1/Worker1", priv->directive, NULL);
-  priv->bus_name = g_strjoin (".", "com.redhat.Yggdrasil1.Worker1", priv->directive, NULL);
+  TransmitStream *transmit = g_new0 (TransmitStream, 1);
 
-  priv->bus_id = g_bus_own_name (G_BUS_TYPE_STARTER,
-                                 priv->bus_name,
-                                 G_BUS_NAME_OWNER_FLAGS_NONE,
-                                 on_bus_acquired,
-                                 on_name_acquired,
-                                 on_name_lost,
-                                 self,
-                                 NULL);
+  transmit->addr = g_strdup (addr);
+  transmit->id = g_strdup (id);
+  transmit->response_to = g_strdup (response_to);
+  transmit->metadata = metadata != NULL ? g_object_ref (metadata) : NULL;
+  transmit->stream = g_object_ref (stream);
+  transmit->chunk_size = chunk_size > 0 ? chunk_size : YGG_WORKER_DEFAULT_CHUNK_SIZE;
+  transmit->total_size = -1;
 
-  return TRUE;
+  /* Announce the total size on every chunk when it can be determined. */
+  if (G_IS_SEEKABLE (stream) && g_seekable_can_seek (G_SEEKABLE (stream))) {
+    GSeekable *seekable = G_SEEKABLE (stream);
+    goffset position = g_seekable_tell (seekable);
+    if (g_seekable_seek (seekable, 0, G_SEEK_END, NULL, NULL)) {
+      transmit->total_size = g_seekable_tell (seekable) - position;
+      g_seekable_seek (seekable, position, G_SEEK_SET, NULL, NULL);
+    }
+  }
+
+  g_task_set_task_data (task, transmit, (GDestroyNotify) transmit_stream_free);
+  GSource *source = g_idle_source_new ();
+  g_task_attach_source (task, source, invoke_tx_stream);
+  g_source_unref (source);
 }
 
 /**
- * ygg_worker_transmit_finish:
+ * ygg_worker_transmit_stream_finish:
  * @worker: A #YggWorker instance.
  * @res: A #GAsyncResult.
- * @response_code: (out): An integer status code.
- * @response_metadata: (out): A map of key/value pairs.
- * @response_data: (out): Data received in response to the transmit.
- * @error: (out) (nullable): The return location for a recoverable error.
+ * @error: (nullable): The return location for a recoverable error.
  *
- * Finishes transmitting the data started with ygg_worker_transmit().
+ * Finishes transmitting the stream started with ygg_worker_transmit_stream().
  *
- * Returns: A %TRUE on success, %FALSE on error.
+ * Returns: %TRUE if every chunk was accepted by the dispatcher, %FALSE on
+ * error.
  */
 gboolean
-ygg_worker_transmit_finish (YggWorker     *self,
-                            GAsyncResult  *res,
-                            gint          *response_code,
-                            YggMetadata  **response_metadata,
-                            GBytes       **response_data,
-                            GError       **error)
+ygg_worker_transmit_stream_finish (YggWorker     *self,
+                                   GAsyncResult  *res,
+                                   GError       **error)
 {
-  g_debug ("ygg_worker_transmit_finish");
   g_return_val_if_fail (g_task_is_valid (res, self), FALSE);
-  GTask *task = G_TASK (res);
-  GError *err = NULL;
 
-  g_autoptr (GVariant) response = g_task_propagate_pointer (task, &err);
-  if (err != NULL && error != NULL) {
-    g_propagate_error (error, err);
-    return FALSE;
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+static gboolean
+on_request_timeout (gpointer user_data)
+{
+  GTask *task = G_TASK (user_data);
+  YggWorker *self = YGG_WORKER (g_task_get_source_object (task));
+  PendingRequest *request = (PendingRequest *) g_task_get_task_data (task);
+
+  GTask *taken = worker_request_take (self, request->id, task);
+  if (taken != NULL) {
+    worker_request_complete (taken,
+                             NULL,
+                             g_error_new (YGG_WORKER_ERROR,
+                                          YGG_WORKER_ERROR_TIMED_OUT,
+                                          "no reply to request %s within %u ms",
+                                          request->id,
+                                          request->timeout));
   }
-  g_object_unref (task);
 
-  g_autofree gchar *printed_variant = g_variant_print (response, TRUE);
-  g_debug ("%s", printed_variant);
+  return G_SOURCE_REMOVE;
+}
 
-  GVariantIter iter;
-  g_variant_iter_init (&iter, response);
-  g_variant_iter_next (&iter, "i", response_code);
+static gboolean
+on_request_cancelled (GCancellable *cancellable,
+                      gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+  YggWorker *self = YGG_WORKER (g_task_get_source_object (task));
+  PendingRequest *request = (PendingRequest *) g_task_get_task_data (task);
+  GError *err = NULL;
 
-  g_assert_null (err);
-  *response_metadata = ygg_metadata_new_from_variant (g_variant_iter_next_value(&iter), &err);
-  if (err != NULL && error != NULL) {
-    g_propagate_error (error, err);
-    return FALSE;
+  GTask *taken = worker_request_take (self, request->id, task);
+  if (taken != NULL) {
+    g_cancellable_set_error_if_cancelled (cancellable, &err);
+    worker_request_complete (taken, NULL, err);
   }
 
-  gsize len = 0;
-  gchar *data = g_variant_dup_bytestring (g_variant_iter_next_value (&iter), &len);
-  *response_data = g_bytes_new_take (data, len);
+  return G_SOURCE_REMOVE;
+}
 
-  return *response_code >= 0;
+static void
+request_transmit_done (GObject      *source_object,
+                       GAsyncResult *res,
+                       gpointer      user_data)
+{
+  YggWorker *self = YGG_WORKER (source_object);
+  GTask *task = G_TASK (user_data);
+  PendingRequest *request = (PendingRequest *) g_task_get_task_data (task);
+  gint response_code = 0;
+  g_autoptr (YggMetadata) response_metadata = NULL;
+  g_autoptr (GBytes) response_data = NULL;
+  GError *err = NULL;
+
+  if (!ygg_worker_transmit_finish (self, res, &response_code, &response_metadata, &response_data, &err)) {
+    if (err == NULL) {
+      err = g_error_new (YGG_WORKER_ERROR,
+                         YGG_WORKER_ERROR_TRANSMIT_FAILED,
+                         "dispatcher rejected request %s with response code %i",
+                         request->id,
+                         response_code);
+    }
+    GTask *taken = worker_request_take (self, request->id, task);
+    if (taken != NULL) {
+      worker_request_complete (taken, NULL, g_steal_pointer (&err));
+    }
+    g_clear_error (&err);
+  }
+
+  g_object_unref (task);
 }
 
 /**
- * ygg_worker_transmit:
+ * ygg_worker_request_async:
  * @worker: A #YggWorker.
- * @addr: (transfer none): destination address of the data to be transmitted.
- * @id: (transfer none): a UUID.
- * @response_to: (transfer none) (nullable): a UUID the data is in response to
- * or %NULL.
+ * @addr: (transfer none): destination address of the request.
+ * @id: (transfer none): a UUID identifying the request.
  * @metadata: (transfer none) (nullable): Key-value pairs associated with the
  * data or %NULL.
  * @data: (transfer none): the data.
+ * @timeout: The number of milliseconds to wait for a reply, or 0 to wait
+ * until @cancellable is cancelled.
  * @cancellable: (nullable): a #GCancellable or %NULL.
- * @callback: (scope async): A #GAsyncReadyCallback to be invoked when the task is complete.
+ * @callback: (scope async): A #GAsyncReadyCallback to be invoked when the
+ * reply arrives.
  * @user_data: (nullable): optional data passed into @callback.
  *
- * Invokes the com.redhat.Yggdrasil1.Dispatcher1.Transmit D-Bus method
- * asynchronously. To receive the response from the D-Bus method, call
- * ygg_worker_transmit_finish().
+ * Transmits a message as ygg_worker_transmit() does, then waits for a
+ * com.redhat.Yggdrasil1.Worker1.Dispatch call whose response_to is @id. The
+ * reply is delivered to @callback instead of the worker's rx function; call
+ * ygg_worker_request_finish() to get it.
+ *
+ * The request fails with %YGG_WORKER_ERROR_TIMED_OUT if no reply arrives
+ * within @timeout, and with %G_IO_ERROR_EXISTS if a request with @id is
+ * already waiting for its reply.
  */
 void
-ygg_worker_transmit (YggWorker           *self,
-                     gchar               *addr,
-                     gchar               *id,
-                     gchar               *response_to,
-                     YggMetadata         *metadata,
-                     GBytes              *data,
-                     GCancellable        *cancellable,
-                     GAsyncReadyCallback  callback,
-                     gpointer             user_data)
+ygg_worker_request_async (YggWorker           *self,
+                          const gchar         *addr,
+                          const gchar         *id,
+                          YggMetadata         *metadata,
+                          GBytes              *data,
+                          guint                timeout,
+                          GCancellable        *cancellable,
+                          GAsyncReadyCallback  callback,
+                          gpointer             user_data)
 {
-  g_debug ("ygg_worker_transmit");
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
   GTask *task = g_task_new (self, cancellable, callback, user_data);
-  Message *message = message_new (self,
-                                  addr,
-                                  id,
-                                  response_to,
-                                  metadata,
-                                  data);
-  g_task_set_task_data (task, message, (GDestroyNotify) message_free);
-  GSource *source = g_idle_source_new ();
-  g_task_attach_source (task, source, invoke_tx);
+  PendingRequest *request = g_new0 (PendingRequest, 1);
+
+  g_task_set_source_tag (task, ygg_worker_request_async);
+  request->id = g_strdup (id);
+  request->timeout = timeout;
+  g_task_set_task_data (task, request, (GDestroyNotify) pending_request_free);
+
+  if (g_task_return_error_if_cancelled (task)) {
+    g_object_unref (task);
+    return;
+  }
+
+  /* The reply may arrive before the transmit completes, so the request is
+   * registered first. */
+  g_mutex_lock (&priv->requests_lock);
+  if (g_hash_table_contains (priv->requests, id)) {
+    g_mutex_unlock (&priv->requests_lock);
+    g_task_return_new_error (task,
+                             G_IO_ERROR,
+                             G_IO_ERROR_EXISTS,
+                             "request %s is already waiting for a reply",
+                             id);
+    g_object_unref (task);
+    return;
+  }
+  if (timeout > 0) {
+    request->timeout_source = g_timeout_source_new (timeout);
+    g_task_attach_source (task, request->timeout_source, on_request_timeout);
+  }
+  if (cancellable != NULL) {
+    request->cancelled_source = g_cancellable_source_new (cancellable);
+    g_task_attach_source (task, request->cancelled_source, (GSourceFunc) on_request_cancelled);
+  }
+  g_hash_table_insert (priv->requests, g_strdup (id), g_object_ref (task));
+  g_mutex_unlock (&priv->requests_lock);
+
+  ygg_worker_transmit (self,
+                       (gchar *) addr,
+                       (gchar *) id,
+                       NULL,
+                       metadata,
+                       data,
+                       cancellable,
+                       request_transmit_done,
+                       task);
+}
+
+/**
+ * ygg_worker_request_finish:
+ * @worker: A #YggWorker.
+ * @res: A #GAsyncResult.
+ * @error: (out) (nullable): The return location for a recoverable error.
+ *
+ * Finishes a request started with ygg_worker_request_async().
+ *
+ * Returns: (transfer full) (nullable): The message that replied to the
+ * request, or %NULL on error.
+ */
+YggMessage *
+ygg_worker_request_finish (YggWorker     *self,
+                           GAsyncResult  *res,
+                           GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, self), NULL);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (res)) == ygg_worker_request_async, NULL);
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+
+/**
+ * WorkingEvent:
+ * @pending_message: The latest WORKING message held back by the rate limit.
+ * @flush_source: A timeout #GSource that fires one interval after each WORKING
+ * event is emitted. It emits @pending_message, or forgets the message ID if
+ * nothing was held back.
+ *
+ * The coalescing state of WORKING events for one message ID. It exists only
+ * for one interval after the last WORKING event was emitted, so WORKING events
+ * sent after the END event of their message are forgotten as well. Protected
+ * by the worker's events_lock.
+ */
+typedef struct {
+  gchar   *pending_message;
+  GSource *flush_source;
+} WorkingEvent;
+
+static void
+working_event_free (WorkingEvent *event)
+{
+  if (event->flush_source != NULL) {
+    g_source_destroy (event->flush_source);
+    g_source_unref (event->flush_source);
+  }
+  g_free (event->pending_message);
+  g_free (event);
+}
+
+typedef struct {
+  YggWorker *worker;
+  gchar     *message_id;
+} WorkingEventFlush;
+
+static void
+working_event_flush_free (gpointer data)
+{
+  WorkingEventFlush *flush = (WorkingEventFlush *) data;
+  g_free (flush->message_id);
+  g_free (flush);
+}
+
+static gboolean
+worker_emit_event_signal (YggWorker       *self,
+                          YggWorkerEvent   event,
+                          const gchar     *message_id,
+                          const gchar     *message,
+                          GError         **error)
+{
+  return worker_emit_signal (self,
+                             "com.redhat.Yggdrasil1.Worker1",
+                             "Event",
+                             g_variant_new ("(uss)", event, message_id, message != NULL ? message : ""),
+                             error);
+}
+
+static gboolean
+working_event_flush (gpointer user_data)
+{
+  WorkingEventFlush *flush = (WorkingEventFlush *) user_data;
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (flush->worker);
+  GError *err = NULL;
+
+  gboolean ret = G_SOURCE_REMOVE;
+
+  g_mutex_lock (&priv->events_lock);
+  WorkingEvent *event = g_hash_table_lookup (priv->working_events, flush->message_id);
+  if (event != NULL && event->flush_source == g_main_current_source ()) {
+    if (event->pending_message == NULL) {
+      /* Nothing was held back for a whole interval */
+      g_hash_table_remove (priv->working_events, flush->message_id);
+    } else {
+      g_autofree gchar *message = g_steal_pointer (&event->pending_message);
+      if (!worker_emit_event_signal (flush->worker, YGG_WORKER_EVENT_WORKING, flush->message_id, message, &err)) {
+        g_critical ("%s", err->message);
+        g_error_free (err);
+      }
+      /* Fire again one interval after this event */
+      ret = G_SOURCE_CONTINUE;
+    }
+  }
+  g_mutex_unlock (&priv->events_lock);
+
+  return ret;
+}
+
+/**
+ * worker_emit_working_event:
+ * @worker: A #YggWorker.
+ * @message_id: The message ID.
+ * @message: (nullable): The message to include with the signal.
+ * @interval: The minimum time between two WORKING events for @message_id, in
+ * milliseconds.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Emits a WORKING event, unless one was emitted for @message_id less than
+ * @interval ago. In that case @message is held back and emitted once the
+ * interval has passed, replacing any message already held back.
+ * @message_id is forgotten one interval after its last WORKING event.
+ *
+ * Returns: %TRUE unless an error occurred.
+ */
+static gboolean
+worker_emit_working_event (YggWorker    *self,
+                           const gchar  *message_id,
+                           const gchar  *message,
+                           guint         interval,
+                           GError      **error)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  gboolean ret = TRUE;
+
+  g_mutex_lock (&priv->events_lock);
+  WorkingEvent *event = g_hash_table_lookup (priv->working_events, message_id);
+  if (event == NULL) {
+    WorkingEventFlush *flush = g_new0 (WorkingEventFlush, 1);
+    flush->worker = self;
+    flush->message_id = g_strdup (message_id);
+    event = g_new0 (WorkingEvent, 1);
+    event->flush_source = g_timeout_source_new (interval);
+    g_source_set_callback (event->flush_source, working_event_flush, flush, working_event_flush_free);
+    g_source_attach (event->flush_source, NULL);
+    g_hash_table_insert (priv->working_events, g_strdup (message_id), event);
+    ret = worker_emit_event_signal (self, YGG_WORKER_EVENT_WORKING, message_id, message, error);
+  } else {
+    if (event->pending_message != NULL) {
+      g_atomic_int_inc (&priv->coalesced_events);
+    }
+    g_free (event->pending_message);
+    event->pending_message = g_strdup (message != NULL ? message : "");
+  }
+  g_mutex_unlock (&priv->events_lock);
+
+  return ret;
+}
+
+/**
+ * worker_emit_end_event:
+ * @worker: A #YggWorker.
+ * @message_id: The message ID.
+ * @message: (nullable): The message to include with the signal.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Emits any WORKING event held back for @message_id, followed by an END
+ * event, and forgets the coalescing state of @message_id.
+ *
+ * Returns: %TRUE unless an error occurred.
+ */
+static gboolean
+worker_emit_end_event (YggWorker    *self,
+                       const gchar  *message_id,
+                       const gchar  *message,
+                       GError      **error)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  gboolean ret = TRUE;
+
+  g_mutex_lock (&priv->events_lock);
+  WorkingEvent *event = g_hash_table_lookup (priv->working_events, message_id);
+  if (event != NULL && event->pending_message != NULL) {
+    ret = worker_emit_event_signal (self, YGG_WORKER_EVENT_WORKING, message_id, event->pending_message, error);
+  }
+  g_hash_table_remove (priv->working_events, message_id);
+  if (ret) {
+    ret = worker_emit_event_signal (self, YGG_WORKER_EVENT_END, message_id, message, error);
+  }
+  g_mutex_unlock (&priv->events_lock);
+
+  return ret;
 }
 
 /**
@@ -637,7 +3218,14 @@ ygg_worker_transmit (YggWorker           *self,
  * @message: (nullable): An optional message to include with the emitted signal.
  * @error: (nullable): Return location for a recoverable error.
  *
- * Emits a com.redhat.Yggdrasil1.Worker1.Event signal.
+ * Emits a com.redhat.Yggdrasil1.Worker1.Event signal. If the worker has not
+ * acquired its bus connection yet, the signal is queued and emitted as soon as
+ * it does.
+ *
+ * If #YggWorker:working-event-interval is set, %YGG_WORKER_EVENT_WORKING
+ * events for the same @message_id are rate limited: only the latest one within
+ * each interval is emitted. A held back WORKING event is always emitted before
+ * the %YGG_WORKER_EVENT_END event of its message.
  *
  * Returns: %TRUE if successful, %FALSE otherwise.
  */
@@ -647,25 +3235,82 @@ gboolean ygg_worker_emit_event (YggWorker       *self,
                                 const gchar     *message,
                                 GError         **error)
 {
-  GError *err = NULL;
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  guint interval = (guint) g_atomic_int_get (&priv->working_event_interval);
+
+  if (event == YGG_WORKER_EVENT_WORKING && interval > 0) {
+    return worker_emit_working_event (self, message_id, message, interval, error);
+  }
+  if (event == YGG_WORKER_EVENT_END) {
+    return worker_emit_end_event (self, message_id, message, error);
+  }
+
+  return worker_emit_event_signal (self, event, message_id, message, error);
+}
 
+/**
+ * ygg_worker_get_metrics:
+ * @worker: A #YggWorker instance.
+ *
+ * Takes a snapshot of the worker's metrics. The same snapshot is available on
+ * the bus as the Metrics property of the com.redhat.Yggdrasil1.Worker1.Metrics
+ * interface, on the worker's object path.
+ *
+ * The snapshot is a dictionary holding:
+ *
+ * - "queue-depth" and "coalesced-events" as "u": the current values of the
+ *   #YggWorker:queue-depth and #YggWorker:coalesced-events properties.
+ * - "spooled" as "u": the number of messages waiting in the worker's spool.
+ * - "journal-pending" as "u", when the worker has a journal: the number of
+ *   journaled messages that have not been handled yet.
+ * - "time-to-ready-us" as "t", once the worker is ready: the time from
+ *   connecting the worker until it owned its name on the bus.
+ * - "messages-allocated" and "messages-reused" as "t": the number of received
+ *   and transmitted messages that were allocated, and that reused a message
+ *   from the pool kept according to #YggWorker:message-pool-size.
+ * - "dispatch-received", "dispatch-rejected", "dispatch-errors",
+ *   "dispatch-duplicates", "messages-handled", "bytes-received", "transmits", "transmit-errors" and
+ *   "bytes-transmitted" as "t": counters since the worker was created.
+ * - "dispatch-latency-us" (from receiving a Dispatch call to invoking the
+ *   handler), "handler-duration-us" and "transmit-round-trip-us" as
+ *   "(tta(tt))": the number of values recorded, their sum, and for every
+ *   histogram bucket its upper bound and the number of values in it.
+ *
+ * Recording metrics takes only atomic operations, so this function may be
+ * called from any thread.
+ *
+ * Returns: (transfer full): A #GVariant of type "a{sv}".
+ */
+GVariant *
+ygg_worker_get_metrics (YggWorker *self)
+{
   YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+  GVariantBuilder builder;
 
-  g_assert_null (err);
-  GDBusConnection *connection = g_bus_get_sync (G_BUS_TYPE_STARTER, NULL, &err);
-  if (err != NULL && error != NULL) {
-    g_critical ("%s", err->message);
-    g_propagate_error (error, err);
-    return FALSE;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "queue-depth",
+                         g_variant_new_uint32 (g_atomic_int_get (&priv->queue_depth)));
+  g_variant_builder_add (&builder, "{sv}", "coalesced-events",
+                         g_variant_new_uint32 (g_atomic_int_get (&priv->coalesced_events)));
+  g_mutex_lock (&priv->lock);
+  gint64 time_to_ready = priv->time_to_ready;
+  g_mutex_unlock (&priv->lock);
+  if (time_to_ready > 0) {
+    g_variant_builder_add (&builder, "{sv}", "time-to-ready-us", g_variant_new_uint64 (time_to_ready));
+  }
+  g_variant_builder_add (&builder, "{sv}", "spooled",
+                         g_variant_new_uint32 (g_atomic_int_get (&priv->spooled)));
+  if (priv->journal != NULL) {
+    g_variant_builder_add (&builder, "{sv}", "journal-pending",
+                           g_variant_new_uint32 (ygg_journal_get_n_pending (priv->journal)));
   }
+  guint64 allocated = 0, reused = 0;
+  ygg_message_pool_get_stats (priv->message_pool, &allocated, &reused);
+  g_variant_builder_add (&builder, "{sv}", "messages-allocated", g_variant_new_uint64 (allocated));
+  g_variant_builder_add (&builder, "{sv}", "messages-reused", g_variant_new_uint64 (reused));
+  ygg_metrics_snapshot (&priv->metrics, &builder);
 
-  return g_dbus_connection_emit_signal (connection,
-                                        NULL,
-                                        priv->object_path,
-                                        "com.redhat.Yggdrasil1.Worker1",
-                                        "Event",
-                                        g_variant_new ("(uss)", event, message_id, message),
-                                        error);
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
 }
 
 /**
@@ -699,6 +3344,59 @@ ygg_worker_get_feature (YggWorker    *self,
   return value;
 }
 
+/**
+ * features_update:
+ * @worker: A #YggWorker instance.
+ * @key: The key to set in the features table.
+ * @value: The value to set in the features table.
+ * @changed: A #GVariantBuilder of type "a{sv}" to add the key to if its value
+ * changed.
+ *
+ * Returns: %TRUE if the value for @key changed.
+ */
+static gboolean
+features_update (YggWorker       *self,
+                 const gchar     *key,
+                 const gchar     *value,
+                 GVariantBuilder *changed)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  if (g_strcmp0 (ygg_metadata_get (priv->features, key), value) == 0) {
+    return FALSE;
+  }
+
+  ygg_metadata_set (priv->features, key, value);
+  metadata_foreach_builder_add_value (key, value, changed);
+
+  return TRUE;
+}
+
+/**
+ * worker_emit_features_changed:
+ * @worker: A #YggWorker instance.
+ * @changed: (transfer full): A #GVariantBuilder of type "a{sv}" holding the
+ * features that changed.
+ * @error: (nullable): Return location for a #GError.
+ *
+ * Emits a PropertiesChanged signal carrying only the features in @changed, and
+ * clears @changed.
+ *
+ * Returns: %TRUE if the signal was emitted.
+ */
+static gboolean
+worker_emit_features_changed (YggWorker        *self,
+                              GVariantBuilder  *changed,
+                              GError          **error)
+{
+  GVariant *parameters = g_variant_new ("(s@a{sv}@as)",
+                                        "com.redhat.Yggdrasil1.Worker1",
+                                        g_variant_builder_end (changed),
+                                        g_variant_new_array (G_VARIANT_TYPE_STRING, NULL, 0));
+
+  return worker_emit_signal (self, "org.freedesktop.DBus.Properties", "PropertiesChanged", parameters, error);
+}
+
 /**
  * ygg_worker_set_feature:
  * @worker: A #YggWorker instance.
@@ -706,9 +3404,12 @@ ygg_worker_get_feature (YggWorker    *self,
  * @value: (transfer none): The value to set in the features table.
  * @error: The return location for an error.
  *
- * Stores @value in the features table for @key.
+ * Stores @value in the features table for @key. A PropertiesChanged signal
+ * carrying only @key is emitted if its value changed. To change several
+ * features at once, use ygg_worker_set_features().
  *
- * Returns: TRUE if the key did not exist yet.
+ * Returns: TRUE if the key did not exist yet. If the signal could not be
+ * emitted, @value is still stored, %FALSE is returned and @error is set.
  */
 gboolean
 ygg_worker_set_feature (YggWorker    *self,
@@ -718,30 +3419,70 @@ ygg_worker_set_feature (YggWorker    *self,
 {
   YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
 
-  GError *err = NULL;
-  GDBusConnection *connection = g_bus_get_sync (G_BUS_TYPE_STARTER, NULL, &err);
-  if (err != NULL && error != NULL) {
-    g_critical ("%s", err->message);
-    g_propagate_error (error, err);
+  gboolean is_new = ygg_metadata_get (priv->features, key) == NULL;
+
+  GVariantBuilder changed;
+  g_variant_builder_init (&changed, G_VARIANT_TYPE ("a{sv}"));
+  if (!features_update (self, key, value, &changed)) {
+    g_variant_builder_clear (&changed);
+    return is_new;
+  }
+
+  if (!worker_emit_features_changed (self, &changed, error)) {
     return FALSE;
   }
 
-  gboolean exists = ygg_metadata_set (priv->features, key, value);
+  return is_new;
+}
 
-  GVariantBuilder builder;
-  g_variant_builder_init (&builder, G_VARIANT_TYPE ("(sa{sv}as)"));
-  g_variant_builder_add (&builder, "s", "com.redhat.Yggdrasil1.Worker1");
-  g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{sv}"));
-  ygg_metadata_foreach (priv->features, metadata_foreach_builder_add_value, &builder);
-  g_variant_builder_close (&builder);
-  g_variant_builder_add_value (&builder, g_variant_new_array (G_VARIANT_TYPE_STRING, NULL, 0));
-  GVariant *parameters = g_variant_builder_end (&builder);
-  g_assert_null (err);
-  if (!g_dbus_connection_emit_signal (connection, NULL, priv->object_path, "org.freedesktop.DBus.Properties", "PropertiesChanged", parameters, &err)) {
-    g_error ("%s", err->message);
+typedef struct {
+  YggWorker       *worker;
+  GVariantBuilder  changed;
+  guint            n_changed;
+} FeaturesUpdate;
+
+static void
+features_update_foreach (const gchar *key,
+                         const gchar *value,
+                         gpointer     user_data)
+{
+  FeaturesUpdate *update = (FeaturesUpdate *) user_data;
+
+  if (features_update (update->worker, key, value, &update->changed)) {
+    update->n_changed++;
+  }
+}
+
+/**
+ * ygg_worker_set_features:
+ * @worker: A #YggWorker instance.
+ * @features: (transfer none): The keys and values to set in the features table.
+ * @error: (nullable): The return location for an error.
+ *
+ * Stores every key/value pair of @features in the features table. Unlike
+ * calling ygg_worker_set_feature() for each of them, this emits a single
+ * PropertiesChanged signal that carries only the features whose values
+ * changed, and none at all if nothing changed.
+ *
+ * Returns: %TRUE on success, %FALSE if the signal could not be emitted.
+ */
+gboolean
+ygg_worker_set_features (YggWorker    *self,
+                         YggMetadata  *features,
+                         GError      **error)
+{
+  FeaturesUpdate update;
+
+  update.worker = self;
+  update.n_changed = 0;
+  g_variant_builder_init (&update.changed, G_VARIANT_TYPE ("a{sv}"));
+  ygg_metadata_foreach (features, features_update_foreach, &update);
+  if (update.n_changed == 0) {
+    g_variant_builder_clear (&update.changed);
+    return TRUE;
   }
 
-  return exists;
+  return worker_emit_features_changed (self, &update.changed, error);
 }
 
 /**
@@ -776,6 +3517,116 @@ ygg_worker_set_rx_func (YggWorker      *self,
   return TRUE;
 }
 
+/**
+ * ygg_worker_set_message_rx_func:
+ * @worker: A #YggWorker instance.
+ * @func: (scope notified) (closure user_data) (nullable): A #YggMessageRxFunc
+ * callback, or %NULL.
+ * @user_data: User data passed to @func when it is invoked.
+ * @notify (nullable): A #GDestroyNotify that is called when the reference to
+ * @func is dropped.
+ *
+ * Stores a pointer to a handler function that is invoked whenever data is
+ * received by the worker, in place of the function set with
+ * ygg_worker_set_rx_func(). The handler is passed the worker's own copy of the
+ * message rather than copies of each of its fields, so receiving a message
+ * does not allocate on the handler's behalf.
+ *
+ * Returns: %TRUE if setting the function handler succeeded.
+ */
+gboolean
+ygg_worker_set_message_rx_func (YggWorker        *self,
+                                YggMessageRxFunc  func,
+                                gpointer          user_data,
+                                GDestroyNotify    notify)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  if (priv->message_rx_func_data_notify != NULL) {
+    priv->message_rx_func_data_notify (priv->message_rx_func_user_data);
+  }
+
+  priv->message_rx_func = func;
+  priv->message_rx_func_user_data = user_data;
+  priv->message_rx_func_data_notify = notify;
+
+  return TRUE;
+}
+
+/**
+ * ygg_worker_set_stream_rx_func:
+ * @worker: A #YggWorker instance.
+ * @func: (scope notified) (closure user_data): A #YggStreamRxFunc callback.
+ * @user_data: User data passed to @func when it is invoked.
+ * @notify (nullable): A #GDestroyNotify that is called when the reference to
+ * @func is dropped.
+ *
+ * Stores a pointer to a handler function that is invoked whenever a chunked
+ * stream has been received in full. While a stream handler is set, received
+ * messages carrying %YGG_WORKER_CHUNK_STREAM_ID are reassembled into a
+ * temporary file rather than passed to the #YggRxFunc one by one, so memory use
+ * does not depend on the size of the stream.
+ *
+ * Returns: %TRUE if setting the function handler succeeded.
+ */
+gboolean
+ygg_worker_set_stream_rx_func (YggWorker       *self,
+                               YggStreamRxFunc  func,
+                               gpointer         user_data,
+                               GDestroyNotify   notify)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  if (priv->stream_rx_func_data_notify != NULL) {
+    priv->stream_rx_func_data_notify (priv->stream_rx_func_user_data);
+  }
+
+  priv->stream_rx_func = func;
+  priv->stream_rx_func_user_data = user_data;
+  priv->stream_rx_func_data_notify = notify;
+
+  return TRUE;
+}
+
+/**
+ * ygg_worker_set_trace_func:
+ * @worker: A #YggWorker instance.
+ * @func: (scope notified) (closure user_data) (nullable): A #YggTraceFunc
+ * callback, or %NULL to disable tracing.
+ * @user_data: User data passed to @func when it is invoked.
+ * @notify (nullable): A #GDestroyNotify that is called when the reference to
+ * @func is dropped.
+ *
+ * Stores a pointer to a function that is invoked with a monotonic timestamp
+ * each time a message reaches one of the points in #YggTracePoint. This makes
+ * it possible to find out where the time spent on individual slow messages
+ * goes. Tracing is disabled by default and costs close to nothing while it
+ * is.
+ *
+ * The function may be invoked from any thread, so it should be set before the
+ * worker is connected.
+ *
+ * Returns: %TRUE if setting the function handler succeeded.
+ */
+gboolean
+ygg_worker_set_trace_func (YggWorker      *self,
+                           YggTraceFunc    func,
+                           gpointer        user_data,
+                           GDestroyNotify  notify)
+{
+  YggWorkerPrivate *priv = ygg_worker_get_instance_private (self);
+
+  if (priv->trace_func_data_notify != NULL) {
+    priv->trace_func_data_notify (priv->trace_func_user_data);
+  }
+
+  priv->trace_func = func;
+  priv->trace_func_user_data = user_data;
+  priv->trace_func_data_notify = notify;
+
+  return TRUE;
+}
+
 /**
  * ygg_worker_set_event_func:
  * @worker: A #YggWorker instance.
@@ -818,6 +3669,24 @@ ygg_worker_constructed (GObject *object)
     priv->features = ygg_metadata_new ();
   }
 
+  if (priv->spool_enabled) {
+    priv->spool = ygg_spool_new (priv->spool_directory,
+                                 priv->spool_memory_limit,
+                                 G_VARIANT_TYPE ("(sssa{ss}ay)"),
+                                 (GDestroyNotify) spooled_task_abandon);
+  }
+
+  if (priv->max_concurrency > 0) {
+    GError *err = NULL;
+    priv->rx_pool = g_thread_pool_new (invoke_rx_thread, self, priv->max_concurrency, FALSE, &err);
+    if (err != NULL) {
+      g_critical ("unable to create thread pool: %s", err->message);
+      g_error_free (err);
+    } else {
+      g_thread_pool_set_sort_function (priv->rx_pool, message_compare_priority, NULL);
+    }
+  }
+
   G_OBJECT_CLASS (ygg_worker_parent_class)->constructed (object);
 }
 
@@ -831,11 +3700,74 @@ ygg_worker_dispose (GObject *object)
     priv->rx_func_data_notify (priv->rx_func_user_data);
   }
 
+  if (priv->message_rx_func_data_notify != NULL) {
+    priv->message_rx_func_data_notify (priv->message_rx_func_user_data);
+  }
+
   if (priv->event_func_data_notify != NULL) {
     priv->event_func_data_notify (priv->event_func_user_data);
   }
 
-  g_object_unref (priv->features);
+  if (priv->stream_rx_func_data_notify != NULL) {
+    priv->stream_rx_func_data_notify (priv->stream_rx_func_user_data);
+  }
+
+  if (priv->trace_func_data_notify != NULL) {
+    priv->trace_func_data_notify (priv->trace_func_user_data);
+  }
+
+  if (priv->assemblies_expire_id != 0) {
+    g_source_remove (priv->assemblies_expire_id);
+    priv->assemblies_expire_id = 0;
+  }
+  g_clear_pointer (&priv->assemblies, g_hash_table_unref);
+  g_clear_pointer (&priv->spool, ygg_spool_free);
+
+  g_mutex_lock (&priv->requests_lock);
+  GList *requests = g_hash_table_get_values (priv->requests);
+  g_hash_table_remove_all (priv->requests);
+  g_mutex_unlock (&priv->requests_lock);
+  for (GList *l = requests; l != NULL; l = l->next) {
+    worker_request_complete (G_TASK (l->data),
+                             NULL,
+                             g_error_new (G_IO_ERROR,
+                                          G_IO_ERROR_CLOSED,
+                                          "the worker was disposed before a reply arrived"));
+  }
+  g_list_free (requests);
+
+  g_mutex_lock (&priv->events_lock);
+  g_hash_table_remove_all (priv->working_events);
+  g_mutex_unlock (&priv->events_lock);
+
+  if (priv->connect_task != NULL) {
+    worker_connect_complete (self, g_error_new (G_IO_ERROR, G_IO_ERROR_CLOSED, "the worker was disposed"));
+  }
+  worker_disconnect (self);
+
+  if (!g_queue_is_empty (&priv->pending_calls)) {
+    g_autoptr (GError) closed = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CLOSED, "worker disposed before the call was issued");
+    PendingCall *call = NULL;
+    while ((call = g_queue_pop_head (&priv->pending_calls)) != NULL) {
+      pending_call_fail (call, closed);
+    }
+  }
+
+  PendingSignal *pending = NULL;
+  while ((pending = g_queue_pop_head (&priv->pending_signals)) != NULL) {
+    pending_signal_free (pending);
+  }
+
+  g_clear_object (&priv->features);
+
+  if (priv->rx_pool != NULL) {
+    /* Queued messages hold a reference on the worker, so the pool is idle by
+     * now. Messages release that reference on the thread that created the
+     * worker (see ygg_worker_release()), but do not wait all the same, in case
+     * a handler drops a reference of its own on a pool thread. */
+    g_thread_pool_free (priv->rx_pool, TRUE, FALSE);
+    priv->rx_pool = NULL;
+  }
 
   G_OBJECT_CLASS (ygg_worker_parent_class)->dispose (object);
 }
@@ -849,6 +3781,17 @@ ygg_worker_finalize (GObject *object)
   g_free (priv->directive);
   g_free (priv->bus_name);
   g_free (priv->object_path);
+  g_free (priv->priority_key);
+  g_free (priv->spool_directory);
+  g_free (priv->journal_directory);
+  g_clear_pointer (&priv->journal, ygg_journal_free);
+  g_hash_table_unref (priv->requests);
+  g_mutex_clear (&priv->requests_lock);
+  g_mutex_clear (&priv->lock);
+  g_hash_table_unref (priv->working_events);
+  g_mutex_clear (&priv->events_lock);
+  ygg_message_pool_free (priv->message_pool);
+  g_main_context_unref (priv->context);
 
   G_OBJECT_CLASS (ygg_worker_parent_class)->finalize (object);
 }
@@ -873,6 +3816,42 @@ ygg_worker_get_property (GObject    *object,
     case PROP_FEATURES:
       g_value_set_object (value, priv->features);
       break;
+    case PROP_MAX_CONCURRENCY:
+      g_value_set_uint (value, priv->max_concurrency);
+      break;
+    case PROP_MAX_IN_FLIGHT:
+      g_value_set_uint (value, g_atomic_int_get (&priv->max_in_flight));
+      break;
+    case PROP_QUEUE_DEPTH:
+      g_value_set_uint (value, g_atomic_int_get (&priv->queue_depth));
+      break;
+    case PROP_WORKING_EVENT_INTERVAL:
+      g_value_set_uint (value, g_atomic_int_get (&priv->working_event_interval));
+      break;
+    case PROP_COALESCED_EVENTS:
+      g_value_set_uint (value, g_atomic_int_get (&priv->coalesced_events));
+      break;
+    case PROP_MESSAGE_POOL_SIZE:
+      g_value_set_uint (value, priv->message_pool_size);
+      break;
+    case PROP_SPOOL:
+      g_value_set_boolean (value, priv->spool_enabled);
+      break;
+    case PROP_SPOOL_MEMORY_LIMIT:
+      g_value_set_uint (value, priv->spool_memory_limit);
+      break;
+    case PROP_SPOOL_DIRECTORY:
+      g_value_set_string (value, priv->spool_directory);
+      break;
+    case PROP_JOURNAL_DIRECTORY:
+      g_value_set_string (value, priv->journal_directory);
+      break;
+    case PROP_JOURNAL_SYNC:
+      g_value_set_boolean (value, priv->journal_sync);
+      break;
+    case PROP_PRIORITY_KEY:
+      g_value_set_string (value, priv->priority_key);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -900,7 +3879,41 @@ ygg_worker_set_property (GObject      *object,
       if (priv->features) {
         g_object_unref (priv->features);
       }
-      priv->features = YGG_METADATA (g_value_get_object (value));
+      priv->features = YGG_METADATA (g_value_dup_object (value));
+      break;
+    case PROP_MAX_CONCURRENCY:
+      priv->max_concurrency = g_value_get_uint (value);
+      break;
+    case PROP_MAX_IN_FLIGHT:
+      g_atomic_int_set (&priv->max_in_flight, g_value_get_uint (value));
+      break;
+    case PROP_WORKING_EVENT_INTERVAL:
+      g_atomic_int_set (&priv->working_event_interval, g_value_get_uint (value));
+      break;
+    case PROP_MESSAGE_POOL_SIZE:
+      priv->message_pool_size = g_value_get_uint (value);
+      ygg_message_pool_set_max_size (priv->message_pool, priv->message_pool_size);
+      break;
+    case PROP_SPOOL:
+      priv->spool_enabled = g_value_get_boolean (value);
+      break;
+    case PROP_SPOOL_MEMORY_LIMIT:
+      priv->spool_memory_limit = g_value_get_uint (value);
+      break;
+    case PROP_SPOOL_DIRECTORY:
+      g_free (priv->spool_directory);
+      priv->spool_directory = g_value_dup_string (value);
+      break;
+    case PROP_JOURNAL_DIRECTORY:
+      g_free (priv->journal_directory);
+      priv->journal_directory = g_value_dup_string (value);
+      break;
+    case PROP_JOURNAL_SYNC:
+      priv->journal_sync = g_value_get_boolean (value);
+      break;
+    case PROP_PRIORITY_KEY:
+      g_free (priv->priority_key);
+      priv->priority_key = g_value_dup_string (value);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -943,21 +3956,147 @@ ygg_worker_class_init (YggWorkerClass *klass)
    */
   properties[PROP_FEATURES] = g_param_spec_object ("features", NULL, NULL, YGG_TYPE_METADATA,
                                                   G_PARAM_READWRITE|G_PARAM_CONSTRUCT_ONLY);
+
+  /**
+   * YggWorker:max-concurrency:
+   *
+   * The maximum number of #YggRxFunc handlers to run concurrently. When 0 (the
+   * default), handlers run one at a time on the default main context. When
+   * greater than 0, handlers run on a thread pool of up to this many threads.
+   * ygg_worker_transmit() and ygg_worker_emit_event() may be called from those
+   * threads.
+   */
+  properties[PROP_MAX_CONCURRENCY] = g_param_spec_uint ("max-concurrency", NULL, NULL, 0, G_MAXINT, 0,
+                                                        G_PARAM_READWRITE|G_PARAM_CONSTRUCT_ONLY);
+
+  /**
+   * YggWorker:max-in-flight:
+   *
+   * The maximum number of received messages that may be queued or being
+   * handled at once. When the limit is reached, further Dispatch calls fail
+   * with %YGG_WORKER_ERROR_BUSY instead of being queued. Replies to a pending
+   * ygg_worker_request_async() and stream chunks are never queued, so they
+   * are not limited. 0 (the default) means no limit.
+   */
+  properties[PROP_MAX_IN_FLIGHT] = g_param_spec_uint ("max-in-flight", NULL, NULL, 0, G_MAXINT, 0,
+                                                      G_PARAM_READWRITE);
+
+  /**
+   * YggWorker:queue-depth:
+   *
+   * The number of received messages that are queued or being handled. This
+   * property changes from several threads and does not emit notifications.
+   */
+  properties[PROP_QUEUE_DEPTH] = g_param_spec_uint ("queue-depth", NULL, NULL, 0, G_MAXINT, 0,
+                                                    G_PARAM_READABLE|G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * YggWorker:priority-key:
+   *
+   * A metadata key used to schedule received messages. Messages whose value
+   * for this key is "high" are handled before queued messages with no value or
+   * any other value, and messages whose value is "low" are handled after them.
+   * Messages of equal priority are handled in the order they were received.
+   * When %NULL (the default), all messages are handled in the order they were
+   * received.
+   */
+  properties[PROP_PRIORITY_KEY] = g_param_spec_string ("priority-key", NULL, NULL, NULL,
+                                                       G_PARAM_READWRITE|G_PARAM_CONSTRUCT_ONLY);
+
+  /**
+   * YggWorker:working-event-interval:
+   *
+   * The minimum time in milliseconds between two %YGG_WORKER_EVENT_WORKING
+   * events for the same message. WORKING events emitted more often are
+   * coalesced, keeping only the latest. 0 (the default) disables coalescing.
+   */
+  properties[PROP_WORKING_EVENT_INTERVAL] = g_param_spec_uint ("working-event-interval", NULL, NULL, 0, G_MAXINT, 0,
+                                                               G_PARAM_READWRITE);
+
+  /**
+   * YggWorker:coalesced-events:
+   *
+   * The number of %YGG_WORKER_EVENT_WORKING events that were dropped because a
+   * later event for the same message replaced them. This property changes from
+   * several threads and does not emit notifications.
+   */
+  properties[PROP_COALESCED_EVENTS] = g_param_spec_uint ("coalesced-events", NULL, NULL, 0, G_MAXINT, 0,
+                                                         G_PARAM_READABLE|G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * YggWorker:message-pool-size:
+   *
+   * The maximum number of freed messages the worker keeps for reuse by later
+   * received or transmitted messages, instead of returning them to the
+   * allocator. 0 disables pooling.
+   */
+  properties[PROP_MESSAGE_POOL_SIZE] = g_param_spec_uint ("message-pool-size", NULL, NULL, 0, G_MAXINT, 64,
+                                                          G_PARAM_READWRITE|G_PARAM_CONSTRUCT);
+
+  /**
+   * YggWorker:spool:
+   *
+   * Whether messages passed to ygg_worker_transmit() are spooled while the
+   * dispatcher reports that it is disconnected, and transmitted in order once
+   * it reports %YGG_DISPATCHER_EVENT_CONNECTION_RESTORED. With a spool,
+   * transmits that fail with a transient D-Bus error are also retried with
+   * exponential backoff.
+   */
+  properties[PROP_SPOOL] = g_param_spec_boolean ("spool", NULL, NULL, FALSE,
+                                                 G_PARAM_READWRITE|G_PARAM_CONSTRUCT_ONLY);
+
+  /**
+   * YggWorker:spool-memory-limit:
+   *
+   * The number of bytes of spooled messages held in memory. Further messages
+   * are appended to a file in #YggWorker:spool-directory until the spool
+   * drains.
+   */
+  properties[PROP_SPOOL_MEMORY_LIMIT] = g_param_spec_uint ("spool-memory-limit", NULL, NULL, 0, G_MAXUINT, 16 * 1024 * 1024,
+                                                           G_PARAM_READWRITE|G_PARAM_CONSTRUCT_ONLY);
+
+  /**
+   * YggWorker:spool-directory:
+   *
+   * The directory spooled messages beyond #YggWorker:spool-memory-limit are
+   * written to. When %NULL (the default), the system temporary directory is
+   * used.
+   */
+  properties[PROP_SPOOL_DIRECTORY] = g_param_spec_string ("spool-directory", NULL, NULL, NULL,
+                                                          G_PARAM_READWRITE|G_PARAM_CONSTRUCT_ONLY);
+
+  /**
+   * YggWorker:journal-directory:
+   *
+   * The directory of the worker's journal. When set, each dispatched message is
+   * recorded in the journal before the Dispatch call is acknowledged, and
+   * marked done once the handler returns. Messages that were not handled when
+   * the worker exited are handled again when it next connects. The IDs of
+   * recently journaled messages are remembered, also across restarts, and
+   * Dispatch calls repeating one of them are acknowledged without handling
+   * the message again.
+   * Reassembled streams are not journaled. When %NULL (the default), there is
+   * no journal.
+   */
+  properties[PROP_JOURNAL_DIRECTORY] = g_param_spec_string ("journal-directory", NULL, NULL, NULL,
+                                                            G_PARAM_READWRITE|G_PARAM_CONSTRUCT_ONLY);
+
+  /**
+   * YggWorker:journal-sync:
+   *
+   * Whether journal writes are flushed to disk before a Dispatch call is
+   * acknowledged. Without it, the journal survives the worker exiting, but
+   * not the machine losing power.
+   */
+  properties[PROP_JOURNAL_SYNC] = g_param_spec_boolean ("journal-sync", NULL, NULL, FALSE,
+                                                        G_PARAM_READWRITE|G_PARAM_CONSTRUCT_ONLY);
   g_object_class_install_properties (object_class, N_PROPS, properties);
 
   GError *err = NULL;
 
   if (dispatcher_node_info == NULL) {
-    g_autofree gchar *dispatcher_xml_data = NULL;
-    g_assert (err == NULL);
-    if (!g_file_get_contents (DISPATCHER_INTERFACE_XML_PATH, &dispatcher_xml_data, NULL, &err)) {
-      if (err != NULL) {
-        g_error ("%s", err->message);
-      }
-    }
-
     g_assert (err == NULL);
-    dispatcher_node_info = g_dbus_node_info_new_for_xml (dispatcher_xml_data, &err);
+    dispatcher_node_info = load_node_info ("com.redhat.Yggdrasil1.Dispatcher1.xml", "YGG_DISPATCHER_INTERFACE_XML", &err);
     if (err != NULL) {
       g_error ("%s", err->message);
     }
@@ -965,20 +4104,20 @@ ygg_worker_class_init (YggWorkerClass *klass)
   }
 
   if (worker_node_info == NULL) {
-    g_autofree gchar *worker_xml_data = NULL;
     g_assert (err == NULL);
-    if (!g_file_get_contents (WORKER_INTERFACE_XML_PATH, &worker_xml_data, NULL, &err)) {
-      if (err != NULL) {
-        g_error ("%s", err->message);
-      }
+    worker_node_info = load_node_info ("com.redhat.Yggdrasil1.Worker1.xml", "YGG_WORKER_INTERFACE_XML", &err);
+    if (err != NULL) {
+      g_error ("%s", err->message);
     }
+    g_assert_nonnull (worker_node_info->interfaces);
+  }
 
+  if (metrics_node_info == NULL) {
     g_assert (err == NULL);
-    worker_node_info = g_dbus_node_info_new_for_xml (worker_xml_data, &err);
-    if (err != NULL ) {
+    metrics_node_info = g_dbus_node_info_new_for_xml (metrics_introspection_xml, &err);
+    if (err != NULL) {
       g_error ("%s", err->message);
     }
-    g_assert_nonnull (worker_node_info->interfaces);
   }
 }
 
@@ -989,5 +4128,16 @@ ygg_worker_init (YggWorker *self)
 
   priv->directive = NULL;
   priv->remote_content = FALSE;
+  g_queue_init (&priv->pending_calls);
+  g_queue_init (&priv->pending_signals);
+  g_mutex_init (&priv->lock);
+  priv->assemblies = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) stream_assembly_drop);
+  priv->requests = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_mutex_init (&priv->requests_lock);
+  priv->working_events = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) working_event_free);
+  g_mutex_init (&priv->events_lock);
+  priv->message_pool = ygg_message_pool_new (0);
+  priv->context = g_main_context_ref_thread_default ();
+  priv->owner = g_thread_self ();
 }
 
@@ -23,6 +23,7 @@
 
 #include <glib-object.h>
 #include <gio/gio.h>
+#include "ygg-message.h"
 #include "ygg-metadata.h"
 
 G_BEGIN_DECLS
@@ -42,6 +43,19 @@ GQuark ygg_worker_error_quark (void);
  * @YGG_WORKER_ERROR_UNKNOWN_METHOD: An unknown method was invoked on the worker.
  * @YGG_WORKER_ERROR_MISSING_FEATURE: The worker's feature table has no value for
  * the given key.
+ * @YGG_WORKER_ERROR_BUSY: A message could not be queued because the worker
+ * already has #YggWorker:max-in-flight messages queued or being handled, or
+ * the first chunk of a stream could not be accepted because the worker is
+ * already reassembling as many streams as it can. The two limits are
+ * independent: stream chunks do not count towards #YggWorker:max-in-flight.
+ * @YGG_WORKER_ERROR_TRANSMIT_FAILED: The dispatcher returned a negative
+ * response code.
+ * @YGG_WORKER_ERROR_INVALID_CHUNK: A chunk of a stream was received out of
+ * order or without a valid sequence number.
+ * @YGG_WORKER_ERROR_CONNECT_FAILED: The worker could not export its object or
+ * own its name on the bus.
+ * @YGG_WORKER_ERROR_TIMED_OUT: No reply to a request arrived within its
+ * timeout.
  *
  * Error codes returned by #YggWorker routines.
  */
@@ -49,9 +63,51 @@ typedef enum
 {
   YGG_WORKER_ERROR_INVALID_DIRECTIVE,
   YGG_WORKER_ERROR_UNKNOWN_METHOD,
-  YGG_WORKER_ERROR_MISSING_FEATURE
+  YGG_WORKER_ERROR_MISSING_FEATURE,
+  YGG_WORKER_ERROR_BUSY,
+  YGG_WORKER_ERROR_TRANSMIT_FAILED,
+  YGG_WORKER_ERROR_INVALID_CHUNK,
+  YGG_WORKER_ERROR_CONNECT_FAILED,
+  YGG_WORKER_ERROR_TIMED_OUT
 } YggWorkerError;
 
+/**
+ * YGG_WORKER_CHUNK_STREAM_ID:
+ *
+ * Metadata key carrying the ID of the stream a chunk sent by
+ * ygg_worker_transmit_stream() belongs to.
+ */
+#define YGG_WORKER_CHUNK_STREAM_ID "Ygg-Chunk-Stream-Id"
+
+/**
+ * YGG_WORKER_CHUNK_SEQUENCE:
+ *
+ * Metadata key carrying the zero-based position of a chunk within its stream.
+ */
+#define YGG_WORKER_CHUNK_SEQUENCE "Ygg-Chunk-Sequence"
+
+/**
+ * YGG_WORKER_CHUNK_TOTAL_SIZE:
+ *
+ * Metadata key carrying the total size of a stream in bytes. It is set on
+ * every chunk if the size is known up front, and on the final chunk otherwise.
+ */
+#define YGG_WORKER_CHUNK_TOTAL_SIZE "Ygg-Chunk-Total-Size"
+
+/**
+ * YGG_WORKER_CHUNK_FINAL:
+ *
+ * Metadata key set to "true" on the last chunk of a stream.
+ */
+#define YGG_WORKER_CHUNK_FINAL "Ygg-Chunk-Final"
+
+/**
+ * YGG_WORKER_DEFAULT_CHUNK_SIZE:
+ *
+ * The chunk size used by ygg_worker_transmit_stream() when none is given.
+ */
+#define YGG_WORKER_DEFAULT_CHUNK_SIZE (1024 * 1024)
+
 /**
  * YggWorkerEvent:
  * @YGG_WORKER_EVENT_BEGIN: Signal to indicate the worker has accepted the data
@@ -106,7 +162,9 @@ G_DECLARE_FINAL_TYPE (YggWorker, ygg_worker, YGG, WORKER, GObject)
  * @user_data: (closure): Data passed to the function when it is invoked.
  *
  * Signature for callback function used in ygg_worker_set_rx_func(). It is
- * invoked each time the worker receives data from the dispatcher.
+ * invoked each time the worker receives data from the dispatcher. If the
+ * worker's #YggWorker:max-concurrency is greater than 0, it is invoked on a
+ * thread pool thread rather than on the default main context.
  */
 typedef void (* YggRxFunc) (YggWorker   *worker,
                             gchar       *addr,
@@ -116,6 +174,140 @@ typedef void (* YggRxFunc) (YggWorker   *worker,
                             GBytes      *data,
                             gpointer     user_data);
 
+/**
+ * YggMessageRxFunc:
+ * @worker: (transfer none): A #YggWorker instance.
+ * @message: (transfer none): The received message.
+ * @user_data: (closure): Data passed to the function when it is invoked.
+ *
+ * Signature for callback function used in ygg_worker_set_message_rx_func().
+ * Unlike a #YggRxFunc, it borrows the fields of the received message instead
+ * of taking copies of them: @message is only valid until the function
+ * returns, unless the function takes a reference with ygg_message_ref(). If
+ * the worker's #YggWorker:max-concurrency is greater than 0, it is invoked on
+ * a thread pool thread rather than on the default main context.
+ */
+typedef void (* YggMessageRxFunc) (YggWorker  *worker,
+                                   YggMessage *message,
+                                   gpointer    user_data);
+
+/**
+ * YggStreamRxFunc:
+ * @worker: (transfer none): A #YggWorker instance.
+ * @addr: (transfer full): destination address of the data.
+ * @id: (transfer full): the ID of the stream, as sent in
+ *      %YGG_WORKER_CHUNK_STREAM_ID.
+ * @response_to: (transfer full) (nullable): a UUID the data is in response to
+ *               or %NULL.
+ * @metadata: (transfer full) (nullable): The key/value pairs of the final
+ *            chunk, or %NULL.
+ * @stream: (transfer full): A #GInputStream to read the reassembled data from.
+ * @user_data: (closure): Data passed to the function when it is invoked.
+ *
+ * Signature for callback function used in ygg_worker_set_stream_rx_func(). It
+ * is invoked once all the chunks of a stream sent with
+ * ygg_worker_transmit_stream() have been received. If the worker's
+ * #YggWorker:max-concurrency is greater than 0, it is invoked on a thread pool
+ * thread rather than on the default main context.
+ */
+typedef void (* YggStreamRxFunc) (YggWorker    *worker,
+                                  gchar        *addr,
+                                  gchar        *id,
+                                  gchar        *response_to,
+                                  YggMetadata  *metadata,
+                                  GInputStream *stream,
+                                  gpointer      user_data);
+
+/**
+ * YggTransmitItem:
+ * @addr: destination address of the data to be transmitted.
+ * @id: a UUID.
+ * @response_to: (nullable): a UUID the data is in response to or %NULL.
+ * @metadata: (nullable): Key-value pairs associated with the data or %NULL.
+ * @data: the data.
+ *
+ * A message to transmit with ygg_worker_transmit_batch().
+ */
+typedef struct
+{
+  const gchar *addr;
+  const gchar *id;
+  const gchar *response_to;
+  YggMetadata *metadata;
+  GBytes      *data;
+} YggTransmitItem;
+
+/**
+ * YggTransmitResult:
+ * @response_code: An integer status code. Negative if the message could not
+ * be transmitted.
+ * @response_metadata: (nullable): A map of key/value pairs received in
+ * response to the message.
+ * @response_data: (nullable): Data received in response to the message.
+ * @error: (nullable): The reason the message could not be transmitted, if
+ * known.
+ *
+ * The result of transmitting one message with ygg_worker_transmit_batch().
+ */
+typedef struct
+{
+  gint         response_code;
+  YggMetadata *response_metadata;
+  GBytes      *response_data;
+  GError      *error;
+} YggTransmitResult;
+
+void ygg_transmit_result_free (YggTransmitResult *result);
+
+/**
+ * YggTracePoint:
+ * @YGG_TRACE_POINT_DISPATCH_RECEIVED: A Dispatch call was received.
+ * @YGG_TRACE_POINT_QUEUED: A received message was queued for its handler.
+ * @YGG_TRACE_POINT_BEGIN_SENT: The %YGG_WORKER_EVENT_BEGIN event of a message
+ * was emitted.
+ * @YGG_TRACE_POINT_HANDLER_STARTED: The handler of a message was invoked.
+ * @YGG_TRACE_POINT_HANDLER_FINISHED: The handler of a message returned.
+ * @YGG_TRACE_POINT_END_SENT: The %YGG_WORKER_EVENT_END event of a message was
+ * emitted.
+ * @YGG_TRACE_POINT_TRANSMIT_ISSUED: A Transmit call was issued for a message.
+ * @YGG_TRACE_POINT_TRANSMIT_COMPLETED: The dispatcher replied to a Transmit
+ * call, or the call failed.
+ *
+ * Points in the life of a message at which a #YggTraceFunc is invoked.
+ */
+typedef enum
+{
+  YGG_TRACE_POINT_DISPATCH_RECEIVED = 1,
+  YGG_TRACE_POINT_QUEUED,
+  YGG_TRACE_POINT_BEGIN_SENT,
+  YGG_TRACE_POINT_HANDLER_STARTED,
+  YGG_TRACE_POINT_HANDLER_FINISHED,
+  YGG_TRACE_POINT_END_SENT,
+  YGG_TRACE_POINT_TRANSMIT_ISSUED,
+  YGG_TRACE_POINT_TRANSMIT_COMPLETED
+} YggTracePoint;
+
+/**
+ * YggTraceFunc:
+ * @worker: (transfer none): A #YggWorker instance.
+ * @point: The #YggTracePoint the message has reached.
+ * @id: (transfer none): The ID of the message.
+ * @response_to: (transfer none) (nullable): The ID of the message that the
+ * message is in response to, or %NULL.
+ * @timestamp: The time at which @point was reached, from
+ * g_get_monotonic_time().
+ * @user_data: (closure): Data passed to the function when it is invoked.
+ *
+ * Signature for callback function used in ygg_worker_set_trace_func(). It may
+ * be invoked from any thread and should return quickly.
+ */
+typedef void (* YggTraceFunc) (YggWorker     *worker,
+                               YggTracePoint  point,
+                               const gchar   *id,
+                               const gchar   *response_to,
+                               gint64         timestamp,
+                               gpointer       user_data);
+
 /**
  * YggEventFunc:
  * @event: The event received from the dispatcher.
@@ -135,6 +327,15 @@ YggWorker *ygg_worker_new (const gchar *directive,
 gboolean ygg_worker_connect (YggWorker  *worker,
                              GError    **error);
 
+void ygg_worker_connect_async (YggWorker           *worker,
+                               GCancellable        *cancellable,
+                               GAsyncReadyCallback  callback,
+                               gpointer             user_data);
+
+gboolean ygg_worker_connect_finish (YggWorker     *worker,
+                                    GAsyncResult  *res,
+                                    GError       **error);
+
 void ygg_worker_transmit (YggWorker           *worker,
                           gchar               *addr,
                           gchar               *id,
@@ -152,12 +353,55 @@ gboolean ygg_worker_transmit_finish (YggWorker     *worker,
                                      GBytes       **response_data,
                                      GError       **error);
 
+void ygg_worker_transmit_batch (YggWorker             *worker,
+                                const YggTransmitItem *items,
+                                guint                  n_items,
+                                guint                  max_in_flight,
+                                GCancellable          *cancellable,
+                                GAsyncReadyCallback    callback,
+                                gpointer               user_data);
+
+GPtrArray * ygg_worker_transmit_batch_finish (YggWorker     *worker,
+                                              GAsyncResult  *res,
+                                              GError       **error);
+
+void ygg_worker_transmit_stream (YggWorker           *worker,
+                                 const gchar         *addr,
+                                 const gchar         *id,
+                                 const gchar         *response_to,
+                                 YggMetadata         *metadata,
+                                 GInputStream        *stream,
+                                 gsize                chunk_size,
+                                 GCancellable        *cancellable,
+                                 GAsyncReadyCallback  callback,
+                                 gpointer             user_data);
+
+gboolean ygg_worker_transmit_stream_finish (YggWorker     *worker,
+                                            GAsyncResult  *res,
+                                            GError       **error);
+
+void ygg_worker_request_async (YggWorker           *worker,
+                               const gchar         *addr,
+                               const gchar         *id,
+                               YggMetadata         *metadata,
+                               GBytes              *data,
+                               guint                timeout,
+                               GCancellable        *cancellable,
+                               GAsyncReadyCallback  callback,
+                               gpointer             user_data);
+
+YggMessage * ygg_worker_request_finish (YggWorker     *worker,
+                                        GAsyncResult  *res,
+                                        GError       **error);
+
 gboolean ygg_worker_emit_event (YggWorker       *worker,
                                 YggWorkerEvent   event,
                                 const gchar     *message_id,
                                 const gchar     *message,
                                 GError         **error);
 
+GVariant * ygg_worker_get_metrics (YggWorker *worker);
+
 const gchar * ygg_worker_get_feature (YggWorker    *worker,
                                       const gchar  *key,
                                       GError      **error);
@@ -167,11 +411,30 @@ gboolean ygg_worker_set_feature (YggWorker    *worker,
                                  gchar        *value,
                                  GError      **error);
 
+gboolean ygg_worker_set_features (YggWorker    *worker,
+                                  YggMetadata  *features,
+                                  GError      **error);
+
 gboolean ygg_worker_set_rx_func (YggWorker      *worker,
                                  YggRxFunc       func,
                                  gpointer        user_data,
                                  GDestroyNotify  notify);
 
+gboolean ygg_worker_set_message_rx_func (YggWorker        *worker,
+                                         YggMessageRxFunc  func,
+                                         gpointer          user_data,
+                                         GDestroyNotify    notify);
+
+gboolean ygg_worker_set_stream_rx_func (YggWorker       *worker,
+                                        YggStreamRxFunc  func,
+                                        gpointer         user_data,
+                                        GDestroyNotify   notify);
+
+gboolean ygg_worker_set_trace_func (YggWorker      *worker,
+                                    YggTraceFunc    func,
+                                    gpointer        user_data,
+                                    GDestroyNotify  notify);
+
 gboolean ygg_worker_set_event_func (YggWorker      *worker,
                                     YggEventFunc    func,
                                     gpointer        user_data,
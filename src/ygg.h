@@ -25,6 +25,7 @@
 G_BEGIN_DECLS
 
 #define LIBYGG_INSIDE
+# include "ygg-message.h"
 # include "ygg-version.h"
 # include "ygg-worker.h"
 #undef LIBYGG_INSIDE